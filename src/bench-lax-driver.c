@@ -0,0 +1,382 @@
+/*
+ * Host-side (Linux) benchmark for LAXDRIVER.
+ *
+ * Compiles the driver against the mock kernel in laxhost.c, builds
+ * synthetic run queues and I/O databases of various sizes, and reports how
+ * long each call of the timer routine lax_stats_update_int holds the SCHED
+ * spinlock. A second table shows how the KTB walk budget bounds that time
+ * on very deep run queues whose depth drifts from tick to tick, and how
+ * close the estimated count comes, starting from no knowledge of the
+ * queues' depths. The
+ * next table shows how the scan of busy CPUs grows with the CPU count, and
+ * the last one the cost of the EWMA update for tables of various sizes.
+ *
+ * Build and run on Linux with:
+ *
+ *   cc -O2 -o bench-lax-driver bench-lax-driver.c laxhost.c
+ *   ./bench-lax-driver [iterations]
+ *
+ * Copyright 2022, Jake Hamby.
+ * MIT License.
+ */
+
+#define LAX_HOST 1
+
+#include "laxdriver.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* One synthetic system configuration to measure */
+
+typedef struct {
+    const char	*name;
+    int		com_ktbs;	/* computable threads */
+    int		como_ktbs;	/* computable but outswapped threads */
+    int		pgw_ktbs;	/* threads in page wait states */
+    uint64_t	prio_mask;	/* priority queues in use, bit 0 = pri 63 */
+    int		cpus;
+    int		busy_cpus;
+    int		disks;
+    int		others;		/* non-disk devices in the I/O database */
+} BENCH_CONFIG;
+
+/* Timesharing priorities 0-15 are bits 48-63 */
+#define TS_PRIOS	0xffff000000000000ULL
+
+static const BENCH_CONFIG configs[] = {
+    { "idle",	       0,     0,    0, 0,		 8,  0,   8,    50 },
+    { "small",	      16,     0,    2, 0x00f0000000000000ULL, 8, 8, 16, 200 },
+    { "medium",	    1000,   100,   30, TS_PRIOS,	32, 32,  64,  2000 },
+    { "large",	    5000,  1000,  300, TS_PRIOS,	64, 64, 256, 10000 },
+    { "realtime",   5000,  1000,  300, ~0ULL,		64, 64, 256, 10000 },
+};
+
+/* A very deep run queue for the walk budget table */
+
+static const BENCH_CONFIG deep_config =
+    { "deep",	  100000, 20000, 2000, TS_PRIOS,	64, 64,  64,   500 };
+
+static const uint32_t budgets[] = { 0, 65536, 16384, 4096, 1024 };
+
+/* CPU counts for the CPU scan table, each run with a quarter, half and
+ * all of them busy
+ */
+
+static const int cpu_counts[] = { 64, 256, 1024 };
+
+/* Accumulator counts for the EWMA table, rounded up to whole metrics of
+ * three windows each. The first is the classic nine averages.
+ */
+
+static const uint32_t ewma_sizes[] = { 9, 64, 512 };
+
+static LAX_UCB bench_ucb;
+
+static void bench_reset_ucb (uint32_t budget) {
+    SPL *dlck = bench_ucb.ucb$r_ucb.ucb$l_dlck;	/* kept across resets */
+
+    memset(&bench_ucb, 0, sizeof(bench_ucb));
+    bench_ucb.ucb$r_ucb.ucb$l_dlck = dlck;
+    lax_host_unit_init((UCB *)&bench_ucb);
+    lax_scan.walk_budget = budget;
+}
+
+/* One tick, a period after the last, so it takes a scan of its own */
+
+static void bench_tick (void) {
+    exe$gq_systime += bench_ucb.ucb$l_tqe.tqe$q_delta;
+    lax_stats_update_int(NULL, &bench_ucb, &bench_ucb.ucb$l_tqe);
+}
+
+static void bench_build (const BENCH_CONFIG *cfg) {
+    lax_host_build_runq(cfg->com_ktbs, cfg->como_ktbs, cfg->pgw_ktbs,
+			cfg->prio_mask);
+    lax_host_build_cpus(cfg->cpus, cfg->busy_cpus);
+    lax_host_build_iodb(cfg->disks, cfg->others);
+    lax_scan.rescan = true;	/* the old disk UCBs are gone */
+}
+
+static int compare_u64 (const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Time iterations updates, leaving the sorted total SCHED hold time of
+ * each call in samples[], and returning the mean time of the whole call.
+ */
+
+static uint64_t bench_time (uint64_t *samples, int iterations) {
+    /* warm up the caches before measuring */
+    for (int i = 0; i < 16; i++) {
+	bench_tick();
+    }
+
+    uint64_t call_ns = 0;
+
+    lax_host_reset_hold();
+    for (int i = 0; i < iterations; i++) {
+	uint64_t held = lax_host_sched_hold.total_ns;
+	uint64_t t0 = lax_host_nanotime();
+
+	bench_tick();
+
+	call_ns += lax_host_nanotime() - t0;
+	samples[i] = lax_host_sched_hold.total_ns - held;
+    }
+
+    qsort(samples, iterations, sizeof(uint64_t), compare_u64);
+    return call_ns / iterations;
+}
+
+static void bench_run (const BENCH_CONFIG *cfg, int iterations) {
+    uint64_t *samples = malloc(iterations * sizeof(uint64_t));
+    if (!samples) {
+	perror("malloc");
+	exit(EXIT_FAILURE);
+    }
+
+    bench_build(cfg);
+    bench_reset_ucb(LAX_WALK_BUDGET);
+    uint64_t call_ns = bench_time(samples, iterations);
+
+    uint64_t total_ns = 0;
+    for (int i = 0; i < iterations; i++) {
+	total_ns += samples[i];
+    }
+
+    printf("%-10s %7d %6d %7d %10llu %10llu %10llu %10llu %10llu   %g\n",
+	cfg->name, cfg->com_ktbs + cfg->como_ktbs + cfg->pgw_ktbs,
+	cfg->cpus, cfg->disks + cfg->others,
+	(unsigned long long)samples[0],
+	(unsigned long long)(total_ns / iterations),
+	(unsigned long long)samples[(iterations * 99) / 100],
+	(unsigned long long)samples[iterations - 1],
+	(unsigned long long)call_ns,
+	(double)bench_ucb.ucb$fx_avgs[0] / (1 << FX_SCALE));
+
+    free(samples);
+}
+
+/* Show what the driver's own profile says about the same configuration */
+
+static void bench_profile (const BENCH_CONFIG *cfg, int iterations) {
+    bench_build(cfg);
+    bench_reset_ucb(LAX_WALK_BUDGET);
+    for (int i = 0; i < iterations; i++) {
+	bench_tick();
+    }
+
+    const LAX_PROFILE *prof = &(bench_ucb.ucb$r_profile);
+    const double ticks = (double)prof->lax$q_ticks;
+
+    printf("%-10s %10u %10.0f %10u %10u %10.0f %10u %8.0f %8.0f\n", cfg->name,
+	prof->lax$r_stat[LAX$K_PROF_TICK].lax$l_min,
+	prof->lax$r_stat[LAX$K_PROF_TICK].lax$q_sum / ticks,
+	prof->lax$r_stat[LAX$K_PROF_TICK].lax$l_max,
+	prof->lax$r_stat[LAX$K_PROF_SCHED].lax$l_min,
+	prof->lax$r_stat[LAX$K_PROF_SCHED].lax$q_sum / ticks,
+	prof->lax$r_stat[LAX$K_PROF_SCHED].lax$l_max,
+	prof->lax$r_stat[LAX$K_PROF_KTBS].lax$q_sum / ticks,
+	prof->lax$r_stat[LAX$K_PROF_UCBS].lax$q_sum / ticks);
+}
+
+/* The deep run queue's size on tick n: it swings steadily between all of
+ * deep_config's and three quarters of it and back every four minutes
+ */
+
+static double bench_deep_scale (int n) {
+    return 0.75 + 0.25 * abs(n % 240 - 120) / 120.0;
+}
+
+/* Measure the deep run queue under each walk budget */
+
+static void bench_budgets (int iterations) {
+    const BENCH_CONFIG *cfg = &deep_config;
+    uint64_t *samples = malloc(iterations * sizeof(uint64_t));
+    if (!samples) {
+	perror("malloc");
+	exit(EXIT_FAILURE);
+    }
+
+    bench_build(cfg);
+
+    for (size_t i = 0; i < sizeof(budgets) / sizeof(budgets[0]); i++) {
+	double error_sum = 0, worst = 0;	/* of the count, as a fraction */
+	uint64_t walked = 0;
+
+	/* nothing is known of the queues' depths to begin with */
+	bench_reset_ucb(budgets[i]);
+	memset(lax_scan.qdepth, 0, sizeof(lax_scan.qdepth));
+	lax_scan.approx = false;
+	lax_scan.depth_time = 0;
+
+	lax_host_reset_hold();
+	for (int n = 0; n < iterations; n++) {
+	    const double scale = bench_deep_scale(n);
+	    const int com = (int)(cfg->com_ktbs * scale);
+	    const int como = (int)(cfg->como_ktbs * scale);
+	    const int pgw = (int)(cfg->pgw_ktbs * scale);
+	    const uint64_t held = lax_host_sched_hold.total_ns;
+
+	    lax_host_build_runq(com, como, pgw, cfg->prio_mask);
+	    bench_tick();
+	    samples[n] = lax_host_sched_hold.total_ns - held;
+
+	    /* every busy CPU adds one to the count */
+	    const uint32_t actual = com + como + pgw + cfg->busy_cpus;
+	    const uint32_t counted = lax_scan.proc_count;
+	    const double error = (double)((counted > actual) ?
+					  counted - actual :
+					  actual - counted) / actual;
+
+	    /* the ticks before the first full walk are as far off as the
+	     * budget is short, and count only toward the mean
+	     */
+	    error_sum += error;
+	    if ((lax_scan.depth_time != 0 || budgets[i] == 0) &&
+		error > worst) {
+		worst = error;
+	    }
+	    walked += lax_scan.ktbs_walked;
+	}
+	qsort(samples, iterations, sizeof(uint64_t), compare_u64);
+
+	printf("%-10u %10llu %10llu %10llu %8llu %7.2f%% %7.2f%%\n",
+	    budgets[i],
+	    (unsigned long long)samples[0],
+	    (unsigned long long)samples[(iterations * 99) / 100],
+	    (unsigned long long)samples[iterations - 1],
+	    (unsigned long long)(walked / iterations),
+	    100.0 * error_sum / iterations, 100.0 * worst);
+    }
+
+    free(samples);
+}
+
+/* Measure the SCHED hold time with many CPUs and nothing else to count */
+
+static void bench_cpus (int iterations) {
+    uint64_t *samples = malloc(iterations * sizeof(uint64_t));
+    if (!samples) {
+	perror("malloc");
+	exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < sizeof(cpu_counts) / sizeof(cpu_counts[0]); i++) {
+	for (int busy = cpu_counts[i] / 4; busy <= cpu_counts[i]; busy *= 2) {
+	    BENCH_CONFIG cfg = { "cpus", 0, 0, 0, 0, cpu_counts[i], busy, 8, 0 };
+
+	    bench_build(&cfg);
+	    bench_reset_ucb(LAX_WALK_BUDGET);
+	    bench_time(samples, iterations);
+
+	    uint64_t total_ns = 0;
+	    for (int j = 0; j < iterations; j++) {
+		total_ns += samples[j];
+	    }
+
+	    printf("%-6d %6d %10llu %10llu %10llu %10llu   %g\n",
+		cpu_counts[i], busy,
+		(unsigned long long)samples[0],
+		(unsigned long long)(total_ns / iterations),
+		(unsigned long long)samples[(iterations * 99) / 100],
+		(unsigned long long)samples[iterations - 1],
+		(double)bench_ucb.ucb$fx_avgs[0] / (1 << FX_SCALE));
+	}
+    }
+
+    free(samples);
+}
+
+/* Measure lax_ewma_update and lax_ewma_update64 in CPU cycles */
+
+static void bench_ewma (int iterations) {
+    for (size_t i = 0; i < sizeof(ewma_sizes) / sizeof(ewma_sizes[0]); i++) {
+	const uint32_t metrics = (ewma_sizes[i] + 2) / 3;
+	uint32_t *samples = malloc(metrics * sizeof(uint32_t));
+	uint32_t *avgs = calloc(metrics * 3, sizeof(uint32_t));
+	uint64_t *avgs64 = calloc(metrics * 3, sizeof(uint64_t));
+	if (!samples || !avgs || !avgs64) {
+	    perror("malloc");
+	    exit(EXIT_FAILURE);
+	}
+
+	for (uint32_t m = 0; m < metrics; m++) {
+	    samples[m] = (m * 2654435761U) >> (m % 24 + 8);
+	}
+
+	uint64_t best = UINT64_MAX, best64 = UINT64_MAX;
+
+	for (int n = 0; n < iterations; n++) {
+	    uint64_t t0 = lax_host_cycles();
+	    lax_ewma_update(avgs, 3, samples, metrics, lax_coef_table[2], 3);
+	    uint64_t t1 = lax_host_cycles();
+	    lax_ewma_update64(avgs64, 3, samples, metrics, lax_coef64_table[2], 3);
+	    uint64_t t2 = lax_host_cycles();
+
+	    if (t1 - t0 < best) best = t1 - t0;
+	    if (t2 - t1 < best64) best64 = t2 - t1;
+	}
+
+	printf("%-8u %8u %10llu %10.2f %10llu %10.2f\n", metrics * 3, metrics,
+	    (unsigned long long)best, (double)best / (metrics * 3),
+	    (unsigned long long)best64, (double)best64 / (metrics * 3));
+
+	free(samples);
+	free(avgs);
+	free(avgs64);
+    }
+}
+
+int main (int argc, char *argv[]) {
+    int iterations = 2000;
+
+    if (argc >= 2) {
+	iterations = atoi(argv[1]);
+	if (iterations <= 0) {
+	    fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+	    return EXIT_FAILURE;
+	}
+    }
+
+    printf("SCHED spinlock hold time per lax_stats_update_int call, in ns,\n");
+    printf("and mean time for the whole call\n\n");
+    printf("%-10s %7s %6s %7s %10s %10s %10s %10s %10s   %s\n",
+	"config", "KTBs", "CPUs", "UCBs", "min", "mean", "p99", "max",
+	"call", "1-min avg");
+
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+	bench_run(&configs[i], iterations);
+    }
+
+    printf("\nThe driver's own profile of the same updates, in cycles\n\n");
+    printf("%-10s %10s %10s %10s %10s %10s %10s %8s %8s\n", "config",
+	"tick min", "mean", "max", "SCHED min", "mean", "max", "KTBs", "UCBs");
+
+    for (size_t i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+	bench_profile(&configs[i], iterations);
+    }
+
+    printf("\nKTB walk budget on a run queue of up to %d KTBs\n\n",
+	deep_config.com_ktbs + deep_config.como_ktbs + deep_config.pgw_ktbs);
+    printf("%-10s %10s %10s %10s %8s %8s %8s\n",
+	"budget", "min", "p99", "max", "walked", "error", "worst");
+
+    bench_budgets(iterations / 4 + 1);
+
+    printf("\nSCHED hold time in ns by number of CPUs, with no other load\n\n");
+    printf("%-6s %6s %10s %10s %10s %10s   %s\n",
+	"CPUs", "busy", "min", "mean", "p99", "max", "1-min avg");
+
+    bench_cpus(iterations);
+
+    printf("\nEWMA update cost by number of averages, best of %d, in cycles\n\n",
+	iterations);
+    printf("%-8s %8s %10s %10s %10s %10s\n",
+	"avgs", "metrics", "32-bit", "per avg", "64-bit", "per avg");
+
+    bench_ewma(iterations);
+
+    return EXIT_SUCCESS;
+}
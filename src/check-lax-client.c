@@ -0,0 +1,185 @@
+/*
+ * Host-side (Linux) check and benchmark for the LAXDRIVER client library.
+ *
+ * Runs the client in laxclient.c against the driver compiled into the same
+ * program, through a transport that calls lax_read directly and a clock
+ * that only moves when told to. It checks that calls between two driver
+ * updates are answered from the cache, that the first call after an update
+ * is due reads the new values, that the fixed-point, double and batch
+ * calls agree with the driver's own averages, and that failures are
+ * reported the way getloadavg() reports them. Then it times calls served
+ * from the cache against calls that go through to the driver.
+ *
+ * Build and run on Linux with:
+ *
+ *   cc -O2 -o check-lax-client check-lax-client.c laxclient.c laxhost.c -lm
+ *   ./check-lax-client [calls]
+ *
+ * Copyright 2022, Jake Hamby.
+ * MIT License.
+ */
+
+#define LAX_HOST 1
+
+#include "laxdriver.c"
+#include "laxclient.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static LAX_UCB check_ucb;
+
+static uint64_t check_clock;		/* what the transport says the time is */
+static uint64_t check_reads;		/* transport reads */
+static bool check_fail;			/* make the transport fail */
+static int check_errors;
+
+#define CHECK(cond, what) \
+    do { if (!(cond)) { printf("FAILED: %s\n", what); check_errors++; } } while (0)
+
+/* The transport: reads go straight to the driver */
+
+static int check_read (void *ctx, uint32_t rec_code, void *buf, uint32_t len) {
+    if (check_fail) {
+	return SS$_DEVOFFLINE;
+    }
+
+    check_reads++;
+    return lax_host_read((UCB *)ctx, buf, len, rec_code, 0);
+}
+
+static uint64_t check_now (void *ctx) {
+    return check_clock;
+}
+
+/* Run the driver's timer routine at the current time */
+
+static void check_tick (void) {
+    exe$gq_systime = check_clock;
+    lax_stats_update_int(NULL, &check_ucb, &check_ucb.ucb$l_tqe);
+}
+
+static void check_cache (LAX_CLIENT *client) {
+    const uint64_t period = (uint64_t)check_ucb.ucb$l_period_ms * 10000;
+    double avgs[9];
+    uint32_t fx[9];
+    LAX_AVGS64 rec;
+
+    /* before the first update the record has no time; don't cache long */
+    CHECK(lax_client_getavg(client, avgs, 3) == 3, "getavg before first tick");
+    check_clock += LAX_CLIENT_RETRY / 2;
+    lax_client_getavg(client, avgs, 3);
+    CHECK(check_reads == 1, "cached briefly before first tick");
+    check_clock += LAX_CLIENT_RETRY;
+    lax_client_getavg(client, avgs, 3);
+    CHECK(check_reads == 2, "read again after retry interval");
+
+    /* several updates, with calls all through each period */
+    for (int tick = 0; tick < 20; tick++) {
+	check_tick();
+	const uint64_t reads = check_reads;
+	const uint64_t tick_time = check_clock;
+
+	for (int i = 0; i < 10; i++) {
+	    check_clock = tick_time + (period * i) / 10;
+	    CHECK(lax_client_get(client, &rec) & 1, "get");
+	}
+	CHECK(check_reads == reads + 1, "one read per update");
+	CHECK(rec.lax$l_seq == check_ucb.ucb$l_seq, "sequence number current");
+	CHECK(rec.lax$q_time == tick_time, "update time in record");
+	check_clock = tick_time + period;
+    }
+
+    /* all three forms agree with the driver */
+    lax_client_getfx(client, fx);
+    CHECK(lax_client_getavg(client, avgs, 9) == 9, "batch of nine");
+    for (int i = 0; i < 9; i++) {
+	const double fx_avg = (double)check_ucb.ucb$fx_avgs[i] / (1 << FX_SCALE);
+	const double q_avg = (double)check_ucb.ucb$q_avgs[i] / 4294967296.0;
+
+	CHECK(avgs[i] == q_avg, "double matches 64-bit average");
+	CHECK(fx[i] == (uint32_t)(check_ucb.ucb$q_avgs[i] >> 18),
+	      "fixed point from 64-bit average");
+	CHECK(fabs(fx_avg - avgs[i]) < 0.01, "close to classic average");
+    }
+
+    /* an update that's late is asked for again soon, not every call */
+    check_clock += period * 3;
+    const uint64_t reads = check_reads;
+    lax_client_getavg(client, avgs, 1);
+    lax_client_getavg(client, avgs, 1);
+    CHECK(check_reads == reads + 1, "late update polled at retry interval");
+
+    /* getloadavg() conventions */
+    CHECK(lax_client_getavg(client, avgs, 0) == 0, "nelem 0");
+    CHECK(lax_client_getavg(client, avgs, 20) == 9, "nelem clamped to 9");
+    CHECK(lax_client_getavg(client, avgs, -1) == -1, "negative nelem");
+
+    check_fail = true;
+    check_clock += period;
+    CHECK(lax_client_getavg(client, avgs, 3) == -1, "transport failure");
+    CHECK(!(lax_client_getfx(client, fx) & 1), "failure status passed back");
+    check_fail = false;
+    CHECK(lax_client_getavg(client, avgs, 3) == 3, "recovers after failure");
+
+    /* there's no default transport on the host */
+    CHECK(lax_getloadavg(avgs, 3) == -1, "lax_getloadavg without LAX0:");
+}
+
+/* Time calls answered from the cache, and calls that read the record */
+
+static void check_timing (LAX_CLIENT *client, int calls) {
+    const uint64_t period = (uint64_t)check_ucb.ucb$l_period_ms * 10000;
+    double avgs[3];
+
+    check_tick();
+    uint64_t t0 = lax_host_nanotime();
+    for (int i = 0; i < calls; i++) {
+	lax_client_getavg(client, avgs, 3);
+    }
+    const double cached = (double)(lax_host_nanotime() - t0) / calls;
+
+    t0 = lax_host_nanotime();
+    for (int i = 0; i < calls; i++) {
+	check_clock += period;		/* always due for an update */
+	lax_client_getavg(client, avgs, 3);
+    }
+    const double uncached = (double)(lax_host_nanotime() - t0) / calls;
+
+    printf("%d calls: %.1f ns from the cache, %.1f ns through lax_read\n",
+	calls, cached, uncached);
+    printf("(lax_read here is a function call; on VMS it is a $QIO)\n");
+}
+
+int main (int argc, char *argv[]) {
+    int calls = 1000000;
+
+    if (argc >= 2) {
+	calls = atoi(argv[1]);
+    }
+    if (calls <= 0) {
+	fprintf(stderr, "usage: %s [calls]\n", argv[0]);
+	return EXIT_FAILURE;
+    }
+
+    lax_host_build_runq(1000, 100, 30, 0xffff000000000000ULL);
+    lax_host_build_cpus(32, 32);
+    lax_host_build_iodb(16, 100);
+
+    lax_host_unit_init((UCB *)&check_ucb);
+    check_clock = exe$gq_systime;
+
+    const LAX_TRANSPORT transport = { check_read, check_now, NULL, &check_ucb };
+    LAX_CLIENT client;
+
+    CHECK(lax_client_open(&client, &transport) & 1, "open");
+    check_cache(&client);
+    check_timing(&client, calls);
+    printf("%llu records read, %llu calls from the cache\n",
+	(unsigned long long)client.fetches, (unsigned long long)client.hits);
+    lax_client_close(&client);
+
+    printf("\n%s\n", check_errors ? "FAILED" : "ok");
+    return check_errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,435 @@
+/*
+ * Host-side (Linux) check and benchmark for the cluster load table.
+ *
+ * Stands in for a cluster with one process per node. Each node process
+ * runs the driver compiled into this program on the mock kernel, under a
+ * load of its own that changes every minute, and answers record requests
+ * on a socket; a request carries the aggregator's clock, and the node runs
+ * the timer ticks due by then before answering, so every node keeps the
+ * same simulated time. A quarter of the nodes sample every 250 ms and the
+ * rest every second.
+ *
+ * The aggregator in laxcluster.c polls them all every 250 ms through a
+ * transport that makes those requests, keeping its table in a shared
+ * mapping, while another process asks the table for the least loaded node
+ * as fast as it can. After every poll the table's totals, order and ranks
+ * are checked against the node entries, and the least loaded node against
+ * a scan of all of them. A third of the way through a few nodes are
+ * killed, and they must be ranked last and left out of the totals until
+ * they are started again two thirds of the way through.
+ *
+ * Then it times a least-loaded query against the scan of every node's
+ * averages it replaces, and a poll.
+ *
+ * Build and run on Linux with:
+ *
+ *   cc -O2 -o check-lax-cluster check-lax-cluster.c laxcluster.c \
+ *      laxclient.c laxhost.c -lm
+ *   ./check-lax-cluster [nodes [polls]]
+ *
+ * It exits with a failure status if any check fails.
+ *
+ * Copyright 2022, Jake Hamby.
+ * MIT License.
+ */
+
+#define LAX_HOST 1
+
+#include "laxdriver.c"
+#include "laxcluster.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define CLUSTER_POLL	2500000ULL	/* 250 ms, in 100 ns units */
+#define CLUSTER_KILLED	5		/* nodes killed and restarted */
+#define CLUSTER_NOTICE	5		/* polls to notice they're down */
+#define SECOND		10000000ULL
+
+/* A request to a node process, and its reply, followed by the record */
+
+typedef struct {
+    uint64_t	now;
+    uint32_t	rec_code;
+    uint32_t	len;
+} NODE_REQUEST;
+
+typedef struct {
+    int32_t	status;
+    uint32_t	len;
+} NODE_REPLY;
+
+typedef struct {
+    int		fd;			/* aggregator's end of the socket */
+    pid_t	pid;
+    uint32_t	index;
+} NODE;
+
+/* Shared with the reader process */
+
+typedef struct {
+    LAX_CLUSTER	table;
+    volatile bool stop;
+    uint64_t	queries;		/* least-loaded queries made */
+    uint64_t	bad;			/*   that returned a node not */
+					/*   ranked first and up */
+} CLUSTER_SHARED;
+
+static CLUSTER_SHARED *shared;
+static LAX_AGGREGATOR agg;
+static NODE nodes[LAX$K_CLUSTER_NODES];
+static uint32_t node_count;
+static uint64_t cluster_clock;
+static int check_errors;
+
+#define CHECK(cond, what) \
+    do { if (!(cond)) { printf("FAILED: %s\n", what); check_errors++; } } while (0)
+
+static bool full_io (int fd, void *buf, size_t len, bool writing) {
+    char *p = buf;
+
+    while (len > 0) {
+	const ssize_t n = writing ? write(fd, p, len) : read(fd, p, len);
+
+	if (n <= 0) {
+	    return false;
+	}
+	p += n;
+	len -= n;
+    }
+    return true;
+}
+
+/* The node side */
+
+static LAX_UCB node_ucb;
+
+/* Each node's own load: a base level, and a step that moves every minute */
+
+static uint32_t node_load (uint32_t index, uint64_t t) {
+    return (index * 37) % 50 + ((t / (60 * SECOND) + index) % 5) * 4;
+}
+
+static void node_serve (int fd, uint32_t index) {
+    static uint8_t buf[4096];
+    NODE_REQUEST req;
+
+    lax_host_build_cpus(8, 0);
+    lax_host_build_iodb(4, 0);
+    lax_host_unit_init((UCB *)&node_ucb);
+    if (index % 4 == 0) {
+	lax_set_period(&node_ucb, 250);
+	lax_queue_tick(&node_ucb);	/* tick on the new grid from now on */
+    }
+
+    while (full_io(fd, &req, sizeof(req), false)) {
+	TQE *tqe = &node_ucb.ucb$l_tqe;
+	NODE_REPLY reply = { SS$_BADPARAM, 0 };
+
+	/* run the ticks that are due, as the timer would have */
+	while (tqe->tqe$q_time <= req.now) {
+	    exe$gq_systime = tqe->tqe$q_time;
+	    lax_host_build_runq(node_load(index, exe$gq_systime), 0, 0,
+				0xffff000000000000ULL);
+	    tqe->tqe$q_time = UINT64_MAX;
+	    lax_stats_update_int(NULL, &node_ucb, tqe);
+	}
+	exe$gq_systime = req.now;
+
+	if (req.len <= sizeof(buf)) {
+	    reply.status = lax_host_read((UCB *)&node_ucb, buf, req.len,
+					 req.rec_code, 0);
+	    reply.len = ($VMS_STATUS_SUCCESS(reply.status)) ? req.len : 0;
+	}
+	if (!full_io(fd, &reply, sizeof(reply), true) ||
+	    !full_io(fd, buf, reply.len, true)) {
+	    break;
+	}
+    }
+    _exit(0);
+}
+
+static void node_start (NODE *node) {
+    int sv[2];
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+	perror("socketpair");
+	exit(EXIT_FAILURE);
+    }
+
+    const pid_t pid = fork();
+    if (pid < 0) {
+	perror("fork");
+	exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+	for (uint32_t i = 0; i < node_count; i++) {
+	    if (nodes[i].fd >= 0) {
+		close(nodes[i].fd);
+	    }
+	}
+	close(sv[0]);
+	exe$gq_systime = cluster_clock;
+	node_serve(sv[1], node->index);
+    }
+
+    close(sv[1]);
+    node->fd = sv[0];
+    node->pid = pid;
+}
+
+static void node_kill (NODE *node) {
+    kill(node->pid, SIGKILL);
+    waitpid(node->pid, NULL, 0);
+    close(node->fd);
+    node->fd = -1;
+}
+
+/* The aggregator's transport: one request and reply per read */
+
+static int cluster_read (void *ctx, uint32_t rec_code, void *buf, uint32_t len) {
+    const NODE *node = ctx;
+    const NODE_REQUEST req = { cluster_clock, rec_code, len };
+    NODE_REPLY reply;
+
+    if (node->fd < 0 || !full_io(node->fd, (void *)&req, sizeof(req), true) ||
+	!full_io(node->fd, &reply, sizeof(reply), false) || reply.len > len ||
+	!full_io(node->fd, buf, reply.len, false)) {
+	return SS$_DEVOFFLINE;
+    }
+    return reply.status;
+}
+
+static uint64_t cluster_now (void *ctx) {
+    return cluster_clock;
+}
+
+/* The reader process: least-loaded queries until told to stop */
+
+static void cluster_reader (void) {
+    uint64_t queries = 0, bad = 0;
+
+    while (!shared->stop) {
+	LAX_NODE node;
+
+	if (lax_cluster_least_loaded(&shared->table, &node) >= 0 &&
+	    (node.lax$l_rank != 0 || (node.lax$l_state & LAX$M_NODE_DOWN))) {
+	    bad++;
+	}
+	queries++;
+    }
+    shared->queries = queries;
+    shared->bad = bad;
+    _exit(0);
+}
+
+/* Check the whole table against its node entries */
+
+static void cluster_verify (void) {
+    const LAX_CLUSTER *table = &shared->table;
+    const uint32_t rank_avg = table->lax$l_rank_avg;
+    uint64_t total[9] = { 0 };
+    uint32_t up = 0;
+    int best = -1;
+
+    for (uint32_t i = 0; i < table->lax$l_node_count; i++) {
+	const LAX_NODE *node = &table->lax$r_node[i];
+
+	CHECK(table->lax$w_order[node->lax$l_rank] == i, "rank matches order");
+	if (node->lax$l_state & LAX$M_NODE_DOWN) {
+	    continue;
+	}
+	up++;
+	for (int a = 0; a < 9; a++) {
+	    total[a] += node->lax$q_avgs[a];
+	}
+	if (best < 0 || node->lax$q_avgs[rank_avg] <
+			table->lax$r_node[best].lax$q_avgs[rank_avg]) {
+	    best = (int)i;
+	}
+    }
+
+    CHECK(up == table->lax$l_up_count, "up count");
+    CHECK(memcmp(total, table->lax$q_total, sizeof(total)) == 0, "totals");
+
+    for (uint32_t r = 1; r < table->lax$l_node_count; r++) {
+	const LAX_NODE *prev = &table->lax$r_node[table->lax$w_order[r - 1]];
+	const LAX_NODE *node = &table->lax$r_node[table->lax$w_order[r]];
+	const bool prev_down = (prev->lax$l_state & LAX$M_NODE_DOWN) != 0;
+	const bool down = (node->lax$l_state & LAX$M_NODE_DOWN) != 0;
+
+	CHECK(!prev_down || down, "down nodes ranked last");
+	CHECK(down || prev->lax$q_avgs[rank_avg] <= node->lax$q_avgs[rank_avg],
+	      "order sorted");
+    }
+
+    const int least = lax_cluster_least_loaded(table, NULL);
+    CHECK(least == best ||
+	  (best >= 0 && table->lax$r_node[least].lax$q_avgs[rank_avg] ==
+			table->lax$r_node[best].lax$q_avgs[rank_avg]),
+	  "least loaded node");
+}
+
+/* Time least-loaded queries, the scan they replace, and polls */
+
+static void cluster_timing (int calls) {
+    const LAX_CLUSTER *table = &shared->table;
+    volatile int sink = 0;
+
+    uint64_t t0 = lax_host_nanotime();
+    for (int i = 0; i < calls; i++) {
+	sink += lax_cluster_least_loaded(table, NULL);
+    }
+    const double query = (double)(lax_host_nanotime() - t0) / calls;
+
+    t0 = lax_host_nanotime();
+    for (int i = 0; i < calls; i++) {
+	uint64_t best = UINT64_MAX;
+	int index = -1;
+
+	for (uint32_t n = 0; n < node_count; n++) {
+	    const LAX_NODE *node = &table->lax$r_node[n];
+
+	    if (!(node->lax$l_state & LAX$M_NODE_DOWN) &&
+		node->lax$q_avgs[LAX$K_AVG_LOAD_1] < best) {
+		best = node->lax$q_avgs[LAX$K_AVG_LOAD_1];
+		index = (int)n;
+	    }
+	}
+	sink += index;
+    }
+    const double scan = (double)(lax_host_nanotime() - t0) / calls;
+
+    const uint32_t polls = 40;
+    uint64_t reads = 0;
+
+    for (uint32_t n = 0; n < node_count; n++) {
+	reads -= agg.client[n].fetches;
+    }
+    t0 = lax_host_nanotime();
+    for (uint32_t i = 0; i < polls; i++) {
+	cluster_clock += CLUSTER_POLL;
+	lax_cluster_poll(&agg);
+    }
+    const double poll = (double)(lax_host_nanotime() - t0) / polls;
+    for (uint32_t n = 0; n < node_count; n++) {
+	reads += agg.client[n].fetches;
+    }
+
+    printf("least loaded of %u nodes: %.1f ns from the table, %.1f ns "
+	"scanning every node\n", node_count, query, scan);
+    printf("poll: %.1f us, %.1f records read\n", poll / 1000,
+	(double)reads / polls);
+    printf("(a read here is a round trip to another process; over a network "
+	"it costs more)\n");
+}
+
+int main (int argc, char *argv[]) {
+    uint32_t polls = 1200;
+
+    node_count = 256;
+    if (argc >= 2) {
+	node_count = (uint32_t)strtoul(argv[1], NULL, 10);
+    }
+    if (argc >= 3) {
+	polls = (uint32_t)strtoul(argv[2], NULL, 10);
+    }
+    if (node_count <= CLUSTER_KILLED || node_count > LAX$K_CLUSTER_NODES ||
+	polls < 6 * CLUSTER_NOTICE) {
+	fprintf(stderr, "usage: %s [nodes [polls]], %d to %d nodes, at least "
+	    "%d polls\n", argv[0], CLUSTER_KILLED + 1, LAX$K_CLUSTER_NODES,
+	    6 * CLUSTER_NOTICE);
+	return EXIT_FAILURE;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED) {
+	perror("mmap");
+	return EXIT_FAILURE;
+    }
+    CHECK(lax_cluster_init(&agg, &shared->table, LAX$K_AVG_LOAD_1) & 1, "init");
+    cluster_clock = exe$gq_systime;
+
+    for (uint32_t i = 0; i < node_count; i++) {
+	nodes[i].fd = -1;
+    }
+    for (uint32_t i = 0; i < node_count; i++) {
+	const LAX_TRANSPORT transport = { cluster_read, cluster_now, NULL,
+					  &nodes[i] };
+	char name[16];
+
+	nodes[i].index = i;
+	node_start(&nodes[i]);
+	snprintf(name, sizeof(name), "NODE%u", i);
+	CHECK(lax_cluster_add(&agg, name, &transport) == (int)i, "add");
+    }
+
+    const pid_t reader = fork();
+    if (reader == 0) {
+	cluster_reader();
+    }
+
+    for (uint32_t p = 1; p <= polls; p++) {
+	cluster_clock += CLUSTER_POLL;
+	lax_cluster_poll(&agg);
+	cluster_verify();
+
+	if (p == polls / 3) {
+	    for (int k = 0; k < CLUSTER_KILLED; k++) {
+		node_kill(&nodes[k * (node_count / CLUSTER_KILLED)]);
+	    }
+	} else if (p == polls / 3 + CLUSTER_NOTICE) {
+	    /* noticed once each node's next update is due */
+	    CHECK(shared->table.lax$l_up_count == node_count - CLUSTER_KILLED,
+		  "killed nodes down");
+	} else if (p == polls * 2 / 3) {
+	    for (int k = 0; k < CLUSTER_KILLED; k++) {
+		node_start(&nodes[k * (node_count / CLUSTER_KILLED)]);
+	    }
+	} else if (p == polls * 2 / 3 + 1) {
+	    const NODE *node = &nodes[0];
+	    LAX_NODE entry;
+
+	    CHECK(shared->table.lax$l_up_count == node_count, "nodes back up");
+	    CHECK(lax_cluster_node(&shared->table, node->index, &entry) &&
+		  (entry.lax$l_flags & LAX$M_RESTARTED), "restart flagged");
+	    CHECK(entry.lax$l_failures > 0, "failures counted");
+	}
+    }
+
+    shared->stop = true;
+    waitpid(reader, NULL, 0);
+
+    uint64_t total[9];
+    uint32_t up;
+    LAX_NODE least;
+
+    lax_cluster_totals(&shared->table, total, &up);
+    lax_cluster_least_loaded(&shared->table, &least);
+    printf("%u nodes, %u polls: %llu node updates, least loaded %s at %.2f, "
+	"cluster total %.2f\n", node_count, polls,
+	(unsigned long long)agg.changes, least.lax$t_name,
+	(double)least.lax$q_avgs[LAX$K_AVG_LOAD_1] / 4294967296.0,
+	(double)total[LAX$K_AVG_LOAD_1] / 4294967296.0);
+    printf("reader process: %llu queries, %llu inconsistent\n",
+	(unsigned long long)shared->queries, (unsigned long long)shared->bad);
+    CHECK(shared->bad == 0, "reader saw a consistent table");
+    CHECK(shared->queries > 0, "reader ran");
+
+    cluster_timing(1000000);
+
+    lax_cluster_close(&agg);
+    for (uint32_t i = 0; i < node_count; i++) {
+	node_kill(&nodes[i]);
+    }
+
+    printf("\n%s\n", check_errors ? "FAILED" : "ok");
+    return check_errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
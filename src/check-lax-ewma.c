@@ -0,0 +1,243 @@
+/*
+ * Host-side (Linux) accuracy check for LAXDRIVER's fixed-point averages.
+ *
+ * Feeds sample streams covering the whole 0 to UINT32_MAX range through
+ * both the classic 32-bit averages (14 fraction bits) and the 64-bit ones
+ * (32 fraction bits), for every sampling period and window, and compares
+ * each result with the same average computed in double precision.
+ *
+ * The bounds checked are what the fixed-point arithmetic can guarantee:
+ * each update truncates by at most one unit in the last place and each
+ * weight is rounded to its own number of fraction bits, and those errors
+ * decay with the average, so they can add up to 1 / (1 - exp(-T/W)) of
+ * the error of a single update. The 32-bit averages are compared with a
+ * reference whose samples are clamped to the largest value they can hold.
+ *
+ * It also checks the coefficients the driver computes for user-defined
+ * windows: exp(-T/W) from its fixed-point exponential must round to the
+ * same value as the C library's for every window length allowed at every
+ * period, and match the generated table for the standard windows.
+ *
+ * Build and run on Linux with:
+ *
+ *   cc -O2 -o check-lax-ewma check-lax-ewma.c laxhost.c -lm
+ *   ./check-lax-ewma [updates]
+ *
+ * It prints the worst error seen as a fraction of the bound for each
+ * period and window, and exits with a failure status if any is exceeded.
+ *
+ * Copyright 2022, Jake Hamby.
+ * MIT License.
+ */
+
+#define LAX_HOST 1
+
+#include "laxdriver.c"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* Sample streams to check */
+
+typedef enum {
+    PAT_ZERO, PAT_ONE, PAT_SMALL, PAT_MAX32, PAT_MAX,
+    PAT_ALTERNATE, PAT_STEP, PAT_LOG_RANDOM, PAT_COUNT
+} CHECK_PATTERN;
+
+static const char *pattern_names[PAT_COUNT] = {
+    "zero", "one", "1000", "max 32-bit", "UINT32_MAX",
+    "0/UINT32_MAX", "max then 0", "log-random"
+};
+
+static uint32_t check_sample (CHECK_PATTERN pat, uint32_t n, uint32_t updates) {
+    switch (pat) {
+    case PAT_ZERO:	return 0;
+    case PAT_ONE:	return 1;
+    case PAT_SMALL:	return 1000;
+    case PAT_MAX32:	return FX_MAX_SAMPLE;
+    case PAT_MAX:	return UINT32_MAX;
+    case PAT_ALTERNATE:	return (n & 1) ? UINT32_MAX : 0;
+    case PAT_STEP:	return (n < updates / 2) ? UINT32_MAX : 0;
+    default: {
+	/* spread evenly over the number of bits, not over the values */
+	const uint32_t bits = lax_host_random() % 33;
+	return (bits == 0) ? 0 : (lax_host_random() >> (32 - bits));
+    }
+    }
+}
+
+/* Worst errors for one period, over all patterns, by window */
+
+typedef struct {
+    double	ratio32[3];		/* error / bound */
+    double	ratio64[3];
+    int		wrapped;
+} CHECK_RESULT;
+
+static void check_stream (int period, CHECK_PATTERN pat, uint32_t updates,
+			  CHECK_RESULT *res) {
+    const LAX_COEF *coef = lax_coef_table[period];
+    const LAX_COEF64 *coef64 = lax_coef64_table[period];
+    const double fx32 = (double)(1 << FX_SCALE);
+    const double fx64 = 4294967296.0;
+    uint32_t avgs32[3] = { 0 };
+    uint64_t avgs64[3] = { 0 };
+    double ref32[3] = { 0 }, ref64[3] = { 0 };
+    double decay[3];
+    double max_sample = 0, max_sample64 = 0, max_ref = 0;
+
+    for (int w = 0; w < 3; w++) {
+	decay[w] = exp(-(lax_coef_period_ms[period] / 1000.0) /
+		       (60.0 * ((w == 0) ? 1 : (w == 1) ? 5 : 15)));
+    }
+
+    for (uint32_t n = 0; n < updates; n++) {
+	const uint32_t sample = check_sample(pat, n, updates);
+	const double s64 = sample;
+	const double s32 = (sample > FX_MAX_SAMPLE) ? FX_MAX_SAMPLE : sample;
+	uint32_t prev32[3];
+	uint64_t prev64[3];
+
+	memcpy(prev32, avgs32, sizeof(prev32));
+	memcpy(prev64, avgs64, sizeof(prev64));
+	lax_ewma_update(avgs32, 3, &sample, 1, coef, 3);
+	lax_ewma_update64(avgs64, 3, &sample, 1, coef64, 3);
+
+	if (s32 > max_sample) max_sample = s32;
+	if (s64 > max_sample64) max_sample64 = s64;
+
+	for (int w = 0; w < 3; w++) {
+	    const double gain = 1.0 / (1.0 - decay[w]);
+
+	    ref32[w] = ref32[w] * decay[w] + s32 * (1.0 - decay[w]);
+	    ref64[w] = ref64[w] * decay[w] + s64 * (1.0 - decay[w]);
+	    if (ref32[w] > max_ref) max_ref = ref32[w];
+
+	    /* an average can't move away from a sample on the other side */
+	    if ((sample == UINT32_MAX && (avgs32[w] < prev32[w] ||
+					  avgs64[w] < prev64[w])) ||
+		(sample == 0 && (avgs32[w] > prev32[w] ||
+				 avgs64[w] > prev64[w]))) {
+		res->wrapped++;
+	    }
+
+	    const double bound32 = (ldexp(1, -FX_SCALE) +
+				    ldexp(1, -(FX_RSHIFT + 1)) * max_ref +
+				    ldexp(1, -33) * max_sample) * gain;
+	    const double bound64 = (ldexp(1, -32) +
+				    ldexp(1, -32) * max_sample64) * gain;
+	    const double err32 = fabs(avgs32[w] / fx32 - ref32[w]);
+	    const double err64 = fabs(avgs64[w] / fx64 - ref64[w]);
+
+	    if (err32 / bound32 > res->ratio32[w]) res->ratio32[w] = err32 / bound32;
+	    if (err64 / bound64 > res->ratio64[w]) res->ratio64[w] = err64 / bound64;
+	}
+    }
+}
+
+/* Check lax_compute_coef for every period and window length, returning
+ * the number of mismatches
+ */
+
+static int check_coefs (void) {
+    int bad = 0;
+
+    for (int period = 0; period < LAXCOEF_NPERIODS; period++) {
+	const uint32_t period_ms = lax_coef_period_ms[period];
+	int64_t worst = 0;
+
+	for (uint32_t window_s = LAX$K_WINDOW_MIN; window_s <= LAX$K_WINDOW_MAX;
+	     window_s++) {
+	    LAX_COEF coef;
+	    LAX_COEF64 coef64;
+
+	    lax_compute_coef(period_ms, window_s, &coef, &coef64);
+
+	    /* within one unit of the correctly rounded value; exp() itself
+	     * may be off by an ulp, and ties can go either way
+	     */
+	    const double decay = exp(-(period_ms / 1000.0) / window_s);
+	    int64_t d64 = (int64_t)coef64.old_lav - (int64_t)llround(ldexp(decay, 32));
+	    int64_t d32 = (int64_t)coef.old_lav - (int64_t)llround(ldexp(decay, FX_RSHIFT));
+
+	    if (llabs(d64) > llabs(worst)) worst = d64;
+	    if (llabs(d64) > 1 || llabs(d32) > 1 ||
+		(uint64_t)coef64.old_lav + coef64.new_lav != (1ULL << 32) ||
+		coef.new_lav != (((1U << FX_RSHIFT) - coef.old_lav) << (FX_SCALE - FX_LSHIFT))) {
+		if (bad++ < 10) {
+		    printf("%u ms, %u s: old %u (%+lld), old64 %u (%+lld)\n",
+			period_ms, window_s, coef.old_lav, (long long)d32,
+			coef64.old_lav, (long long)d64);
+		}
+	    }
+	}
+
+	for (int w = 0; w < LAXCOEF_NWINDOWS; w++) {
+	    LAX_COEF coef;
+	    LAX_COEF64 coef64;
+
+	    lax_compute_coef(period_ms, lax_coef_window_s[w], &coef, &coef64);
+	    if (coef.old_lav != lax_coef_table[period][w].old_lav ||
+		coef64.old_lav != lax_coef64_table[period][w].old_lav ||
+		coef64.new_lav != lax_coef64_table[period][w].new_lav) {
+		printf("%u ms, %u s: differs from laxcoef.h\n",
+		    period_ms, lax_coef_window_s[w]);
+		bad++;
+	    }
+	}
+
+	printf("%6u ms   %u windows, worst 64-bit old_lav error %+lld\n",
+	    period_ms, LAX$K_WINDOW_MAX - LAX$K_WINDOW_MIN + 1, (long long)worst);
+    }
+
+    return bad;
+}
+
+int main (int argc, char *argv[]) {
+    uint32_t updates = 100000;
+    bool failed = false;
+
+    if (argc >= 2) {
+	updates = (uint32_t)strtoul(argv[1], NULL, 10);
+    }
+    if (updates == 0) {
+	fprintf(stderr, "usage: %s [updates]\n", argv[0]);
+	return EXIT_FAILURE;
+    }
+
+    printf("%u updates of each of:", updates);
+    for (int pat = 0; pat < PAT_COUNT; pat++) {
+	printf("%s %s", (pat == 0) ? "" : ",", pattern_names[pat]);
+    }
+    printf("\n\nworst error / bound\n");
+    printf("%9s  %8s %8s %8s   %8s %8s %8s   %s\n", "period",
+	   "32 1m", "32 5m", "32 15m", "64 1m", "64 5m", "64 15m", "wraps");
+
+    for (int period = 0; period < LAXCOEF_NPERIODS; period++) {
+	CHECK_RESULT res = { { 0 } };
+
+	for (int pat = 0; pat < PAT_COUNT; pat++) {
+	    check_stream(period, (CHECK_PATTERN)pat, updates, &res);
+	}
+
+	printf("%6u ms ", lax_coef_period_ms[period]);
+	for (int w = 0; w < 3; w++) {
+	    printf(" %8.4f", res.ratio32[w]);
+	    failed |= (res.ratio32[w] > 1.0);
+	}
+	printf("  ");
+	for (int w = 0; w < 3; w++) {
+	    printf(" %8.4f", res.ratio64[w]);
+	    failed |= (res.ratio64[w] > 1.0);
+	}
+	printf("   %d\n", res.wrapped);
+	failed |= (res.wrapped != 0);
+    }
+
+    printf("\ncoefficients computed for user-defined windows\n\n");
+    failed |= (check_coefs() != 0);
+
+    printf("\n%s\n", failed ? "FAILED" : "ok");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,200 @@
+/*
+ * Host-side (Linux) check of LAXDRIVER's idle sampling.
+ *
+ * Runs two units of the driver compiled into this program on the mock
+ * kernel, side by side on the same load: one sampling at the full rate,
+ * and one set with LAX$K_CMD_IDLE to slow down after 30 seconds without
+ * reads. A simulated timer queue fires each unit's single-shot TQE when
+ * it's due, taking it off the queue first as exe$swtimint does; the
+ * driver queues the next tick itself.
+ *
+ * The load steps between levels every few minutes, while a reader polls
+ * the lazy unit in bursts separated by long quiet spells, some quiet
+ * spells spanning a change of load. At every read, the 64-bit averages
+ * it returns are compared with the full-rate unit's at the same moment,
+ * and at the end the number of updates each unit made is compared. Both
+ * units' ticks fall on the same grid, so every timer update of the lazy
+ * unit must reuse the full-rate unit's scan. A
+ * read after a quiet spell sees the load as of the last idle update and
+ * the one it takes on demand, so it can be off by the change in load
+ * since then, decayed over the window; the bound allows for that.
+ *
+ * Build and run on Linux with:
+ *
+ *   cc -O2 -o check-lax-idle check-lax-idle.c laxhost.c -lm
+ *   ./check-lax-idle [hours]
+ *
+ * It exits with a failure status if the averages stray too far or the
+ * lazy unit didn't update much less often.
+ *
+ * Copyright 2022, Jake Hamby.
+ * MIT License.
+ */
+
+#define LAX_HOST 1
+
+#include "laxdriver.c"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define IDLE_AFTER_S	30		/* LAX$K_CMD_IDLE for the lazy unit */
+#define IDLE_LOAD_STEP	600		/* seconds between load changes */
+#define IDLE_BURST	300		/* seconds of reads in a burst */
+#define IDLE_QUIET	1800		/* seconds between bursts */
+#define IDLE_POLL	5		/* seconds between reads in a burst */
+
+#define SECOND		10000000ULL	/* in 100 ns units */
+
+static LAX_UCB lazy_ucb, full_ucb;
+
+/* Fire a unit's TQE if it's due; the driver requeues it unless stopped */
+
+static void idle_timer (LAX_UCB *ucb) {
+    TQE *tqe = &ucb->ucb$l_tqe;
+
+    if (exe$gq_systime >= tqe->tqe$q_time) {
+	tqe->tqe$q_time = UINT64_MAX;
+	lax_stats_update_int(NULL, ucb, tqe);
+    }
+}
+
+static bool idle_command (LAX_UCB *ucb, uint32_t cmd, uint32_t value) {
+    return (lax_host_write((UCB *)ucb, &value, sizeof(value), cmd) & 1) != 0;
+}
+
+static void idle_read (LAX_UCB *ucb, LAX_AVGS64 *avgs) {
+    lax_host_read((UCB *)ucb, avgs, sizeof(*avgs), LAX$K_REC_AVGS64, 0);
+}
+
+/* Load levels stepped through, one every IDLE_LOAD_STEP seconds */
+
+static uint32_t idle_load (uint64_t t) {
+    static const uint32_t levels[6] = { 20, 80, 80, 5, 40, 0 };
+
+    return levels[(t / (IDLE_LOAD_STEP * SECOND)) % 6];
+}
+
+int main (int argc, char *argv[]) {
+    const uint64_t start = exe$gq_systime;
+    uint64_t hours = 12;
+    uint64_t next_read, burst_end;
+    uint32_t load = UINT32_MAX;
+    double worst[3] = { 0, 0, 0 };
+    double bound[3];
+    uint64_t reads = 0, on_demand = 0;
+    bool ok = true;
+
+    if (argc > 1) {
+	hours = strtoull(argv[1], NULL, 10);
+	if (hours == 0) {
+	    fprintf(stderr, "usage: %s [hours]\n", argv[0]);
+	    return EXIT_FAILURE;
+	}
+    }
+
+    lax_host_build_cpus(4, 0);
+    lax_host_build_iodb(16, 0);
+    lax_host_unit_init((UCB *)&lazy_ucb);
+    lax_host_unit_init((UCB *)&full_ucb);
+    if (!idle_command(&lazy_ucb, LAX$K_CMD_IDLE, IDLE_AFTER_S)) {
+	fprintf(stderr, "LAX$K_CMD_IDLE failed\n");
+	return EXIT_FAILURE;
+    }
+
+    /* The largest load step is 75, and the lazy unit can miss one for up
+     * to an idle period, plus the period before the read's own sample.
+     */
+    for (int w = 0; w < 3; w++) {
+	const double window = full_ucb.ucb$l_window_s[w];
+
+	bound[w] = 75 * (1 - exp(-(LAX$K_IDLE_PERIOD_MS / 1000.0 + 1) / window));
+    }
+
+    next_read = start + IDLE_QUIET * SECOND;
+    burst_end = next_read + IDLE_BURST * SECOND;
+
+    const uint64_t end = start + hours * 3600 * SECOND;
+    while (exe$gq_systime < end) {
+	uint64_t next = end;
+
+	if (lazy_ucb.ucb$l_tqe.tqe$q_time < next) {
+	    next = lazy_ucb.ucb$l_tqe.tqe$q_time;
+	}
+	if (full_ucb.ucb$l_tqe.tqe$q_time < next) {
+	    next = full_ucb.ucb$l_tqe.tqe$q_time;
+	}
+	if (next_read < next) {
+	    next = next_read;
+	}
+	exe$gq_systime = next;
+
+	if (idle_load(next - start) != load) {
+	    load = idle_load(next - start);
+	    lax_host_build_runq(load, 0, 0, 0xffff000000000000ULL);
+	}
+
+	idle_timer(&full_ucb);
+	idle_timer(&lazy_ucb);
+
+	if (next == next_read) {
+	    const uint64_t updates = lazy_ucb.ucb$r_profile.lax$q_ticks;
+	    LAX_AVGS64 lazy, full;
+
+	    /* bring the full-rate unit up to now first */
+	    idle_timer(&full_ucb);
+	    idle_read(&lazy_ucb, &lazy);
+	    idle_read(&full_ucb, &full);
+	    reads++;
+	    on_demand += lazy_ucb.ucb$r_profile.lax$q_ticks - updates;
+
+	    for (int w = 0; w < 3; w++) {
+		const double err = fabs((double)lazy.lax$q_avgs[w] -
+					(double)full.lax$q_avgs[w]) / 4294967296.0;
+
+		if (err > worst[w]) {
+		    worst[w] = err;
+		}
+	    }
+
+	    next_read += IDLE_POLL * SECOND;
+	    if (next_read >= burst_end) {
+		next_read = burst_end + IDLE_QUIET * SECOND;
+		burst_end = next_read + IDLE_BURST * SECOND;
+	    }
+	}
+    }
+
+    const uint64_t lazy_ticks = lazy_ucb.ucb$r_profile.lax$q_ticks;
+    const uint64_t full_ticks = full_ucb.ucb$r_profile.lax$q_ticks;
+    const uint64_t shared = lazy_ucb.ucb$r_profile.lax$q_shared;
+
+    printf("%llu hours, %llu reads of the lazy unit, %llu of them sampled "
+	"on demand\n", (unsigned long long)hours, (unsigned long long)reads,
+	(unsigned long long)on_demand);
+    printf("updates: %llu at the full rate, %llu lazily (%.1f%%)\n",
+	(unsigned long long)full_ticks, (unsigned long long)lazy_ticks,
+	100.0 * lazy_ticks / full_ticks);
+    printf("lazy updates on the full-rate unit's scan: %llu of %llu on "
+	"the timer\n", (unsigned long long)shared,
+	(unsigned long long)(lazy_ticks - on_demand));
+    printf("worst difference at a read, 1, 5, 15 min:");
+    for (int w = 0; w < 3; w++) {
+	printf("  %.4f (bound %.4f)", worst[w], bound[w]);
+	if (worst[w] > bound[w]) {
+	    ok = false;
+	}
+    }
+    printf("\n");
+
+    /* a burst of reads keeps it at the full rate a sixth of the time */
+    if (lazy_ticks * 3 > full_ticks) {
+	ok = false;
+    }
+    if (shared < lazy_ticks - on_demand) {
+	ok = false;
+    }
+    printf("\n%s\n", ok ? "ok" : "FAILED");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,228 @@
+/*
+ * Host-side (Linux) check of LAXDRIVER's averages under timer jitter.
+ *
+ * Runs the driver compiled into this program on the mock kernel with a
+ * load that steps from 0 up to 100 and back down to 0 half way through,
+ * while moving the system time on between ticks by patterns of on-time,
+ * jittered, late and stopped ticks. After each tick the 64-bit and 32-bit
+ * one, five and fifteen minute load averages are compared with the
+ * average computed in double precision over the time that actually
+ * passed, exp(-dt/W) for each interval dt.
+ *
+ * For contrast it also shows how far off the same reference would be if
+ * every tick were taken as one period, as the driver used to: that's
+ * the error elapsed-time decay removes. Ticks within LAX_TICK_SLACK ms of
+ * the period still use the period's coefficients, so the bounds allow
+ * each update an error of the decay over that slack.
+ *
+ * The system's page fault count goes up at a steady JITTER_FAULTS a
+ * second all the while, so the driver must measure exactly that rate on
+ * every tick after the first, however long the tick took, and its fault
+ * rate averages must stay as close to the reference as the load's.
+ *
+ * The LAX$M_RESTARTED flag must be set on the first sample only, and
+ * LAX$M_STALE on exactly the samples more than LAX_STALE_PERIODS late.
+ *
+ * Build and run on Linux with:
+ *
+ *   cc -O2 -o check-lax-jitter check-lax-jitter.c laxhost.c -lm
+ *   ./check-lax-jitter [ticks]
+ *
+ * It exits with a failure status if any error or flag is wrong.
+ *
+ * Copyright 2022, Jake Hamby.
+ * MIT License.
+ */
+
+#define LAX_HOST 1
+
+#include "laxdriver.c"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define JITTER_LOAD	100		/* run queue length of the step */
+#define JITTER_FAULTS	1000		/* page faults a second */
+
+/* How the system time moves on between ticks */
+
+typedef enum {
+    JIT_ON_TIME, JIT_UNIFORM, JIT_LATE, JIT_EARLY_LATE, JIT_STOP, JIT_COUNT
+} JITTER_PATTERN;
+
+static const char *pattern_names[JIT_COUNT] = {
+    "on time", "+-40% uniform", "1 in 10 3.5x late", "late then early",
+    "10 minute stop"
+};
+
+/* The time from tick n - 1 to tick n, in 100 ns units */
+
+static uint64_t jitter_interval (JITTER_PATTERN pat, uint32_t n,
+				 uint32_t ticks, uint64_t period) {
+    switch (pat) {
+    case JIT_UNIFORM:
+	return period * 6 / 10 + period * (lax_host_random() % 801) / 1000;
+    case JIT_LATE:
+	return (n % 10 == 9) ? period * 7 / 2 : period;
+    case JIT_EARLY_LATE:
+	/* a tick runs late, and the next one is due at the usual time */
+	return (n % 10 == 9) ? period * 19 / 10 :
+	       (n % 10 == 0 && n != 0) ? period / 10 : period;
+    case JIT_STOP:
+	return (n == ticks / 4) ? 600ULL * 10000000 : period;
+    default:
+	return period;
+    }
+}
+
+static LAX_UCB jitter_ucb;
+
+static bool jitter_run (JITTER_PATTERN pat, uint32_t ticks, uint32_t period_ms) {
+    LAX_UCB *ucb = &jitter_ucb;
+    const uint64_t period = (uint64_t)period_ms * 10000;
+    const double slack = (double)LAX_TICK_SLACK / 1000;
+    double ref[3] = { 0, 0, 0 };	/* decayed by the time that passed */
+    double nominal[3] = { 0, 0, 0 };	/* decayed by one period a tick */
+    double err64[3] = { 0, 0, 0 };
+    double err32[3] = { 0, 0, 0 };
+    double err_nominal[3] = { 0, 0, 0 };
+    double ref_rate[3] = { 0, 0, 0 };	/* fault rate, as ref */
+    double err_rate = 0;
+    uint32_t bad_rate = 0;
+    double bound[3];
+    uint32_t stale = 0, stale_expected = 0, restarted = 0;
+    SPL *dlck = ucb->ucb$r_ucb.ucb$l_dlck;	/* keep the device lock */
+    bool ok = true;
+
+    memset(ucb, 0, sizeof(*ucb));
+    ucb->ucb$r_ucb.ucb$l_dlck = dlck;
+    lax_host_unit_init((UCB *)ucb);
+    lax_set_period(ucb, period_ms);
+    lax_host_build_cpus(4, 0);
+    lax_host_build_iodb(16, 0);
+    lax_scan.rescan = true;	/* the old disk UCBs are gone */
+
+    for (int w = 0; w < 3; w++) {
+	/* each update may be off by the decay over the slack, and those
+	 * errors add up to the same 1 / (1 - exp(-T/W)) as rounding does,
+	 * plus a little for the rounding itself
+	 */
+	const double window = ucb->ucb$l_window_s[w];
+
+	bound[w] = JITTER_LOAD * (1 - exp(-slack / window)) /
+		   (1 - exp(-(double)period_ms / 1000 / window)) + 1e-3;
+    }
+
+    for (uint32_t n = 0; n < ticks; n++) {
+	const uint64_t dt = jitter_interval(pat, n, ticks, period);
+	const uint32_t load = (n < ticks / 2) ? JITTER_LOAD : 0;
+
+	lax_host_build_runq(load, 0, 0, 0xffff000000000000ULL);
+	exe$gq_systime += dt;
+	pms$gl_faults += (uint32_t)(dt * JITTER_FAULTS / 10000000);
+	lax_stats_update_int(NULL, ucb, &ucb->ucb$l_tqe);
+
+	const uint32_t slot = (ucb->ucb$l_sample_seq - 1) & (LAX_SAMPLE_RING - 1);
+	const LAX_SAMPLE *sample = &ucb->ucb$r_samples[slot];
+	const double x = sample->lax$l_proc_count;
+
+	/* the first tick has nothing to measure from, so it counts as one
+	 * period, as it does in the driver
+	 */
+	const double seconds = (n == 0) ? period_ms / 1000.0 : dt / 1e7;
+
+	for (int w = 0; w < 3; w++) {
+	    const double window = ucb->ucb$l_window_s[w];
+	    const double e = exp(-seconds / window);
+	    const double e_nominal = exp(-(double)period_ms / 1000 / window);
+
+	    ref[w] = ref[w] * e + x * (1 - e);
+	    nominal[w] = nominal[w] * e_nominal + x * (1 - e_nominal);
+
+	    const double got64 = (double)ucb->ucb$q_avgs[w] / 4294967296.0;
+	    const double got32 = (double)ucb->ucb$fx_avgs[w] / (1 << FX_SCALE);
+
+	    err64[w] = fmax(err64[w], fabs(got64 - ref[w]));
+	    err32[w] = fmax(err32[w], fabs(got32 - ref[w]));
+	    err_nominal[w] = fmax(err_nominal[w], fabs(nominal[w] - ref[w]));
+
+	    /* the rate isn't known until the second tick */
+	    if (n != 0) {
+		const double rate64 = (double)ucb->ucb$r_memory.lax$q_avgs
+					  [LAX$K_MEM_FAULT_RATE][w] / 4294967296.0;
+
+		ref_rate[w] = ref_rate[w] * e + JITTER_FAULTS * (1 - e);
+		err_rate = fmax(err_rate, fabs(rate64 - ref_rate[w]) /
+				JITTER_FAULTS * JITTER_LOAD / bound[w]);
+	    }
+	}
+
+	if (n != 0 && ucb->ucb$r_memory.lax$l_sample[LAX$K_MEM_FAULT_RATE] !=
+		      JITTER_FAULTS) {
+	    bad_rate++;
+	}
+
+	if (sample->lax$l_flags & LAX$M_RESTARTED) {
+	    restarted++;
+	    if (n != 0) {
+		ok = false;
+	    }
+	}
+	if (sample->lax$l_flags & LAX$M_STALE) {
+	    stale++;
+	}
+	if (n != 0 && dt > period * LAX_STALE_PERIODS) {
+	    stale_expected++;
+	}
+    }
+
+    printf("%-18s %5u ms", pattern_names[pat], period_ms);
+    for (int w = 0; w < 3; w++) {
+	/* the 32-bit averages can also be off by their own rounding */
+	const double bound32 = bound[w] + JITTER_LOAD * 1e-3;
+
+	printf("  %8.5f %8.5f %8.5f", err64[w], err32[w], err_nominal[w]);
+	if (err64[w] > bound[w] || err32[w] > bound32) {
+	    ok = false;
+	}
+    }
+    /* the fault rate's error, as a fraction of the load's bound */
+    printf("  %5.3f", err_rate);
+    if (err_rate > 1 || bad_rate != 0) {
+	printf("  fault rate: %u ticks off", bad_rate);
+	ok = false;
+    }
+    if (restarted != 1 || stale != stale_expected) {
+	printf("  flags: %u restarted, %u stale of %u", restarted, stale,
+	    stale_expected);
+	ok = false;
+    }
+    printf("%s\n", ok ? "" : "  FAIL");
+    return ok;
+}
+
+int main (int argc, char *argv[]) {
+    static const uint32_t periods[2] = { 1000, 5000 };
+    uint32_t ticks = 2000;
+    bool ok = true;
+
+    if (argc > 1) {
+	ticks = (uint32_t)strtoul(argv[1], NULL, 10);
+	if (ticks < 8) {
+	    fprintf(stderr, "usage: %s [ticks], at least 8\n", argv[0]);
+	    return EXIT_FAILURE;
+	}
+    }
+
+    printf("worst error of the 64-bit, 32-bit and per-tick 1, 5, 15 min "
+	"averages, load %u,\nand of the fault rate averages as a fraction of "
+	"the error allowed:\n", JITTER_LOAD);
+    for (int p = 0; p < 2; p++) {
+	for (int pat = 0; pat < JIT_COUNT; pat++) {
+	    ok &= jitter_run((JITTER_PATTERN)pat, ticks, periods[p]);
+	}
+    }
+    printf("\n%s\n", ok ? "ok" : "FAILED");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,263 @@
+/*
+ * Host-side (Linux) check of LAXDRIVER's sliding window peaks.
+ *
+ * Runs the driver compiled into this program on the mock kernel, set with
+ * LAX$K_CMD_IDLE to slow down after 30 seconds without reads, under a run
+ * queue that changes on every tick. The peaks are tracked from a
+ * LAX$K_CMD_PEAKS write at a 5 second period, which is shortened to 250 ms
+ * halfway through, so the queues are reallocated with samples in them. A simulated timer fires its TQE when
+ * it's due, or some seconds later now and then, so a few ticks come late.
+ * A reader asks for LAX$K_REC_PEAKS every few seconds for a while, then
+ * stays away long enough for the unit to go idle and tick once a minute,
+ * then comes back, reading on demand, and so on.
+ *
+ * Every sample the driver takes is copied from its sample ring as it's
+ * taken, and after each one the peaks it reports for every window are
+ * compared with the largest and smallest of the samples taken within that
+ * window before it, found by a scan of them all, and lax$l_tracked_ms
+ * with the time covered since tracking began. A read of the record before
+ * the write must fail with SS$_DEVINACT.
+ *
+ * Build and run on Linux with:
+ *
+ *   cc -O2 -o check-lax-peaks check-lax-peaks.c laxhost.c -lm
+ *   ./check-lax-peaks [hours]
+ *
+ * It exits with a failure status if any peak or the time covered is wrong.
+ *
+ * Copyright 2022, Jake Hamby.
+ * MIT License.
+ */
+
+#define LAX_HOST 1
+
+#include "laxdriver.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PEAKS_IDLE_AFTER 30		/* LAX$K_CMD_IDLE, in seconds */
+#define PEAKS_BUSY	1200		/* seconds of reads in a burst */
+#define PEAKS_QUIET	2400		/* seconds between bursts */
+#define PEAKS_POLL	5		/* seconds between reads in a burst */
+#define PEAKS_LATE_EVERY 97		/* one tick in this many comes late */
+#define PEAKS_PERIOD	5000		/* ms, the period tracking starts at */
+#define PEAKS_SHORTER	250		/* ms, the period for the second half */
+
+#define SECOND		10000000ULL	/* in 100 ns units */
+
+static LAX_UCB peaks_ucb;
+
+/* The samples taken since tracking began */
+
+typedef struct {
+    uint32_t	t_ms;
+    uint32_t	value[2];		/* by LAX$K_PEAK_xxx */
+} PEAKS_SAMPLE;
+
+static PEAKS_SAMPLE *history;
+static uint32_t history_len, history_max;
+static uint32_t next_seq;		/* sample sequence number to copy */
+static uint32_t first_period_ms;	/* covered by the first sample */
+
+static bool peaks_command (uint32_t cmd, uint32_t value) {
+    return (lax_host_write((UCB *)&peaks_ucb, &value, sizeof(value), cmd)
+	    & 1) != 0;
+}
+
+static uint32_t peaks_read (LAX_PEAKS *peaks) {
+    return lax_host_read((UCB *)&peaks_ucb, peaks, sizeof(*peaks),
+			 LAX$K_REC_PEAKS, 0);
+}
+
+/* Copy the sample the driver just took, if it took one, and check the
+ * peaks it reports against all the samples so far. Returns the number of
+ * wrong values.
+ */
+
+static uint32_t peaks_check (void) {
+    static const uint32_t window_s[3] = LAX_PEAK_WINDOWS;
+    const LAX_PEAKS *peaks = &peaks_ucb.ucb$r_peaks;
+    uint32_t errors = 0;
+
+    if (peaks_ucb.ucb$l_sample_seq == next_seq) {
+	return 0;
+    }
+
+    const LAX_SAMPLE *sample =
+	&peaks_ucb.ucb$r_samples[next_seq & (LAX_SAMPLE_RING - 1)];
+
+    next_seq = peaks_ucb.ucb$l_sample_seq;
+    if (history_len == history_max) {
+	history_max = history_max ? history_max * 2 : 4096;
+	history = realloc(history, history_max * sizeof(*history));
+	if (history == NULL) {
+	    perror("realloc");
+	    exit(EXIT_FAILURE);
+	}
+    }
+
+    PEAKS_SAMPLE *s = &history[history_len++];
+    s->t_ms = (uint32_t)(sample->lax$q_time / 10000);
+    s->value[LAX$K_PEAK_LOAD] = sample->lax$l_proc_count;
+    s->value[LAX$K_PEAK_DISKQ] = sample->lax$l_disk_qlen;
+
+    /* the first sample covers one period, and each later one the time
+     * since the one before
+     */
+    const uint32_t first_ms = history[0].t_ms;
+    uint64_t tracked = first_period_ms + (s->t_ms - first_ms);
+    if (tracked > LAX_PEAK_LONGEST * 1000) {
+	tracked = LAX_PEAK_LONGEST * 1000;
+    }
+    if (peaks->lax$l_tracked_ms != tracked) {
+	if (errors++ == 0) {
+	    printf("FAILED: %u ms tracked at sample %u, should be %llu\n",
+		   peaks->lax$l_tracked_ms, history_len,
+		   (unsigned long long)tracked);
+	}
+    }
+
+    for (int m = 0; m < 2; m++) {
+	for (int w = 0; w < 3; w++) {
+	    uint32_t max = LAX$K_NO_QLEN, min = LAX$K_NO_QLEN;
+
+	    for (uint32_t i = history_len; i-- > 0; ) {
+		const uint32_t value = history[i].value[m];
+
+		if (s->t_ms - history[i].t_ms >= window_s[w] * 1000) {
+		    break;
+		}
+		if (value == LAX$K_NO_QLEN) {
+		    continue;
+		}
+		if (max == LAX$K_NO_QLEN || value > max) {
+		    max = value;
+		}
+		if (min == LAX$K_NO_QLEN || value < min) {
+		    min = value;
+		}
+	    }
+
+	    if (peaks->lax$l_max[m][w] != max ||
+		peaks->lax$l_min[m][w] != min) {
+		if (errors++ == 0) {
+		    printf("FAILED: peak %d window %us at sample %u: "
+			   "%u..%u, should be %u..%u\n", m, window_s[w],
+			   history_len, peaks->lax$l_min[m][w],
+			   peaks->lax$l_max[m][w], min, max);
+		}
+	    }
+	}
+    }
+    return errors;
+}
+
+int main (int argc, char *argv[]) {
+    const uint64_t start = exe$gq_systime;
+    uint64_t hours = 6;
+    uint64_t next_read, burst_end;
+    uint64_t ticks = 0, late = 0, idle = 0, reads = 0, errors = 0;
+    LAX_PEAKS peaks;
+
+    if (argc > 1) {
+	hours = strtoull(argv[1], NULL, 10);
+	if (hours == 0) {
+	    fprintf(stderr, "usage: %s [hours]\n", argv[0]);
+	    return EXIT_FAILURE;
+	}
+    }
+
+    lax_host_build_cpus(4, 0);
+    lax_host_build_iodb(16, 0);
+    lax_host_build_runq(10, 0, 0, 0xffff000000000000ULL);
+    lax_host_seed(0x2545F4914F6CDD1DULL);
+    lax_host_unit_init((UCB *)&peaks_ucb);
+    if (!peaks_command(LAX$K_CMD_IDLE, PEAKS_IDLE_AFTER) ||
+	!peaks_command(LAX$K_CMD_PERIOD, PEAKS_PERIOD)) {
+	fprintf(stderr, "LAX$K_CMD_IDLE or LAX$K_CMD_PERIOD failed\n");
+	return EXIT_FAILURE;
+    }
+
+    /* nothing is tracked, or allocated, until the write */
+    if (peaks_read(&peaks) != SS$_DEVINACT ||
+	peaks_ucb.ucb$ps_peakq != NULL) {
+	fprintf(stderr, "LAX$K_REC_PEAKS read before LAX$K_CMD_PEAKS "
+		"didn't fail with SS$_DEVINACT\n");
+	return EXIT_FAILURE;
+    }
+    if (!peaks_command(LAX$K_CMD_PEAKS, 0)) {
+	fprintf(stderr, "LAX$K_CMD_PEAKS failed\n");
+	return EXIT_FAILURE;
+    }
+    const uint32_t first_slots = peaks_ucb.ucb$ps_peakq[0].slots;
+    first_period_ms = PEAKS_PERIOD;
+    next_seq = peaks_ucb.ucb$l_sample_seq;
+    next_read = start + PEAKS_POLL * SECOND;
+    burst_end = start + PEAKS_BUSY * SECOND;
+
+    const uint64_t end = start + hours * 3600 * SECOND;
+    const uint64_t half = start + hours * 1800 * SECOND;
+    while (exe$gq_systime < end) {
+	TQE *tqe = &peaks_ucb.ucb$l_tqe;
+
+	/* the queues must grow for the shorter period, keeping what's in
+	 * them
+	 */
+	if (exe$gq_systime >= half &&
+	    peaks_ucb.ucb$l_period_ms != PEAKS_SHORTER) {
+	    if (!peaks_command(LAX$K_CMD_PERIOD, PEAKS_SHORTER) ||
+		peaks_ucb.ucb$ps_peakq[0].slots <= first_slots) {
+		fprintf(stderr, "LAX$K_CMD_PERIOD didn't grow the queues\n");
+		return EXIT_FAILURE;
+	    }
+	}
+
+	if (next_read < tqe->tqe$q_time) {
+	    exe$gq_systime = next_read;
+	    if ((peaks_read(&peaks) & 1) == 0) {
+		fprintf(stderr, "LAX$K_REC_PEAKS read failed\n");
+		return EXIT_FAILURE;
+	    }
+	    reads++;
+
+	    next_read += PEAKS_POLL * SECOND;
+	    if (next_read >= burst_end) {
+		next_read = burst_end + PEAKS_QUIET * SECOND;
+		burst_end = next_read + PEAKS_BUSY * SECOND;
+	    }
+	} else {
+	    const uint64_t last = peaks_ucb.ucb$q_tick_time;
+
+	    /* now and then the timer fires up to 20 seconds late */
+	    exe$gq_systime = tqe->tqe$q_time;
+	    if (lax_host_random() % PEAKS_LATE_EVERY == 0) {
+		exe$gq_systime += (1 + lax_host_random() % 20) * SECOND;
+		late++;
+	    }
+	    if (exe$gq_systime - last >= LAX$K_IDLE_PERIOD_MS * 10000ULL) {
+		idle++;
+	    }
+
+	    lax_host_build_runq(lax_host_random() % 100, 0, 0,
+				0xffff000000000000ULL);
+	    tqe->tqe$q_time = UINT64_MAX;
+	    lax_stats_update_int(NULL, &peaks_ucb, tqe);
+	    ticks++;
+	}
+	errors += peaks_check();
+    }
+
+    printf("%llu hours, %llu ticks (%llu late, %llu a minute or more "
+	"apart), %llu reads, %u samples checked\n", (unsigned long long)hours,
+	(unsigned long long)ticks, (unsigned long long)late,
+	(unsigned long long)idle, (unsigned long long)reads, history_len);
+
+    /* the run must have gone idle and had late ticks to check anything */
+    const bool ok = (errors == 0 && late != 0 && idle != 0);
+    if (errors != 0) {
+	printf("%llu wrong values\n", (unsigned long long)errors);
+    }
+    printf("\n%s\n", ok ? "ok" : "FAILED");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,357 @@
+/*
+ * Host-side (Linux) accuracy and drift benchmark for LAXDRIVER's averages.
+ *
+ * Replays days of synthetic load through the driver's own averaging
+ * routines, the classic 32-bit averages (14 fraction bits) and the 64-bit
+ * ones (32 fraction bits), and through the F_floating arithmetic of the
+ * original LAVDRIVER (orig-src/lavdriver.mar), and compares all three with
+ * the same averages computed in IEEE double precision. The F_floating
+ * arithmetic is emulated with IEEE single precision, which has the same
+ * 24-bit fraction; the two round differently only on exact ties.
+ *
+ * The traces, each followed by four idle hours:
+ *
+ *   zero	no load at all
+ *   step	idle for the first quarter, then 8 for the rest
+ *   sawtooth	ramps from 0 to 16 every ten minutes
+ *   bursty	Poisson arrivals, averaging 12 in bursts of about two minutes
+ *		and 0.5 between them, which last about eight
+ *
+ * For each sampling period, trace, arithmetic and window it reports:
+ *
+ *   max err	largest difference from the double average, as a load
+ *   bias	mean signed difference over the second half of the trace;
+ *		any drift over the days shows up here
+ *   zero s	seconds after the load stops until the average reads 0.00
+ *   Mupd/s	millions of updates of all three windows a second
+ *
+ * Build and run on Linux with:
+ *
+ *   cc -O2 -o drift-lax-ewma drift-lax-ewma.c laxhost.c -lm
+ *   ./drift-lax-ewma [days [period_ms]]
+ *
+ * The default is a week of load at each of the driver's sampling periods.
+ *
+ * Copyright 2022, Jake Hamby.
+ * MIT License.
+ */
+
+#define LAX_HOST 1
+
+#include "laxdriver.c"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DRIFT_IDLE_MS	(4 * 3600 * 1000ULL)	/* idle tail after each trace */
+#define DRIFT_ZERO	0.005			/* reads as 0.00 */
+
+typedef enum {
+    TRACE_ZERO, TRACE_STEP, TRACE_SAWTOOTH, TRACE_BURSTY, TRACE_COUNT
+} DRIFT_TRACE;
+
+static const char *trace_names[TRACE_COUNT] = {
+    "zero", "step", "sawtooth", "bursty"
+};
+
+/* The ways of averaging compared, all against the double reference */
+
+typedef enum {
+    ARITH_FX32, ARITH_FX64, ARITH_FFLOAT, ARITH_DOUBLE, ARITH_COUNT
+} DRIFT_ARITH;
+
+static const char *arith_names[ARITH_COUNT] = {
+    "32-bit", "64-bit", "F_float", "double"
+};
+
+typedef struct {
+    double	max_err[3];
+    double	bias_sum[3];
+    uint64_t	bias_count;
+    double	zero_s[3];		/* negative until it reads 0.00 */
+    double	updates_per_s;
+} DRIFT_RESULT;
+
+static double drift_uniform (void) {
+    return (double)(lax_host_random64() >> 11) / 9007199254740992.0;
+}
+
+static uint32_t drift_poisson (double mean) {
+    const double limit = exp(-mean);
+    double p = drift_uniform();
+    uint32_t k = 0;
+
+    while (p > limit) {
+	p *= drift_uniform();
+	k++;
+    }
+    return k;
+}
+
+/* Fill in one sample every period_ms for the trace and the idle tail */
+
+static void drift_fill (DRIFT_TRACE trace, uint32_t period_ms, uint32_t *samples,
+			uint64_t load, uint64_t total) {
+    const double switch_on = period_ms / 480000.0;
+    const double switch_off = period_ms / 120000.0;
+    bool burst = false;
+
+    for (uint64_t n = 0; n < total; n++) {
+	const uint64_t t_ms = n * period_ms;
+	uint32_t sample = 0;
+
+	if (n < load) {
+	    switch (trace) {
+	    case TRACE_ZERO:
+		break;
+	    case TRACE_STEP:
+		sample = (n < load / 4) ? 0 : 8;
+		break;
+	    case TRACE_SAWTOOTH:
+		sample = (uint32_t)((t_ms % 600000) * 17 / 600000);
+		break;
+	    default:
+		if (drift_uniform() < (burst ? switch_off : switch_on)) {
+		    burst = !burst;
+		}
+		sample = drift_poisson(burst ? 12.0 : 0.5);
+		break;
+	    }
+	}
+	samples[n] = sample;
+    }
+}
+
+/* One update of the original driver's averages: La = OldLa*F + NewLa*(1-F),
+ * rounding after each MULF3 and ADDF3. The volatiles keep the compiler from
+ * fusing the multiply and add, which the VAX didn't.
+ */
+
+static inline void drift_ffloat_update (float avgs[3], uint32_t sample,
+					const float old_f[3], const float new_f[3]) {
+    const float x = (float)sample;
+
+    for (int w = 0; w < 3; w++) {
+	volatile float r0 = x * new_f[w];
+	volatile float r1 = avgs[w] * old_f[w];
+
+	avgs[w] = r0 + r1;
+    }
+}
+
+/* Replay one trace, comparing everything with the double average */
+
+static void drift_accuracy (int period, const uint32_t *samples, uint64_t load,
+			    uint64_t total, DRIFT_RESULT res[ARITH_COUNT]) {
+    const LAX_COEF *coef = lax_coef_table[period];
+    const LAX_COEF64 *coef64 = lax_coef64_table[period];
+    const double period_s = lax_coef_period_ms[period] / 1000.0;
+    const double fx32 = (double)(1 << FX_SCALE);
+    const double fx64 = 4294967296.0;
+    uint32_t avgs32[3] = { 0 };
+    uint64_t avgs64[3] = { 0 };
+    float avgsf[3] = { 0 };
+    double ref[3] = { 0 };
+    float old_f[3], new_f[3];
+    double decay[3];
+
+    for (int w = 0; w < 3; w++) {
+	decay[w] = exp(-period_s / lax_coef_window_s[w]);
+	old_f[w] = (float)decay[w];
+	new_f[w] = (float)(1.0 - decay[w]);
+    }
+
+    for (int a = 0; a < ARITH_COUNT; a++) {
+	memset(&res[a], 0, sizeof(res[a]));
+	for (int w = 0; w < 3; w++) {
+	    res[a].zero_s[w] = -1;
+	}
+    }
+
+    for (uint64_t n = 0; n < total; n++) {
+	const uint32_t sample = samples[n];
+
+	lax_ewma_update(avgs32, 3, &sample, 1, coef, 3);
+	lax_ewma_update64(avgs64, 3, &sample, 1, coef64, 3);
+	drift_ffloat_update(avgsf, sample, old_f, new_f);
+
+	for (int w = 0; w < 3; w++) {
+	    ref[w] = ref[w] * decay[w] + sample * (1.0 - decay[w]);
+
+	    const double value[ARITH_COUNT] = {
+		avgs32[w] / fx32, avgs64[w] / fx64, avgsf[w], ref[w]
+	    };
+
+	    for (int a = 0; a < ARITH_COUNT; a++) {
+		const double err = value[a] - ref[w];
+
+		if (fabs(err) > res[a].max_err[w]) {
+		    res[a].max_err[w] = fabs(err);
+		}
+		if (n >= load / 2 && n < load) {
+		    res[a].bias_sum[w] += err;
+		}
+
+		/* the first update of the idle tail counts as 0 seconds */
+		if (n >= load && res[a].zero_s[w] < 0 && value[a] < DRIFT_ZERO) {
+		    res[a].zero_s[w] = (n - load) * period_s;
+		}
+	    }
+	}
+    }
+
+    for (int a = 0; a < ARITH_COUNT; a++) {
+	res[a].bias_count = load - load / 2;
+    }
+}
+
+/* Time each kind of update alone over the trace */
+
+static void drift_speed (int period, const uint32_t *samples, uint64_t total,
+			 DRIFT_RESULT res[ARITH_COUNT]) {
+    const LAX_COEF *coef = lax_coef_table[period];
+    const LAX_COEF64 *coef64 = lax_coef64_table[period];
+    const double period_s = lax_coef_period_ms[period] / 1000.0;
+    volatile double sink = 0;
+    float old_f[3], new_f[3];
+    double decay[3];
+
+    for (int w = 0; w < 3; w++) {
+	decay[w] = exp(-period_s / lax_coef_window_s[w]);
+	old_f[w] = (float)decay[w];
+	new_f[w] = (float)(1.0 - decay[w]);
+    }
+
+    for (int a = 0; a < ARITH_COUNT; a++) {
+	uint32_t avgs32[3] = { 0 };
+	uint64_t avgs64[3] = { 0 };
+	float avgsf[3] = { 0 };
+	double ref[3] = { 0 };
+
+	const uint64_t t0 = lax_host_nanotime();
+	switch (a) {
+	case ARITH_FX32:
+	    for (uint64_t n = 0; n < total; n++) {
+		lax_ewma_update(avgs32, 3, &samples[n], 1, coef, 3);
+	    }
+	    sink += avgs32[0];
+	    break;
+	case ARITH_FX64:
+	    for (uint64_t n = 0; n < total; n++) {
+		lax_ewma_update64(avgs64, 3, &samples[n], 1, coef64, 3);
+	    }
+	    sink += avgs64[0];
+	    break;
+	case ARITH_FFLOAT:
+	    for (uint64_t n = 0; n < total; n++) {
+		drift_ffloat_update(avgsf, samples[n], old_f, new_f);
+	    }
+	    sink += avgsf[0];
+	    break;
+	default:
+	    for (uint64_t n = 0; n < total; n++) {
+		for (int w = 0; w < 3; w++) {
+		    ref[w] = ref[w] * decay[w] + samples[n] * (1.0 - decay[w]);
+		}
+	    }
+	    sink += ref[0];
+	    break;
+	}
+	const uint64_t elapsed = lax_host_nanotime() - t0;
+
+	res[a].updates_per_s = (elapsed == 0) ? 0 : total * 1e9 / elapsed;
+    }
+}
+
+static void drift_print (const DRIFT_RESULT res[ARITH_COUNT]) {
+    static const char *labels[3] = {
+	"--------- 1 min ----------",
+	"--------- 5 min ----------",
+	"--------- 15 min ---------"
+    };
+
+    printf("%-10s ", "");
+    for (int w = 0; w < 3; w++) {
+	printf("  %s", labels[w]);
+    }
+    printf("\n%-10s ", "");
+    for (int w = 0; w < 3; w++) {
+	printf("  %8s %9s %7s", "max err", "bias", "zero s");
+    }
+    printf("  %7s\n", "Mupd/s");
+
+    for (int a = 0; a < ARITH_COUNT; a++) {
+	printf("%-10s ", arith_names[a]);
+	for (int w = 0; w < 3; w++) {
+	    const double bias = res[a].bias_sum[w] / res[a].bias_count;
+
+	    if (a == ARITH_DOUBLE) {
+		printf("  %8s %9s", "-", "-");
+	    } else {
+		printf("  %8.1e %+9.1e", res[a].max_err[w], bias);
+	    }
+	    if (res[a].zero_s[w] < 0) {
+		printf(" %7s", "never");
+	    } else {
+		printf(" %7.0f", res[a].zero_s[w]);
+	    }
+	}
+	printf("  %7.1f\n", res[a].updates_per_s / 1e6);
+    }
+}
+
+int main (int argc, char *argv[]) {
+    double days = 7;
+    uint32_t only_period_ms = 0;
+    bool found = false;
+
+    if (argc >= 2) {
+	days = atof(argv[1]);
+    }
+    if (argc >= 3) {
+	only_period_ms = (uint32_t)strtoul(argv[2], NULL, 10);
+    }
+    if (days <= 0) {
+	fprintf(stderr, "usage: %s [days [period_ms]]\n", argv[0]);
+	return EXIT_FAILURE;
+    }
+
+    for (int period = 0; period < LAXCOEF_NPERIODS; period++) {
+	const uint32_t period_ms = lax_coef_period_ms[period];
+
+	if (only_period_ms != 0 && only_period_ms != period_ms) {
+	    continue;
+	}
+	found = true;
+
+	const uint64_t load = (uint64_t)(days * 86400000.0 / period_ms);
+	const uint64_t total = load + DRIFT_IDLE_MS / period_ms;
+	uint32_t *samples = malloc(total * sizeof(uint32_t));
+
+	if (samples == NULL) {
+	    fprintf(stderr, "can't allocate %llu samples\n", (unsigned long long)total);
+	    return EXIT_FAILURE;
+	}
+
+	for (int trace = 0; trace < TRACE_COUNT; trace++) {
+	    DRIFT_RESULT res[ARITH_COUNT];
+
+	    drift_fill((DRIFT_TRACE)trace, period_ms, samples, load, total);
+	    drift_accuracy(period, samples, load, total, res);
+	    drift_speed(period, samples, total, res);
+
+	    printf("%u ms period, %g days of %s load, %llu updates\n\n",
+		period_ms, days, trace_names[trace], (unsigned long long)total);
+	    drift_print(res);
+	    printf("\n");
+	}
+	free(samples);
+    }
+
+    if (!found) {
+	fprintf(stderr, "no %u ms sampling period\n", only_period_ms);
+	return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
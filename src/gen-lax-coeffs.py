@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+"""Generate laxcoef.h, the fixed-point EWMA coefficients for LAXDRIVER.
+
+For a sampling period T and an averaging window W, each update computes
+
+    avg = avg * exp(-T/W) + sample * (1 - exp(-T/W))
+
+The driver keeps the averages with FX_SCALE fraction bits and shifts each
+new sample left by FX_LSHIFT before multiplying, then shifts the sum right
+by FX_RSHIFT. So the weight of the old average has FX_RSHIFT fraction bits
+and the weight of the new sample has FX_SCALE + FX_RSHIFT - FX_LSHIFT.
+
+The 64-bit averages have 32 fraction bits, and so do both of their
+weights. The new weight is 1 minus the rounded old one, so the two add up
+to exactly 1 and a constant sample is tracked without any bias.
+
+Run this again whenever the scaling factors, periods or windows change:
+
+    python3 gen-lax-coeffs.py > laxcoef.h
+
+Copyright 2022, Jake Hamby.
+MIT License.
+"""
+
+import argparse
+import math
+
+# Sampling periods in milliseconds that the driver can be switched to
+PERIODS_MS = [100, 250, 1000, 5000]
+
+# The 1, 5 and 15 minute load average windows, in seconds
+WINDOWS_S = [60, 300, 900]
+
+
+def coefficients(period_ms, window_s, scale, lshift, rshift):
+    decay = math.exp(-(period_ms / 1000.0) / window_s)
+    old = round(decay * (1 << rshift))
+    new = round((1.0 - decay) * (1 << (scale + rshift - lshift)))
+    if not (0 < old < (1 << 32) and 0 < new < (1 << 32)):
+        raise ValueError("coefficient out of range for %d ms, %d s"
+                         % (period_ms, window_s))
+    return old, new
+
+
+def coefficients64(period_ms, window_s):
+    decay = math.exp(-(period_ms / 1000.0) / window_s)
+    old = round(decay * (1 << 32))
+    if not (0 < old < (1 << 32)):
+        raise ValueError("coefficient out of range for %d ms, %d s"
+                         % (period_ms, window_s))
+    return old, (1 << 32) - old
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--scale", type=int, default=14)
+    parser.add_argument("--lshift", type=int, default=6)
+    parser.add_argument("--rshift", type=int, default=24)
+    args = parser.parse_args()
+
+    print("/*")
+    print(" * Fixed-point EWMA coefficients for LAXDRIVER.")
+    print(" *")
+    print(" * Generated by gen-lax-coeffs.py. Do not edit by hand; rerun the")
+    print(" * script if FX_SCALE, FX_LSHIFT or FX_RSHIFT change.")
+    print(" */")
+    print()
+    print("#ifndef LAXCOEF_H")
+    print("#define LAXCOEF_H")
+    print()
+    print("/* Scaling factors these coefficients were computed for */")
+    print()
+    print("#define LAXCOEF_FX_SCALE\t%d" % args.scale)
+    print("#define LAXCOEF_FX_LSHIFT\t%d" % args.lshift)
+    print("#define LAXCOEF_FX_RSHIFT\t%d" % args.rshift)
+    print()
+    print("#define LAXCOEF_NPERIODS\t%d" % len(PERIODS_MS))
+    print("#define LAXCOEF_NWINDOWS\t%d" % len(WINDOWS_S))
+    print()
+    print("static const uint32_t lax_coef_period_ms[LAXCOEF_NPERIODS] = {")
+    print("    " + ", ".join(str(p) for p in PERIODS_MS))
+    print("};")
+    print()
+    print("static const uint32_t lax_coef_window_s[LAXCOEF_NWINDOWS] = {")
+    print("    " + ", ".join(str(w) for w in WINDOWS_S))
+    print("};")
+    print()
+    print("/* { old: exp(-T/W) * (1<<%d), new: (1 - exp(-T/W)) * (1<<%d) } */"
+          % (args.rshift, args.scale + args.rshift - args.lshift))
+    print()
+    print("static const LAX_COEF "
+          "lax_coef_table[LAXCOEF_NPERIODS][LAXCOEF_NWINDOWS] = {")
+    for period in PERIODS_MS:
+        pairs = []
+        for window in WINDOWS_S:
+            old, new = coefficients(period, window, args.scale,
+                                    args.lshift, args.rshift)
+            pairs.append("{ %10d, %10d }" % (old, new))
+        print("    { %s },\t/* %d ms */" % (", ".join(pairs), period))
+    print("};")
+    print()
+    print("/* { old: exp(-T/W) * (1<<32), new: (1<<32) - old } */")
+    print()
+    print("static const LAX_COEF64 "
+          "lax_coef64_table[LAXCOEF_NPERIODS][LAXCOEF_NWINDOWS] = {")
+    for period in PERIODS_MS:
+        pairs = []
+        for window in WINDOWS_S:
+            old, new = coefficients64(period, window)
+            pairs.append("{ %10dU, %10dU }" % (old, new))
+        print("    { %s },\t/* %d ms */" % (", ".join(pairs), period))
+    print("};")
+    print()
+    print("#endif /* LAXCOEF_H */")
+
+
+if __name__ == "__main__":
+    main()
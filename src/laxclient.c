@@ -0,0 +1,188 @@
+/*
+ * Client library for LAXDRIVER: see laxclient.h.
+ *
+ * Copyright 2022, Jake Hamby.
+ * MIT License.
+ */
+
+#include "laxclient.h"
+
+#include <string.h>
+
+#ifdef __VMS
+#define __NEW_STARLET 1
+#include <descrip.h>
+#include <efndef.h>
+#include <gen64def.h>
+#include <iodef.h>
+#include <iosbdef.h>
+#include <starlet.h>
+#include <stsdef.h>
+#endif
+
+/* Failure status when no transport is available, SS$_NOSUCHDEV on VMS */
+
+#define LAX_CLIENT_NODEV	2312
+
+#ifdef __VMS
+
+/* The default transport: $QIO on a channel to LAX0:, and $GETTIM */
+
+static int lax_qio_read (void *ctx, uint32_t rec_code, void *buf, uint32_t len) {
+    const unsigned short channel = (unsigned short)(uintptr_t)ctx;
+    IOSB iosb;
+
+    int status = sys$qiow(EFN$C_ENF, channel, IO$_READVBLK, &iosb, NULL, 0,
+			  buf, len, rec_code, 0, 0, 0);
+    if ($VMS_STATUS_SUCCESS(status)) {
+	status = iosb.iosb$w_status;
+    }
+    return status;
+}
+
+static uint64_t lax_qio_now (void *ctx) {
+    GENERIC_64 now;
+
+    sys$gettim(&now);
+    return now.gen64$q_quadword;
+}
+
+static void lax_qio_close (void *ctx) {
+    sys$dassgn((unsigned short)(uintptr_t)ctx);
+}
+
+static int lax_qio_open (LAX_TRANSPORT *transport) {
+    $DESCRIPTOR (devnam, "LAX0:");
+    unsigned short channel;
+
+    int status = sys$assign(&devnam, &channel, 0, NULL);
+    if (!$VMS_STATUS_SUCCESS(status)) {
+	return status;
+    }
+
+    transport->read = lax_qio_read;
+    transport->now = lax_qio_now;
+    transport->close = lax_qio_close;
+    transport->ctx = (void *)(uintptr_t)channel;
+    return status;
+}
+
+#endif /* __VMS */
+
+int lax_client_open (LAX_CLIENT *client, const LAX_TRANSPORT *transport) {
+    memset(client, 0, sizeof(*client));
+
+    if (transport != NULL) {
+	client->transport = *transport;
+	return 1;
+    }
+
+#ifdef __VMS
+    return lax_qio_open(&(client->transport));
+#else
+    return LAX_CLIENT_NODEV;
+#endif
+}
+
+void lax_client_close (LAX_CLIENT *client) {
+    if (client->transport.close != NULL) {
+	client->transport.close(client->transport.ctx);
+    }
+    memset(client, 0, sizeof(*client));
+}
+
+/* Bring the cache up to date if the driver has updated since it was filled
+ * in, or should have. Returns a VMS status.
+ */
+
+static int lax_client_refresh (LAX_CLIENT *client) {
+    const uint64_t now = client->transport.now(client->transport.ctx);
+
+    /* the clock may have been set back, too */
+    if (client->valid && now >= client->fetched && now < client->expires) {
+	client->hits++;
+	return 1;
+    }
+
+    if (client->transport.read == NULL) {
+	return LAX_CLIENT_NODEV;
+    }
+
+    LAX_AVGS64 rec;
+    memset(&rec, 0, sizeof(rec));
+
+    int status = client->transport.read(client->transport.ctx,
+					LAX$K_REC_AVGS64, &rec, sizeof(rec));
+    if (!(status & 1)) {
+	return status;
+    }
+    client->fetches++;
+
+    /* The next update is due one period after this one was taken. An
+     * older driver doesn't say when that was, so assume it was just now.
+     */
+    const uint64_t period = (uint64_t)rec.lax$l_period_ms * 10000;
+    const uint64_t taken = (rec.lax$w_version >= 2 && rec.lax$q_time != 0) ?
+			   rec.lax$q_time : now;
+
+    client->cache = rec;
+    client->valid = true;
+    client->fetched = now;
+    client->expires = taken + period;
+    if (client->expires <= now) {
+	client->expires = now + LAX_CLIENT_RETRY;	/* update is late */
+    }
+    return status;
+}
+
+int lax_client_get (LAX_CLIENT *client, LAX_AVGS64 *avgs) {
+    int status = lax_client_refresh(client);
+
+    if (status & 1) {
+	*avgs = client->cache;
+    }
+    return status;
+}
+
+int lax_client_getfx (LAX_CLIENT *client, uint32_t fx[9]) {
+    int status = lax_client_refresh(client);
+
+    if (status & 1) {
+	for (int i = 0; i < 9; i++) {
+	    const uint64_t value = client->cache.lax$q_avgs[i] >>
+				   (LAX$K_FX64_SCALE - LAX$K_FX_SCALE);
+
+	    fx[i] = (value > UINT32_MAX) ? UINT32_MAX : (uint32_t)value;
+	}
+    }
+    return status;
+}
+
+int lax_client_getavg (LAX_CLIENT *client, double avgs[], int nelem) {
+    static const double scale = 1.0 / (double)(1ULL << LAX$K_FX64_SCALE);
+
+    if (nelem < 0 || !(lax_client_refresh(client) & 1)) {
+	return -1;
+    }
+
+    if (nelem > 9) {
+	nelem = 9;
+    }
+    for (int i = 0; i < nelem; i++) {
+	avgs[i] = (double)client->cache.lax$q_avgs[i] * scale;
+    }
+    return nelem;
+}
+
+int lax_getloadavg (double loadavg[], int nelem) {
+    static LAX_CLIENT client;
+    static bool opened;
+
+    if (!opened) {
+	if (!(lax_client_open(&client, NULL) & 1)) {
+	    return -1;
+	}
+	opened = true;
+    }
+    return lax_client_getavg(&client, loadavg, nelem);
+}
@@ -0,0 +1,84 @@
+/*
+ * Client library for LAXDRIVER.
+ *
+ * Keeps one channel to LAX0: open and caches the most recent record of
+ * load averages, so programs that ask for them many times a second only
+ * issue a $QIO once per driver update. The driver's LAX$K_REC_AVGS64
+ * record says when it was taken and how often the driver samples, so the
+ * cache is good until the next update is due.
+ *
+ * Each client reads through an LAX_TRANSPORT. On VMS, passing NULL to
+ * lax_client_open uses $QIO on LAX0:; other transports can read from a
+ * driver compiled into the same program, as check-lax-client.c does on
+ * Linux, or from anything else that can fill in the record.
+ *
+ * A client isn't safe to share between threads; give each thread its own.
+ *
+ * Copyright 2022, Jake Hamby.
+ * MIT License.
+ */
+
+#ifndef LAXCLIENT_H
+#define LAXCLIENT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "laxdef.h"
+
+/* Where a client gets its records from. Statuses are VMS condition values:
+ * odd for success.
+ */
+
+typedef struct {
+    int		(*read) (void *ctx, uint32_t rec_code, void *buf, uint32_t len);
+    uint64_t	(*now) (void *ctx);	/* system time, in 100 ns units */
+    void	(*close) (void *ctx);	/* may be NULL */
+    void	*ctx;
+} LAX_TRANSPORT;
+
+/* How long to wait before asking again when an update is overdue, as it
+ * is when updates are stopped, in 100 ns units
+ */
+
+#define LAX_CLIENT_RETRY	100000	/* 10 ms */
+
+typedef struct {
+    LAX_TRANSPORT transport;
+    LAX_AVGS64	cache;			/* the last record read */
+    bool	valid;			/* cache has been filled in */
+    uint64_t	fetched;		/* time the cache was filled in */
+    uint64_t	expires;		/*   and when it goes stale */
+    uint64_t	fetches;		/* records read from the driver */
+    uint64_t	hits;			/* calls answered from the cache */
+} LAX_CLIENT;
+
+/* Open a client on a transport, or on LAX0: if transport is NULL (VMS
+ * only). Returns a VMS status.
+ */
+
+int  lax_client_open (LAX_CLIENT *client, const LAX_TRANSPORT *transport);
+void lax_client_close (LAX_CLIENT *client);
+
+/* All nine averages and the header of the record, with 32 fraction bits */
+
+int  lax_client_get (LAX_CLIENT *client, LAX_AVGS64 *avgs);
+
+/* All nine averages with LAX$K_FX_SCALE fraction bits, like the classic
+ * record. They are rounded down from the 64-bit averages, so they may be
+ * a little more accurate than the classic record itself.
+ */
+
+int  lax_client_getfx (LAX_CLIENT *client, uint32_t fx[9]);
+
+/* Up to nelem averages as doubles, in LAX$K_AVG_xxx order, like
+ * getloadavg(): returns the number stored, at most 9, or -1 on failure.
+ */
+
+int  lax_client_getavg (LAX_CLIENT *client, double avgs[], int nelem);
+
+/* getloadavg() through a client that is opened on LAX0: on first use */
+
+int  lax_getloadavg (double loadavg[], int nelem);
+
+#endif /* LAXCLIENT_H */
@@ -0,0 +1,264 @@
+/*
+ * Cluster-wide load table built from LAXDRIVER records: see laxcluster.h.
+ *
+ * Copyright 2022, Jake Hamby.
+ * MIT License.
+ */
+
+#include "laxcluster.h"
+
+#include <string.h>
+
+#ifdef __VMS
+#include <builtins.h>
+#define LAX_CLUSTER_MB()	__MB()
+#else
+#define LAX_CLUSTER_MB()	__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+/* Failure status for a bad argument, SS$_BADPARAM on VMS */
+
+#define LAX_CLUSTER_BADPARAM	20
+
+int lax_cluster_init (LAX_AGGREGATOR *agg, LAX_CLUSTER *table,
+		      uint32_t rank_avg) {
+    if (rank_avg >= 9) {
+	return LAX_CLUSTER_BADPARAM;
+    }
+
+    memset(agg, 0, sizeof(*agg));
+    memset(table, 0, sizeof(*table));
+    table->lax$l_version = LAX$K_CLUSTER_VERSION;
+    table->lax$l_rank_avg = rank_avg;
+    agg->table = table;
+    return 1;
+}
+
+int lax_cluster_add (LAX_AGGREGATOR *agg, const char *name,
+		     const LAX_TRANSPORT *transport) {
+    LAX_CLUSTER *table = agg->table;
+    const uint32_t index = table->lax$l_node_count;
+
+    if (index == LAX$K_CLUSTER_NODES) {
+	return -1;
+    }
+    if (!(lax_client_open(&(agg->client[index]), transport) & 1)) {
+	return -1;
+    }
+
+    /* a new node goes at the end of the order, with the other down ones */
+    table->lax$l_generation++;
+    LAX_CLUSTER_MB();
+
+    LAX_NODE *node = &(table->lax$r_node[index]);
+    memset(node, 0, sizeof(*node));
+    strncpy(node->lax$t_name, name, sizeof(node->lax$t_name) - 1);
+    node->lax$l_state = LAX$M_NODE_DOWN;
+    node->lax$l_rank = index;
+    table->lax$w_order[index] = (uint16_t)index;
+    table->lax$l_node_count = index + 1;
+
+    LAX_CLUSTER_MB();
+    table->lax$l_generation++;
+    return (int)index;
+}
+
+/* The value a node is ranked by: down nodes come after all the others */
+
+static uint64_t lax_cluster_key (const LAX_CLUSTER *table, uint32_t index) {
+    const LAX_NODE *node = &(table->lax$r_node[index]);
+
+    if (node->lax$l_state & LAX$M_NODE_DOWN) {
+	return UINT64_MAX;
+    }
+    return node->lax$q_avgs[table->lax$l_rank_avg];
+}
+
+/* Put the order back in sorted order after some keys changed, ties going
+ * to the lower index, and renumber the ranks. Loads change a little at a
+ * time, so the order is nearly sorted already, and insertion sort only
+ * moves the nodes that changed places.
+ */
+
+static void lax_cluster_rank (LAX_CLUSTER *table) {
+    uint16_t *order = table->lax$w_order;
+    const uint32_t count = table->lax$l_node_count;
+
+    for (uint32_t i = 1; i < count; i++) {
+	const uint16_t index = order[i];
+	const uint64_t key = lax_cluster_key(table, index);
+	uint32_t j = i;
+
+	while (j > 0) {
+	    const uint64_t prev = lax_cluster_key(table, order[j - 1]);
+
+	    if (prev < key || (prev == key && order[j - 1] < index)) {
+		break;
+	    }
+	    order[j] = order[j - 1];
+	    j--;
+	}
+	order[j] = index;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+	table->lax$r_node[order[i]].lax$l_rank = i;
+    }
+}
+
+uint32_t lax_cluster_poll (LAX_AGGREGATOR *agg) {
+    LAX_CLUSTER *table = agg->table;
+    const uint32_t count = table->lax$l_node_count;
+    bool read_ok[LAX$K_CLUSTER_NODES];
+    bool changed[LAX$K_CLUSTER_NODES];
+    uint32_t nchanged = 0;
+
+    agg->polls++;
+
+    /* First do all the reads, without touching the table, finding which
+     * nodes have a new record, went down or came back up.
+     */
+    for (uint32_t i = 0; i < count; i++) {
+	const LAX_NODE *node = &(table->lax$r_node[i]);
+	LAX_AVGS64 rec;
+
+	read_ok[i] = (lax_client_get(&(agg->client[i]), &rec) & 1) != 0;
+	if (node->lax$l_state & LAX$M_NODE_DOWN) {
+	    changed[i] = true;		/* up again, or one more failure */
+	} else if (!read_ok[i]) {
+	    changed[i] = true;
+	} else {
+	    changed[i] = (rec.lax$l_seq != node->lax$l_seq ||
+			  rec.lax$q_time != node->lax$q_time);
+	}
+	nchanged += changed[i];
+    }
+
+    if (nchanged == 0) {
+	return 0;
+    }
+
+    /* then apply them all at once */
+    table->lax$l_generation++;
+    LAX_CLUSTER_MB();
+
+    nchanged = 0;
+    for (uint32_t i = 0; i < count; i++) {
+	LAX_NODE *node = &(table->lax$r_node[i]);
+	const bool was_up = !(node->lax$l_state & LAX$M_NODE_DOWN);
+
+	if (!changed[i]) {
+	    continue;
+	}
+
+	if (!read_ok[i]) {
+	    node->lax$l_failures++;
+	    if (was_up) {
+		for (int a = 0; a < 9; a++) {
+		    table->lax$q_total[a] -= node->lax$q_avgs[a];
+		}
+		table->lax$l_up_count--;
+		node->lax$l_state |= LAX$M_NODE_DOWN;
+		nchanged++;
+	    }
+	    continue;
+	}
+
+	/* totals are kept by difference; unsigned arithmetic makes that
+	 * exact even if an intermediate sum wraps
+	 */
+	const LAX_AVGS64 *rec = &(agg->client[i].cache);
+
+	for (int a = 0; a < 9; a++) {
+	    if (was_up) {
+		table->lax$q_total[a] -= node->lax$q_avgs[a];
+	    }
+	    table->lax$q_total[a] += rec->lax$q_avgs[a];
+	}
+	if (!was_up) {
+	    table->lax$l_up_count++;
+	    node->lax$l_state &= ~LAX$M_NODE_DOWN;
+	}
+	memcpy(node->lax$q_avgs, rec->lax$q_avgs, sizeof(node->lax$q_avgs));
+	node->lax$l_seq = rec->lax$l_seq;
+	node->lax$l_flags = rec->lax$l_flags;
+	node->lax$l_period_ms = rec->lax$l_period_ms;
+	node->lax$q_time = rec->lax$q_time;
+	nchanged++;
+    }
+
+    lax_cluster_rank(table);
+    table->lax$q_polls++;
+    agg->changes += nchanged;
+
+    LAX_CLUSTER_MB();
+    table->lax$l_generation++;
+    return nchanged;
+}
+
+void lax_cluster_close (LAX_AGGREGATOR *agg) {
+    for (uint32_t i = 0; i < agg->table->lax$l_node_count; i++) {
+	lax_client_close(&(agg->client[i]));
+    }
+}
+
+/* Wait for the poller to finish with the table, and start a read */
+
+static uint32_t lax_cluster_begin (const LAX_CLUSTER *table) {
+    uint32_t generation;
+
+    while ((generation = table->lax$l_generation) & 1)
+	;
+    LAX_CLUSTER_MB();
+    return generation;
+}
+
+/* True if the table changed since the read began, so it must be retried */
+
+static bool lax_cluster_retry (const LAX_CLUSTER *table, uint32_t generation) {
+    LAX_CLUSTER_MB();
+    return table->lax$l_generation != generation;
+}
+
+int lax_cluster_least_loaded (const LAX_CLUSTER *table, LAX_NODE *node) {
+    uint32_t generation;
+    int index;
+
+    do {
+	generation = lax_cluster_begin(table);
+	index = -1;
+	if (table->lax$l_up_count != 0) {
+	    index = table->lax$w_order[0];
+	    if (node != NULL) {
+		*node = table->lax$r_node[index];
+	    }
+	}
+    } while (lax_cluster_retry(table, generation));
+    return index;
+}
+
+bool lax_cluster_node (const LAX_CLUSTER *table, uint32_t index,
+		       LAX_NODE *node) {
+    uint32_t generation;
+    bool found;
+
+    do {
+	generation = lax_cluster_begin(table);
+	found = (index < table->lax$l_node_count);
+	if (found) {
+	    *node = table->lax$r_node[index];
+	}
+    } while (lax_cluster_retry(table, generation));
+    return found;
+}
+
+void lax_cluster_totals (const LAX_CLUSTER *table, uint64_t total[9],
+			 uint32_t *up_count) {
+    uint32_t generation;
+
+    do {
+	generation = lax_cluster_begin(table);
+	memcpy(total, table->lax$q_total, sizeof(table->lax$q_total));
+	*up_count = table->lax$l_up_count;
+    } while (lax_cluster_retry(table, generation));
+}
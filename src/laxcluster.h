@@ -0,0 +1,143 @@
+/*
+ * Cluster-wide load table built from LAXDRIVER records.
+ *
+ * An aggregator polls any number of nodes, each through a LAX_CLIENT on its
+ * own LAX_TRANSPORT (see laxclient.h), and keeps a LAX_CLUSTER table of
+ * every node's nine 64-bit averages, the totals over the nodes that are
+ * up, and the nodes in order of one chosen average, least loaded first.
+ * Answering "which node is least loaded" is then a look at the first entry
+ * of the order, however many nodes there are.
+ *
+ * The table holds no pointers, so it can live in memory shared with other
+ * processes, such as a global section or a Linux shared mapping, with one
+ * process polling and any number reading it. Like the driver's LAX_PAGE,
+ * lax$l_generation is odd while the poller is changing the table, and
+ * goes up by 2 on each poll that changes it; the lax_cluster_xxx readers
+ * copy what they need and retry if it changed under them. A poll does its
+ * I/O first and only then changes the table, so readers never wait on the
+ * network.
+ *
+ * A client only reads a node's record when that node's next update is
+ * due, so a poll costs one read per node that has updated since the last
+ * one. A node whose transport fails is marked down, taken out of the
+ * totals and ranked after all the nodes that are up, until a read of it
+ * succeeds again. How a transport reaches a remote node, over DECnet, TCP
+ * or anything else, is up to whoever supplies it; check-lax-cluster.c uses
+ * one process per node on Linux.
+ *
+ * The aggregator isn't safe to share between threads; the table's readers
+ * are.
+ *
+ * Copyright 2022, Jake Hamby.
+ * MIT License.
+ */
+
+#ifndef LAXCLUSTER_H
+#define LAXCLUSTER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "laxclient.h"
+
+#define LAX$K_CLUSTER_VERSION	1
+#define LAX$K_CLUSTER_NODES	512	/* largest cluster a table holds */
+
+#define LAX$M_NODE_DOWN		0x00000001  /* last read failed, or none */
+					    /*   has succeeded yet */
+
+/* One node's entry in the table */
+
+typedef struct {
+    char	lax$t_name[16];		/* as given, NUL-terminated */
+    uint32_t	lax$l_state;		/* LAX$M_NODE_xxx bits */
+    uint32_t	lax$l_rank;		/* index in lax$w_order, 0 = least */
+					/*   loaded */
+    uint32_t	lax$l_seq;		/* update sequence number, and */
+    uint32_t	lax$l_flags;		/*   LAX$M_xxx status bits of the */
+    uint32_t	lax$l_period_ms;	/*   node's last record */
+    uint32_t	lax$l_failures;		/* reads that failed */
+    uint64_t	lax$q_time;		/* node's system time of the record */
+    uint64_t	lax$q_avgs[9];		/* LAX$K_AVG_xxx order, 32 fraction */
+					/*   bits, as in LAX_AVGS64 */
+} LAX_NODE;
+
+/* The shared table. lax$q_total is the sum of the averages of the nodes
+ * that are up; the sum wraps if it outgrows 32 integer bits, which takes
+ * a load of over 8 million on each of 512 nodes.
+ */
+
+typedef struct {
+    uint32_t	lax$l_version;		/* LAX$K_CLUSTER_VERSION */
+    volatile uint32_t lax$l_generation;	/* odd while being updated */
+    uint32_t	lax$l_rank_avg;		/* LAX$K_AVG_xxx nodes are ranked by */
+    uint32_t	lax$l_node_count;	/* entries in use */
+    uint32_t	lax$l_up_count;		/* of those, nodes that are up */
+    uint32_t	lax$l_reserved;
+    uint64_t	lax$q_polls;		/* polls that changed the table */
+    uint64_t	lax$q_total[9];		/* over the nodes that are up */
+    uint16_t	lax$w_order[LAX$K_CLUSTER_NODES]; /* node indexes, least */
+					/*   loaded first, then down nodes */
+    LAX_NODE	lax$r_node[LAX$K_CLUSTER_NODES];
+} LAX_CLUSTER;
+
+/* The poller's own state, private to the process that polls */
+
+typedef struct {
+    LAX_CLUSTER	*table;			/* may be in shared memory */
+    LAX_CLIENT	client[LAX$K_CLUSTER_NODES];
+    uint64_t	polls;			/* calls of lax_cluster_poll */
+    uint64_t	changes;		/* node updates seen by them */
+} LAX_AGGREGATOR;
+
+/* Set up an aggregator and clear its table, ranking nodes by the average
+ * rank_avg (LAX$K_AVG_LOAD_1 for the usual least-loaded node). Returns a
+ * VMS status: SS$_BADPARAM if rank_avg is out of range.
+ */
+
+int  lax_cluster_init (LAX_AGGREGATOR *agg, LAX_CLUSTER *table,
+		       uint32_t rank_avg);
+
+/* Add a node read through transport, or through LAX0: if transport is
+ * NULL (VMS only). It stays down until the next poll reads it. Returns
+ * the node's index, or -1 if the table is full or the transport can't
+ * be opened.
+ */
+
+int  lax_cluster_add (LAX_AGGREGATOR *agg, const char *name,
+		      const LAX_TRANSPORT *transport);
+
+/* Read every node that has updated, or should have, since the last poll,
+ * then bring the table up to date in one go. Returns the number of nodes
+ * whose entry changed.
+ */
+
+uint32_t lax_cluster_poll (LAX_AGGREGATOR *agg);
+
+/* Close every node's transport. The table is left as it was. */
+
+void lax_cluster_close (LAX_AGGREGATOR *agg);
+
+/* Readers. Each copies from the table without locking, retrying while
+ * a poll is changing it.
+ */
+
+/* The least loaded node that is up: returns its index and copies its
+ * entry to *node if node isn't NULL, or returns -1 if no node is up.
+ */
+
+int  lax_cluster_least_loaded (const LAX_CLUSTER *table, LAX_NODE *node);
+
+/* A node's entry, including its rank. Returns false if there's no such
+ * node.
+ */
+
+bool lax_cluster_node (const LAX_CLUSTER *table, uint32_t index,
+		       LAX_NODE *node);
+
+/* The totals over the nodes that are up, and how many there are */
+
+void lax_cluster_totals (const LAX_CLUSTER *table, uint64_t total[9],
+			 uint32_t *up_count);
+
+#endif /* LAXCLUSTER_H */
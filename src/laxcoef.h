@@ -0,0 +1,46 @@
+/*
+ * Fixed-point EWMA coefficients for LAXDRIVER.
+ *
+ * Generated by gen-lax-coeffs.py. Do not edit by hand; rerun the
+ * script if FX_SCALE, FX_LSHIFT or FX_RSHIFT change.
+ */
+
+#ifndef LAXCOEF_H
+#define LAXCOEF_H
+
+/* Scaling factors these coefficients were computed for */
+
+#define LAXCOEF_FX_SCALE	14
+#define LAXCOEF_FX_LSHIFT	6
+#define LAXCOEF_FX_RSHIFT	24
+
+#define LAXCOEF_NPERIODS	4
+#define LAXCOEF_NWINDOWS	3
+
+static const uint32_t lax_coef_period_ms[LAXCOEF_NPERIODS] = {
+    100, 250, 1000, 5000
+};
+
+static const uint32_t lax_coef_window_s[LAXCOEF_NWINDOWS] = {
+    60, 300, 900
+};
+
+/* { old: exp(-T/W) * (1<<24), new: (1 - exp(-T/W)) * (1<<32) } */
+
+static const LAX_COEF lax_coef_table[LAXCOEF_NPERIODS][LAXCOEF_NWINDOWS] = {
+    { {   16749277,    7152317 }, {   16771625,    1431417 }, {   16775352,     477192 } },	/* 100 ms */
+    { {   16707456,   17858466 }, {   16763241,    3577649 }, {   16772556,    1192881 } },	/* 250 ms */
+    { {   16499913,   70989565 }, {   16721385,   14292723 }, {   16758585,    4769536 } },	/* 1000 ms */
+    { {   15435784,  343406624 }, {   16499913,   70989565 }, {   16684268,   23794772 } },	/* 5000 ms */
+};
+
+/* { old: exp(-T/W) * (1<<32), new: (1<<32) - old } */
+
+static const LAX_COEF64 lax_coef64_table[LAXCOEF_NPERIODS][LAXCOEF_NWINDOWS] = {
+    { { 4287814979U,    7152317U }, { 4293535879U,    1431417U }, { 4294490104U,     477192U } },	/* 100 ms */
+    { { 4277108830U,   17858466U }, { 4291389647U,    3577649U }, { 4293774415U,    1192881U } },	/* 250 ms */
+    { { 4223977731U,   70989565U }, { 4280674573U,   14292723U }, { 4290197760U,    4769536U } },	/* 1000 ms */
+    { { 3951560672U,  343406624U }, { 4223977731U,   70989565U }, { 4271172524U,   23794772U } },	/* 5000 ms */
+};
+
+#endif /* LAXCOEF_H */
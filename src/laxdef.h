@@ -0,0 +1,382 @@
+/*
+ * Definitions shared by LAXDRIVER and the programs that talk to it.
+ *
+ * A plain read of LAX0: with P3 = 0 returns the classic 36-byte block of
+ * nine fixed-point load averages, and a plain write with P3 = 0 takes the
+ * single stop/start byte. Other values of the $QIO P3 parameter select an
+ * extended record to read, or a command to perform on a write. Writes
+ * require CMKRNL privilege.
+ *
+ * More units, LAX1: and up, can be connected the same way as LAX0:. Each
+ * has its own averages, period, windows, idle setting and stop/start
+ * state, and its own published page, but they all share the one scan of
+ * the scheduler and I/O database made when their ticks coincide, and the
+ * walk budget that limits it.
+ *
+ * Copyright 2022, Jake Hamby.
+ * MIT License.
+ */
+
+#ifndef LAXDEF_H
+#define LAXDEF_H
+
+#include <stdint.h>
+
+/* Fixed-point scaling of the load averages in the classic record */
+
+#define LAX$K_FX_SCALE		14
+
+/* Record codes for reads (P3) */
+
+#define LAX$K_REC_AVGS		0	/* uint32_t[9] load averages, then */
+					/*   uint32_t update sequence number */
+#define LAX$K_REC_STATUS	1	/* LAX_STATUS */
+#define LAX$K_REC_DISKS		2	/* LAX_DISK_HDR + LAX_DISK[] */
+#define LAX$K_REC_SAMPLES	3	/* LAX_SAMPLE_HDR + LAX_SAMPLE[] */
+#define LAX$K_REC_PAGE		4	/* LAX_PAGE_INFO */
+#define LAX$K_REC_WAIT		5	/* none: wait for a threshold, see below */
+#define LAX$K_REC_PRIO		6	/* LAX_PRIO */
+#define LAX$K_REC_CLASSES	7	/* LAX_CLASSES */
+#define LAX$K_REC_AVGS64	8	/* LAX_AVGS64 */
+#define LAX$K_REC_PEAKS		9	/* LAX_PEAKS */
+#define LAX$K_REC_PROFILE	10	/* LAX_PROFILE */
+#define LAX$K_REC_MEMORY	11	/* LAX_MEMORY */
+
+/* Indexes of the nine load averages in the classic record */
+
+#define LAX$K_AVG_LOAD_1	0	/* runnable threads, 1 minute */
+#define LAX$K_AVG_LOAD_5	1
+#define LAX$K_AVG_LOAD_15	2
+#define LAX$K_AVG_PRI_1		3	/* lowest running priority */
+#define LAX$K_AVG_PRI_5		4
+#define LAX$K_AVG_PRI_15	5
+#define LAX$K_AVG_DISKQ_1	6	/* total disk queue length */
+#define LAX$K_AVG_DISKQ_5	7
+#define LAX$K_AVG_DISKQ_15	8
+
+/* Command codes for writes (P3) */
+
+#define LAX$K_CMD_STOP		0	/* bool: 1 = stop updates, 0 = restart */
+#define LAX$K_CMD_WALK_BUDGET	1	/* uint32_t: max KTBs per tick, 0 = no */
+					/*   limit; shared by all units */
+#define LAX$K_CMD_PERIOD	2	/* uint32_t: sampling period in ms, one */
+					/*   of 100, 250, 1000 or 5000 */
+#define LAX$K_CMD_PUBLISH	3	/* uint32_t: 0; allocates the LAX_PAGE */
+#define LAX$K_CMD_WINDOWS	4	/* uint32_t[3]: averaging windows in */
+					/*   seconds, see below */
+#define LAX$K_CMD_IDLE		5	/* uint32_t: seconds without reads */
+					/*   before sampling slows down, */
+					/*   0 = never (the default) */
+#define LAX$K_CMD_PEAKS		6	/* uint32_t: 0; starts tracking the */
+					/*   LAX_PEAKS record */
+
+/* Idle sampling. Once LAX$K_CMD_IDLE is set and nothing has read the unit
+ * for that long, the timer slows down to one update every
+ * LAX$K_IDLE_PERIOD_MS, and a read that finds the last update more than a
+ * period old takes a fresh sample first, decayed over the whole time
+ * since. The period's rate resumes at the next update after a read.
+ * Threshold waits and the published page are read without $QIOs the
+ * driver can see, so the unit never idles while either is in use.
+ */
+
+#define LAX$K_IDLE_PERIOD_MS	60000
+
+/* Averaging windows. Each metric is averaged over three windows, 1, 5 and
+ * 15 minutes unless set otherwise with LAX$K_CMD_WINDOWS, which takes the
+ * length of each in seconds, or 0 to restore its standard length. The
+ * averages over a window whose length changes restart from 0, and the
+ * window lengths in use are returned in LAX_STATUS. The LAX$K_AVG_xxx_1,
+ * _5 and _15 names refer to the first, second and third window.
+ */
+
+#define LAX$K_WINDOW_MIN	1
+#define LAX$K_WINDOW_MAX	86400	/* one day */
+
+/* The nine load averages with 64 bits and a 32-bit fraction, for clients
+ * that need more range or precision than the classic record has. The
+ * header gives the record's version and size, so fields can be added to
+ * the end later; version 2 added lax$q_time, from which a client can tell
+ * when the next update is due. Both forms of the averages saturate at
+ * their largest value rather than wrapping.
+ */
+
+#define LAX$K_AVGS64_VERSION	2
+#define LAX$K_FX64_SCALE	32
+
+typedef struct {
+    uint16_t	lax$w_version;		/* LAX$K_AVGS64_VERSION */
+    uint16_t	lax$w_size;		/* bytes in the whole record */
+    uint32_t	lax$l_seq;		/* update sequence number */
+    uint32_t	lax$l_flags;		/* LAX$M_xxx status bits */
+    uint32_t	lax$l_period_ms;	/* sampling period */
+    uint64_t	lax$q_avgs[9];		/* LAX$K_AVG_xxx order */
+    uint64_t	lax$q_time;		/* exe$gq_systime of the update, */
+					/*   0 before the first one and */
+					/*   after a restart */
+} LAX_AVGS64;
+
+/* Threshold waits. A read with P3 = LAX$K_REC_WAIT transfers no data; it
+ * stays queued until the load average selected by P4 crosses the
+ * fixed-point threshold in P5, then completes with SS$_NORMAL and the
+ * average's value in the second longword of the IOSB, which is when the
+ * $QIO's AST is delivered. It completes with SS$_CANCEL if cancelled, and
+ * SS$_ABORT if updates are stopped.
+ *
+ * A wait completes on the first update at which the average is at or above
+ * the threshold (at or below it with LAX$M_WAIT_BELOW), after having been
+ * on the other side. If it is already past the threshold when the read is
+ * issued, it must first fall back by more than the hysteresis in P6, so a
+ * daemon that reissues the read as soon as it completes isn't woken again
+ * by noise around the threshold. With LAX$M_WAIT_LEVEL, a read issued past
+ * the threshold completes at once instead.
+ */
+
+#define LAX$M_WAIT_INDEX	0x000000FF  /* P4: LAX$K_AVG_xxx to watch */
+#define LAX$M_WAIT_BELOW	0x00000100  /* P4: wait to fall to threshold */
+#define LAX$M_WAIT_LEVEL	0x00000200  /* P4: complete at once if past it */
+
+/* Every record read from the driver is a consistent snapshot of a single
+ * update. The update sequence number returned with it changes on each
+ * update, so a client that sees the same number twice knows no new sample
+ * has been taken in between. The classic record only includes it if the
+ * buffer is at least 40 bytes long.
+ */
+
+/* Sampling status, describing the most recent update. The averages decay
+ * by the time that actually passed since the update before, so an update
+ * that comes late, or after others were missed, counts for as long as it
+ * stood for. If that was more than a few periods, the load in between
+ * wasn't seen and the sample is flagged as stale.
+ */
+
+#define LAX$M_APPROX		0x00000001  /* run queue count was estimated */
+#define LAX$M_STALE		0x00000002  /* long gap before this update */
+#define LAX$M_RESTARTED		0x00000004  /* first update since loading or */
+					    /*   a restart, from 0 */
+#define LAX$M_IDLE		0x00000008  /* taken at the idle rate, or */
+					    /*   for a read while idle */
+
+typedef struct {
+    uint32_t	lax$l_flags;		/* LAX$M_xxx bits */
+    uint32_t	lax$l_walk_budget;	/* current KTB walk limit, 0 = none */
+    uint32_t	lax$l_ktbs_walked;	/* KTBs visited in the last update */
+    uint32_t	lax$l_ktbs_estimated;	/* KTBs estimated, not visited */
+    uint32_t	lax$l_period_ms;	/* sampling period */
+    uint32_t	lax$l_seq;		/* update sequence number */
+    uint32_t	lax$l_window_s[3];	/* averaging windows, in seconds */
+    uint32_t	lax$l_idle_s;		/* LAX$K_CMD_IDLE setting */
+} LAX_STATUS;
+
+/* Per-disk queue length averages. The header is followed by as many
+ * LAX_DISK entries as fit in the read buffer, up to the number of mounted
+ * disks, and lax$l_count is set to the number actually returned.
+ * LAX$M_DISKS_OVERFLOW means nonpaged pool ran short when the driver made
+ * room for more disks, so some are left out, here and in the total disk
+ * queue length, until the driver next rebuilds its list of them.
+ */
+
+#define LAX$M_DISKS_OVERFLOW	0x00000001  /* not every disk fit */
+
+typedef struct {
+    uint32_t	lax$l_count;		/* LAX_DISK entries that follow */
+    uint32_t	lax$l_flags;		/* LAX$M_DISKS_xxx bits */
+    uint32_t	lax$l_seq;		/* update sequence number */
+    uint32_t	lax$l_reserved;
+} LAX_DISK_HDR;
+
+typedef struct {
+    uint64_t	lax$q_ucb;		/* UCB address, identifies the unit */
+    char	lax$t_name[16];		/* device name, e.g. "DKA100", */
+					/*   zero-padded */
+    uint32_t	lax$l_qlen;		/* queue length at the last update */
+    uint32_t	lax$fx_avgs[3];		/* 1, 5 and 15 minute averages */
+} LAX_DISK;
+
+/* Run queue histogram: 1, 5 and 15 minute averages of the number of
+ * threads running or waiting for a CPU at each priority, 63 being the
+ * highest. Threads in page wait states are counted in the classic load
+ * average but not here, since they aren't queued by priority.
+ */
+
+typedef struct {
+    uint32_t	lax$l_seq;		/* update sequence number */
+    uint32_t	lax$l_reserved;
+    uint32_t	lax$fx_avgs[64][3];	/* by priority, then window */
+} LAX_PRIO;
+
+/* The classic load average broken down by the state of the threads it
+ * counts, each with its own 1, 5 and 15 minute averages. The four add up
+ * to the classic load average, give or take rounding.
+ */
+
+#define LAX$K_CLASS_COM		0	/* computable, waiting for a CPU */
+#define LAX$K_CLASS_COMO	1	/* computable but outswapped */
+#define LAX$K_CLASS_PGWAIT	2	/* page fault, free page and */
+					/*   collided page waits */
+#define LAX$K_CLASS_RUNNING	3	/* running on a CPU */
+
+typedef struct {
+    uint32_t	lax$l_seq;		/* update sequence number */
+    uint32_t	lax$l_reserved;
+    uint32_t	lax$fx_avgs[4][3];	/* by LAX$K_CLASS_xxx, then window */
+} LAX_CLASSES;
+
+/* Memory pressure: 1, 5 and 15 minute averages of the depth of each of
+ * the three page wait queues that LAX$K_CLASS_PGWAIT adds together, of
+ * the number of pages on the free list, and of the system's page fault
+ * rate, with the values each had at the last update. They have 32
+ * fraction bits, as in LAX_AVGS64, since the free list can hold millions
+ * of pages. The fault rate is measured from the system's count of page
+ * faults over the time since the unit's previous update, so it starts
+ * with the second update after loading or a restart.
+ */
+
+#define LAX$K_MEM_COLPGWAIT	0	/* threads in collided page wait */
+#define LAX$K_MEM_PFWAIT	1	/* threads in page fault wait */
+#define LAX$K_MEM_FPGWAIT	2	/* threads in free page wait */
+#define LAX$K_MEM_FREE		3	/* pages on the free list */
+#define LAX$K_MEM_FAULT_RATE	4	/* page faults per second */
+#define LAX$K_MEM_COUNT		5
+
+typedef struct {
+    uint32_t	lax$l_seq;		/* update sequence number */
+    uint32_t	lax$l_sample[LAX$K_MEM_COUNT]; /* by LAX$K_MEM_xxx, */
+					/*   at the last update */
+    uint64_t	lax$q_avgs[LAX$K_MEM_COUNT][3]; /* by LAX$K_MEM_xxx, */
+					/*   then window */
+} LAX_MEMORY;
+
+/* Sliding window peaks: the exact largest and smallest samples of the
+ * run queue and total disk queue length taken over the last 1, 5 and 15
+ * minutes, whatever the averaging windows are set to. They are plain
+ * integers, not fixed point. The driver tracks them only after a
+ * privileged write with P3 = LAX$K_CMD_PEAKS, since the samples behind
+ * them take nonpaged pool in proportion to the sampling rate, and until
+ * then a read of the record fails with SS$_DEVINACT. lax$l_tracked_ms
+ * says how much of the longest window is covered so far. A window that
+ * holds no samples, because the I/O database couldn't be locked
+ * throughout, reports LAX$K_NO_QLEN.
+ */
+
+#define LAX$K_PEAK_LOAD		0	/* runnable and running threads */
+#define LAX$K_PEAK_DISKQ	1	/* total disk queue length */
+
+typedef struct {
+    uint32_t	lax$l_seq;		/* update sequence number */
+    uint32_t	lax$l_tracked_ms;	/* sampling covered, up to 15 minutes */
+    uint32_t	lax$l_max[2][3];	/* by LAX$K_PEAK_xxx, then window */
+    uint32_t	lax$l_min[2][3];
+} LAX_PEAKS;
+
+/* The driver's own cost. Each update is profiled from when the timer
+ * routine is entered to just before it releases the device lock. Times
+ * are in ticks of the processor's cycle counter (the interval time
+ * counter on Integrity servers), and are only meaningful compared with
+ * each other on the same system. Lateness is how long after one sampling
+ * period since the previous update each one came, in microseconds, to the
+ * resolution of the system clock; an update that came late by a whole
+ * period or more also counts the periods that went without one as missed.
+ * Statistics cover every update since the driver was loaded, except that
+ * lateness isn't measured for the first update after a restart.
+ */
+
+#define LAX$K_PROF_TICK		0	/* cycles in the timer routine */
+#define LAX$K_PROF_SCHED	1	/* cycles holding the SCHED spinlock */
+#define LAX$K_PROF_KTBS		2	/* KTBs visited */
+#define LAX$K_PROF_UCBS		3	/* UCBs visited */
+#define LAX$K_PROF_LATE		4	/* microseconds late */
+#define LAX$K_PROF_COUNT	5
+
+/* Histogram bucket 0 counts zeros, bucket n counts values from 2^(n-1)
+ * up to 2^n - 1, and the last bucket also counts anything larger.
+ */
+
+#define LAX$K_PROF_BUCKETS	32
+
+typedef struct {
+    uint32_t	lax$l_min;		/* UINT32_MAX before the first update */
+    uint32_t	lax$l_max;
+    uint64_t	lax$q_sum;		/* divide by the histogram's total */
+					/*   for the mean */
+    uint32_t	lax$l_hist[LAX$K_PROF_BUCKETS];
+} LAX_PROF_STAT;
+
+typedef struct {
+    uint32_t	lax$l_seq;		/* update sequence number */
+    uint32_t	lax$l_reserved;
+    uint64_t	lax$q_ticks;		/* updates profiled */
+    uint64_t	lax$q_late_ticks;	/*   and of those, ones at least */
+					/*   half a period late */
+    uint64_t	lax$q_missed;		/* periods with no update at all */
+    uint64_t	lax$q_iodb_busy;	/* updates that skipped the disks */
+					/*   because the I/O database was */
+					/*   locked for write */
+    LAX_PROF_STAT lax$r_stat[LAX$K_PROF_COUNT]; /* by LAX$K_PROF_xxx */
+    uint64_t	lax$q_shared;		/* updates that used another */
+					/*   unit's scan, costing nothing */
+					/*   in SCHED, KTBs or UCBs */
+} LAX_PROFILE;
+
+/* Raw samples, as taken on each tick before they are averaged. The driver
+ * keeps the most recent ones in a ring, numbered from 1 upward. A read
+ * with P3 = LAX$K_REC_SAMPLES and P4 = the first sequence number wanted
+ * (0 for the oldest one still held) returns the header followed by as many
+ * consecutive samples as fit in the buffer. Pass lax$l_next_seq as P4 on
+ * the next read to pick up where this one left off.
+ */
+
+#define LAX$K_NO_PRI		0xFFFFFFFF  /* no CPU was running a thread */
+#define LAX$K_NO_QLEN		0xFFFFFFFF  /* IOC database was busy */
+
+typedef struct {
+    uint32_t	lax$l_first_seq;	/* sequence number of the first sample */
+    uint32_t	lax$l_count;		/* LAX_SAMPLE entries that follow */
+    uint32_t	lax$l_next_seq;		/* sequence number to ask for next */
+    uint32_t	lax$l_lost;		/* samples requested but overwritten */
+} LAX_SAMPLE_HDR;
+
+typedef struct {
+    uint64_t	lax$q_time;		/* exe$gq_systime of the tick */
+    uint32_t	lax$l_seq;		/* sequence number */
+    uint32_t	lax$l_flags;		/* LAX$M_xxx status bits */
+    uint32_t	lax$l_proc_count;	/* runnable and running threads */
+    uint32_t	lax$l_lowest_pri;	/* lowest running priority, 0-63 */
+    uint32_t	lax$l_disk_qlen;	/* sum of disk queue lengths */
+    uint32_t	lax$l_period_ms;	/* sampling period */
+} LAX_SAMPLE;
+
+/* Published statistics page. After a privileged write with
+ * P3 = LAX$K_CMD_PUBLISH, the driver copies the load averages into a
+ * LAX_PAGE at the start of a page of its own on every tick. A read with
+ * P3 = LAX$K_REC_PAGE returns where that page is, so a privileged startup
+ * program can create a permanent system global section named
+ * LAX$K_SECTION_NAME over it, and other processes can map it read-only.
+ * By convention, other units' sections add an underscore and the device
+ * name, as in LAX$STATS_LAX1.
+ *
+ * lax$l_generation is odd while the driver is writing the page, and goes
+ * up by 2 on each update. A reader copies the fields it wants, then checks
+ * that the generation was even and hasn't changed, and retries if not.
+ */
+
+#define LAX$K_SECTION_NAME	"LAX$STATS"
+#define LAX$K_PAGE_VERSION	1
+
+typedef struct {
+    uint32_t	lax$l_version;		/* LAX$K_PAGE_VERSION */
+    volatile uint32_t lax$l_generation;	/* odd while being updated */
+    uint64_t	lax$q_time;		/* exe$gq_systime of the last update */
+    uint32_t	lax$l_flags;		/* LAX$M_xxx status bits */
+    uint32_t	lax$l_period_ms;	/* sampling period */
+    uint32_t	lax$fx_avgs[9];		/* same as the LAX$K_REC_AVGS record */
+    uint32_t	lax$l_reserved;
+} LAX_PAGE;
+
+typedef struct {
+    uint64_t	lax$q_pfn;		/* page frame number, 0 if the page */
+					/*   hasn't been allocated */
+    uint32_t	lax$l_page_size;	/* bytes in the page */
+    uint32_t	lax$l_reserved;
+} LAX_PAGE_INFO;
+
+#endif /* LAXDEF_H */
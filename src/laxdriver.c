@@ -1,4 +1,6 @@
+#ifndef LAX_HOST
 #pragma module LAXDRIVER "X-1"
+#endif
 /*
  * System load average extended driver (LAX0:), returning fixed-point
  * values as 32-bit unsigned ints, with a 14-bit scaling factor.
@@ -13,10 +15,19 @@
 
 /* Define system data structure types and constants */
 
+#ifdef LAX_HOST
+
+/* Linux benchmark build: mock kernel definitions (see laxhost.h) */
+
+#include "laxhost.h"
+
+#else
+
 #define __NEW_STARLET 1
 
 #include <bufiodef.h>		/* Define the packet header for a system */
 				/*   buffer for buffered I/O data */
+#include <cbbdef.h>             /* CPU bitmask block */
 #include <ccbdef.h>             /* Channel control block */
 #include <cpudef.h>             /* Per-CPU data definition */
 #include <crbdef.h>             /* Controller request block */
@@ -34,6 +45,7 @@
 #include <orbdef.h>             /* Object rights block */
 #include <pcbdef.h>             /* Process control block */
 #include <prvdef.h>             /* Privilege bits */
+#include <ptedef.h>             /* Page table entry */
 #include <ssdef.h>              /* System service status codes */
 #include <stsdef.h>             /* Status value fields */
 #include <tqedef.h>             /* Timer queue entry fields */
@@ -42,6 +54,7 @@
 
 /* Define function prototypes for system routines */
 
+#include <com_routines.h>       /* Prototypes for com$ and com_std$ routines */
 #include <exe_routines.h>       /* Prototypes for exe$ and exe_std$ routines */
 #include <ioc_routines.h>       /* Prototypes for ioc$ and ioc_std$ routines */
 #include <sch_routines.h>       /* Prototypes for sch$ and sch_std$ routines */
@@ -52,43 +65,353 @@
                                 /* table initialization macros and prototypes */
 #include <vms_macros.h>         /* Additional macros */
 
+#include <builtins.h>		/* _trailz, _leadz, _popcnt, __UMULH, __MB */
+				/*   and the cycle counters */
+
+#endif /* LAX_HOST */
+
 /* Define the DEC C functions used by this driver */
 
 #include <string.h>             /* String routines provided by "kernel CRTL" */
+#include <stddef.h>		/* offsetof */
 #include <stdint.h>		/* C99 typedefs */
 #include <stdbool.h>		/* C99 bool type */
 
+#include "laxdef.h"		/* Record layouts shared with client programs */
+
 /* Define the fixed-point scaling factors. Update the constants if you change them. */
 
-#define FX_SCALE	14		/* scaling factor for stored results */
+#define FX_SCALE	LAX$K_FX_SCALE	/* scaling factor for stored results */
 #define FX_LSHIFT   (FX_SCALE - 8)	/* coefficients will shift 8 extra bits */
 #define FX_RSHIFT   (FX_SCALE + 10)	/* right-shift after multiply and add */
 
-/* Number of realtime priority levels to test and eliminate (as an optimization).
- * OpenVMS V7.0 tests bits 0-46 with a mask, skipping to bit 47, corresponding to
- * external priority 16 (swapper), which is the highest priority typically used,
- * if none of the bits in the mask are set. Do the same thing in this program.
- * If you use priorities 17 or higher, reduce this accordingly (subtract from 63).
+/* Coefficient pair for one averaging window at the current sampling period.
+ * The multipliers for the new values have an extra 8 bits of fraction.
+ * This is subtracted from the 14 bits that the integers are shifted,
+ * so that the old and new coefficients will both have 24 fraction bits.
+ */
+
+typedef struct {
+    uint32_t	old_lav;		/* exp(-T/W) * (1<<24) */
+    uint32_t	new_lav;		/* (1 - exp(-T/W)) * (1<<32) */
+} LAX_COEF;
+
+/* Coefficient pair for the 64-bit averages, which have 32 fraction bits,
+ * as do both coefficients. They add up to exactly 1<<32.
+ */
+
+typedef struct {
+    uint32_t	old_lav;		/* exp(-T/W) * (1<<32) */
+    uint32_t	new_lav;		/* (1<<32) - old_lav */
+} LAX_COEF64;
+
+/* Largest sample the 32-bit averages can represent. Larger samples are
+ * clamped to it, so that the averages saturate instead of wrapping.
+ */
+
+#define FX_MAX_SAMPLE	(UINT32_MAX >> FX_SCALE)
+
+/* The coefficients for each supported sampling period are generated by
+ * gen-lax-coeffs.py, which must be rerun if the scaling factors change.
+ */
+
+#include "laxcoef.h"
+
+#if (LAXCOEF_FX_SCALE != FX_SCALE) || (LAXCOEF_FX_LSHIFT != FX_LSHIFT) || \
+    (LAXCOEF_FX_RSHIFT != FX_RSHIFT)
+#error "laxcoef.h is out of date: rerun gen-lax-coeffs.py"
+#endif
+
+/* Default sampling period in milliseconds, which must be one of the periods
+ * in laxcoef.h. It can be chosen at build time, or changed after the driver
+ * is loaded with a privileged write with P3 = LAX$K_CMD_PERIOD.
+ */
+
+#ifndef LAX_PERIOD_MS
+#define LAX_PERIOD_MS		1000
+#endif
+
+/* Default limit on the number of KTBs visited per tick while holding SCHED.
+ * Queues beyond the limit are estimated from their depth the last time they
+ * were walked, and the sample is flagged as approximate. A privileged
+ * write with P3 = LAX$K_CMD_WALK_BUDGET changes it; 0 means no limit.
+ *
+ * A queue deeper than the whole budget is never walked to the end within
+ * it, so while the samples are approximate, every LAX_DEPTH_REFRESH
+ * seconds one scan walks every queue without a limit to learn their
+ * depths again.
+ */
+
+#ifndef LAX_WALK_BUDGET
+#define LAX_WALK_BUDGET		16384
+#endif
+
+#ifndef LAX_DEPTH_REFRESH
+#define LAX_DEPTH_REFRESH	60
+#endif
+
+/* A tick that comes within LAX_TICK_SLACK ms of one period after the last,
+ * about the resolution of the system clock, is taken to be on time and
+ * uses the period's coefficients; others get coefficients for the time
+ * that actually passed. One that comes more than LAX_STALE_PERIODS
+ * periods after the last is flagged LAX$M_STALE.
+ */
+
+#ifndef LAX_TICK_SLACK
+#define LAX_TICK_SLACK		10
+#endif
+
+#ifndef LAX_STALE_PERIODS
+#define LAX_STALE_PERIODS	4
+#endif
+
+/* The cached disk list, and each unit's per-disk averages, are allocated
+ * from nonpaged pool for the number of mounted disks found, rounded up to
+ * a multiple of LAX_DISK_ROUND so that a few more don't need a new
+ * allocation. LAX_DISK_RESCAN is the number of seconds between rescans of
+ * the I/O database to refresh the list.
+ */
+
+#ifndef LAX_DISK_ROUND
+#define LAX_DISK_ROUND		32
+#endif
+
+#ifndef LAX_DISK_RESCAN
+#define LAX_DISK_RESCAN		60
+#endif
+
+/* Maximum number of units, LAX0: to LAX7: by default. Every unit's ticks
+ * fall on multiples of its own period, counted from the same origin of
+ * system time, so units whose ticks are due at the same moment run one
+ * after the other. A unit that ticks within LAX_SCAN_SHARE ms of another
+ * uses the scan of the scheduler and I/O database that one made, instead
+ * of making its own.
+ */
+
+#ifndef LAX_MAX_UNITS
+#define LAX_MAX_UNITS		8
+#endif
+
+#ifndef LAX_SCAN_SHARE
+#define LAX_SCAN_SHARE		20
+#endif
+
+/* Number of raw samples to keep for LAX$K_REC_SAMPLES reads; must be a
+ * power of 2. At the default period of 1 second, 512 samples is a little
+ * over 8 minutes of history.
+ */
+
+#ifndef LAX_SAMPLE_RING
+#define LAX_SAMPLE_RING		512
+#endif
+
+#if (LAX_SAMPLE_RING & (LAX_SAMPLE_RING - 1)) != 0
+#error "LAX_SAMPLE_RING must be a power of 2"
+#endif
+
+/* Sliding windows for the LAX$K_REC_PEAKS maximum and minimum, in seconds.
+ * Each tracked value keeps a queue of the samples that are still the
+ * largest (or smallest) of those taken since, over the longest window,
+ * which must be the last. At the unit's period every sample may need to
+ * be kept, so that decides the size of the queues, with room for one
+ * more a minute: an idle unit's timer tick between samples on demand.
+ */
+
+#define LAX_PEAK_WINDOWS	{ 60, 300, 900 }
+#define LAX_PEAK_LONGEST	900
+#define LAX_PEAK_SLOTS(period_ms) \
+    (LAX_PEAK_LONGEST * 1000 / (period_ms) + LAX_PEAK_LONGEST / 60 + 1)
+
+typedef struct {
+    uint32_t	t_ms;			/* system time of the sample in ms */
+    uint32_t	value;			/* sample, or its complement */
+} LAX_PEAK_ENT;
+
+typedef struct {
+    uint32_t	head;			/* slot of the oldest entry */
+    uint32_t	len;			/* entries in use */
+    uint32_t	skip[3];		/* entries before each window */
+    uint32_t	slots;			/* size of ent, set when allocated */
+    LAX_PEAK_ENT *ent;			/*   after the four queue headers */
+} LAX_PEAK_Q;
+
+/* The last scan of the scheduler and I/O database, shared by all units,
+ * and the state carried from one scan to the next.
+ *
+ * Every unit's updates use it, so they must all hold its lock, a spinlock
+ * of the driver's own: the units don't share any other lock that would
+ * keep two of them out of it at once. The lock also covers what decides
+ * when each unit's updates run and what coefficients they use, so the
+ * timer routine, updates taken for a read, a restart and the commands
+ * that change a unit's period or windows all take it, before the unit's
+ * device lock and before SCHED.
  */
 
-#define FIRST_LIKELY_PRIO	47
-#define RT_PRIO_MASK		((1ULL << FIRST_LIKELY_PRIO) - 1)
+typedef struct {
+    SPL		*lock;			/* held while using the rest, */
+					/*   allocated by the first unit */
+    uint64_t	time;			/* exe$gq_systime of the scan, 0 */
+					/*   before the first */
+    uint32_t	proc_count;		/* runnable and running threads */
+    uint32_t	lowest_pri;		/* UINT32_MAX if no CPU ran one */
+    uint32_t	disk_queue_len;		/* UINT32_MAX if the IOC database */
+					/*   was busy */
+    uint32_t	prio_count[64];		/* threads at each priority, in */
+					/*   the order of the averages */
+    uint32_t	class_count[4];		/* by LAX$K_CLASS_xxx */
+    uint32_t	wait_count[3];		/* each page wait queue, in */
+					/*   LAX$K_MEM_xxx order */
+    uint32_t	free_pages;		/* sch$gi_freecnt, clamped */
+    uint32_t	faults;			/* pms$gl_faults */
+    bool	approx;			/* ran out of walk budget */
+    uint32_t	ktbs_walked;		/* KTBs visited */
+    uint32_t	ktbs_estimated;		/* KTBs estimated, not visited */
+    uint32_t	walk_budget;		/* max KTBs to visit per scan */
+    uint32_t	qdepth[3][64];		/* COM, COMO and page wait queue */
+					/*   depths from the last full walk */
+    uint64_t	depth_time;		/* walk them all without a limit */
+					/*   after this, if still approx */
+    uint8_t	walk_set;		/* queue set and bit to start the */
+    uint8_t	walk_bit;		/*   next walk at */
+    bool	disks_overflow;		/* no pool for a longer list */
+    bool	rescan;			/* rebuild the list next scan */
+    uint64_t	rescan_time;		/* and rebuild it after this anyway */
+    uint32_t	disk_gen;		/* changes with every rebuild */
+    uint32_t	ndisks;			/* entries used in the list */
+    uint32_t	max_disks;		/* entries allocated, 0 at first */
+    UCB		**disks;		/* mounted disks to sample, in */
+					/*   one piece of nonpaged pool */
+					/*   with the arrays below */
+    DDB		**disk_ddb;		/* and their DDBs */
+    uint32_t	*disk_qlen;		/* and their queue lengths */
+    char	(*disk_name)[16];	/* and their names */
+    bool	*disk_gone;		/* and whether they've left the */
+					/*   I/O database since the rebuild */
+} LAX_SCAN;
+
+static LAX_SCAN lax_scan = {
+    .walk_budget = LAX_WALK_BUDGET,
+    .rescan = true,
+};
 
 /* Define Device-Dependent Unit Control Block with extensions for LAX device */
 
 typedef struct {
     UCB		ucb$r_ucb;		/* Generic UCB */
     uint32_t	ucb$fx_avgs[9];		/* fixed-point data to return on reads */
+    uint64_t	ucb$q_avgs[9];		/*   and with 32 fraction bits */
+    uint32_t	ucb$fx_prio_avgs[64][3]; /* runnable threads at each priority */
+    uint32_t	ucb$fx_class_avgs[4][3]; /* COM, COMO, page wait and running */
+    LAX_MEMORY	ucb$r_memory;		/* memory pressure averages */
+    uint32_t	ucb$l_faults;		/* pms$gl_faults at the scan the */
+    uint64_t	ucb$q_fault_time;	/*   last update used, and when; */
+					/*   0 before the first */
+    volatile uint32_t ucb$l_seq;	/* update sequence number, odd while */
+					/*   the records are being changed */
     bool	ucb$b_is_stopping;	/* user request to stop pending */
     bool	ucb$b_is_stopped;	/* stats update is currently stopped */
-    TQE		ucb$l_tqe;		/* timer tick (1 Hz) */
+    TQE		ucb$l_tqe;		/* timer tick (1 Hz by default) */
+    uint32_t	ucb$l_period_ms;	/* sampling period */
+    uint64_t	ucb$q_tick_time;	/* exe$gq_systime of the last tick, */
+					/*   0 until the first and after */
+					/*   a restart */
+    uint32_t	ucb$l_idle_s;		/* seconds without reads before */
+					/*   idling, 0 = never */
+    bool	ucb$b_is_idle;		/* ticking at LAX$K_IDLE_PERIOD_MS */
+    uint64_t	ucb$q_read_time;	/* exe$gq_systime of the last read */
+    uint32_t	ucb$l_window_s[3];	/* averaging windows, in seconds */
+    LAX_COEF	ucb$r_coef[3];		/* coefficients for each window */
+					/*   at the sampling period */
+    LAX_COEF64	ucb$r_coef64[3];	/*   and for the 64-bit averages */
+    uint32_t	ucb$l_disk_gen;		/* lax_scan.disk_gen the disk */
+					/*   averages follow */
+    uint32_t	ucb$l_disk_bank;	/* bank in use, 0 or 1 */
+    uint32_t	ucb$l_disk_max;		/* entries in each bank */
+    LAX_DISK_HDR ucb$r_disk_hdr[2];	/* per-disk averages, as returned */
+    LAX_DISK	*ucb$ps_disks[2];	/*   by LAX$K_REC_DISKS reads, in */
+					/*   two banks in one piece of */
+					/*   nonpaged pool, or NULL; a new */
+					/*   disk list fills in the other */
+    LAX_STATUS	ucb$r_status;		/* sampling status of the last tick */
+    uint32_t	ucb$l_sample_seq;	/* sequence number of next sample */
+    LAX_SAMPLE	ucb$r_samples[LAX_SAMPLE_RING]; /* recent raw samples */
+    LAX_PAGE	*ucb$ps_page;		/* published page, or NULL */
+    uint64_t	ucb$q_page_pfn;		/*   and its page frame number */
+    IRP		*ucb$ps_waitq;		/* LAX$K_REC_WAIT reads, linked */
+					/*   through irp$l_ioqfl */
+    LAX_PEAK_Q	*ucb$ps_peakq;		/* [LAX$K_PEAK_xxx][max, min] */
+					/*   queues, or NULL until */
+					/*   LAX$K_CMD_PEAKS */
+    uint32_t	ucb$l_peak_clock;	/* system time in ms of the last */
+					/*   tracked sample */
+    LAX_PEAKS	ucb$r_peaks;		/* results as of the last tick */
+    LAX_PROFILE	ucb$r_profile;		/* the driver's own cost */
 } LAX_UCB;
 
+/* The UCB size is stored in a word in the DPT. */
+
+typedef char lax_ucb_size_check[(sizeof(LAX_UCB) <= 65535) ? 1 : -1];
+
+/* Threshold wait state kept in P4 of a queued LAX$K_REC_WAIT IRP, above
+ * the LAX$M_WAIT_xxx bits a caller can set.
+ */
+
+#define LAX_WAIT_ARMED		0x80000000  /* average was on the near side */
+#define LAX_WAIT_USER_BITS	(LAX$M_WAIT_INDEX | LAX$M_WAIT_BELOW | \
+				 LAX$M_WAIT_LEVEL)
+
+/* Progress of the run queue walk during one tick */
+
+typedef struct {
+    uint32_t	budget;			/* KTBs left to visit, if limited */
+    uint32_t	walked;			/* KTBs visited */
+    uint32_t	estimated;		/* KTBs estimated but not visited */
+    bool	limited;		/* is there a budget at all? */
+    bool	approx;			/* did we run out of budget? */
+    int		set;			/* queue set being walked */
+    int		missed_set;		/* first queue not walked completely, */
+    int		missed_bit;		/*   or -1 if none */
+} LAX_WALK;
+
+/* The processor's cycle counter, for LAX$K_REC_PROFILE: RPCC on Alpha,
+ * whose count is only 32 bits wide, the interval time counter on IA64,
+ * and the time stamp counter on x86-64. Only differences within a tick
+ * are used, and they're taken modulo 2^32.
+ */
+
+#if defined(LAX_HOST)
+#define LAX_CYCLES()		lax_host_cycles()
+#elif defined(__alpha)
+#define LAX_CYCLES()		((uint64_t)__RPCC())
+#elif defined(__ia64)
+#define LAX_CYCLES()		((uint64_t)__getReg(_IA64_REG_AR_ITC))
+#else
+#define LAX_CYCLES()		((uint64_t)__builtin_readcyclecounter())
+#endif
+
+/* What the current tick has cost so far */
+
+typedef struct {
+    uint64_t	start;			/* LAX_CYCLES() on entry */
+    uint32_t	sched;			/* cycles holding SCHED */
+    uint32_t	ktbs;			/* KTBs visited */
+    uint32_t	ucbs;			/* UCBs visited */
+    bool	iodb_busy;		/* couldn't lock the I/O database */
+    uint64_t	interval;		/* time since the last tick, in */
+					/*   100 ns units, 0 if unknown */
+    bool	unscheduled;		/* idle or for a read, so it can't */
+					/*   be late */
+    bool	shared;			/* used another unit's scan */
+} LAX_TICK_PROF;
+
 /* Define const references to the global data we need to reference */
 
 /* System time */
 extern uint64_t	exe$gq_systime;
 
+/* CPU-specific page size in bytes */
+extern uint32_t	mmg$gl_page_size;
+
 /* Bit vectors of which priority queues are active (bit 0 = priority 63) */
 extern uint64_t	sch$gq_comqs;	/* computable queue */
 extern uint64_t	sch$gq_comoqs;	/* computable (outswapped) queue */
@@ -102,11 +425,17 @@ extern KTB* sch$gq_colpgwq;	/* collided page wait queue */
 extern KTB* sch$gq_pfwq;	/* page fault wait queue */
 extern KTB* sch$gq_fpgwq;	/* free page wait queue */
 
-/* TODO: Use CBB functions instead of bitmasks to support > 64 CPUs */
+/* Memory management counters */
+extern int64_t	sch$gi_freecnt;	/* pages on the free list */
+extern uint32_t	pms$gl_faults;	/* page faults since boot */
 
-extern uint32_t	smp$gl_max_cpuid;   /* max CPU ID for bitmasks */
-extern uint64_t	smp$gq_active_set;  /* active CPU set bitmask */
-extern uint64_t	sch$gq_idle_cpus;   /* idle CPU bitmask */
+/* CPU sets as bitmask blocks, which unlike the old smp$gq_active_set and
+ * sch$gq_idle_cpus quadwords cover every possible CPU ID
+ */
+
+extern uint32_t	smp$gl_max_cpuid;	/* highest CPU ID */
+extern CBB	smp$ar_active_set_cbb;	/* active CPU set */
+extern CBB	sch$ar_idle_cpus_cbb;	/* idle CPU set */
 
 extern CPU* smp$gl_cpu_data[];  /* CPU data pointer array */
 
@@ -132,13 +461,80 @@ static int  lax_unit_init (IDB *idb, LAX_UCB *ucb);
 
 static int  lax_read (IRP *irp, PCB *pcb, LAX_UCB *ucb, CCB *ccb);
 
+/* Cancel I/O routine */
+
+static void lax_cancel (int chan, IRP *irp, PCB *pcb, LAX_UCB *ucb, int reason);
+
 /* FDT routine for write functions */
 
 static int  lax_write (IRP *irp, PCB *pcb, LAX_UCB *ucb, CCB *ccb);
 
+/* Queue a LAX$K_REC_WAIT read, or complete it at once */
+
+static int  lax_queue_wait (IRP *irp, PCB *pcb, LAX_UCB *ucb);
+
+/* Decide whether a threshold wait has been satisfied */
+
+static bool lax_wait_done (const LAX_UCB *ucb, IRP *irp);
+
+/* Complete the threshold waits that have been satisfied */
+
+static void lax_check_waits (LAX_UCB *ucb, bool abort);
+
+/* Copy a consistent snapshot of a record to a reader's buffer */
+
+static inline void lax_copy_rec (CHAR_PQ bufp, const void *rec,
+				 uint32_t rec_size, uint32_t buflen);
+static void lax_copy_snapshot (LAX_UCB *ucb, CHAR_PQ bufp, uint32_t buflen,
+			       uint32_t rec_code);
+
+/* Copy raw samples from the ring to a reader's buffer */
+
+static void lax_copy_samples (LAX_UCB *ucb, CHAR_PQ bufp, uint32_t buflen,
+			      uint32_t first_seq);
+
+/* Allocate the page for LAX$K_CMD_PUBLISH */
+
+static int  lax_alloc_page (LAX_UCB *ucb);
+
+/* Copy the current averages to the published page */
+
+static void lax_publish (LAX_UCB *ucb);
+
+/* Allocate the queues for LAX$K_REC_PEAKS, and keep them up to date */
+
+static int  lax_alloc_peaks (uint32_t period_ms, LAX_PEAK_Q **peakq);
+static LAX_PEAK_Q *lax_grow_peaks (LAX_UCB *ucb, LAX_PEAK_Q *peakq);
+static void lax_track_peaks (LAX_UCB *ucb, uint64_t now, uint32_t proc_count,
+			     uint32_t disk_queue_len);
+
+/* Add the cost of a tick to the LAX$K_REC_PROFILE statistics */
+
+static void lax_profile_tick (LAX_UCB *ucb, const LAX_TICK_PROF *prof);
+
+/* Select the sampling period and its coefficients */
+
+static bool lax_set_period (LAX_UCB *ucb, uint32_t period_ms);
+static bool lax_set_windows (LAX_UCB *ucb, const uint32_t window_s[3]);
+static void lax_compute_coef (uint32_t period_ms, uint32_t window_s,
+			      LAX_COEF *coef, LAX_COEF64 *coef64);
+static bool lax_elapsed_coef (uint64_t interval, uint32_t period_ms,
+			      const uint32_t window_s[3], LAX_COEF coef[3],
+			      LAX_COEF64 coef64[3]);
+
+/* Count the CPUs running threads, and find their lowest priority */
+
+static uint32_t lax_scan_cpus (uint32_t *lowest_pri, uint32_t prio_count[64]);
+static void lax_take_scan (LAX_SCAN *scan, uint64_t now, LAX_TICK_PROF *prof);
+static void lax_remap_disks (LAX_UCB *ucb, const LAX_SCAN *scan);
+static void lax_queue_tick (LAX_UCB *ucb);
+
 /* Periodic load averages update via timer queue entry */
 
 static void lax_stats_update_int (void *fr3, LAX_UCB *ucb, TQE *tqe);
+static void lax_sample_on_demand (LAX_UCB *ucb);
+static void lax_update (LAX_UCB *ucb, bool on_demand);
+static void lax_check_idle (LAX_UCB *ucb, uint64_t now);
 
 /*
  * DRIVER$INIT_TABLES - Initialize Driver Tables
@@ -204,7 +600,7 @@ int driver$init_tables (void)  {
     ini_dpt_name        (&driver$dpt, "LAXDRIVER");
     ini_dpt_adapt       (&driver$dpt, AT$_NULL); /* software adapter */
     ini_dpt_defunits    (&driver$dpt, 1);
-    ini_dpt_maxunits    (&driver$dpt, 1);
+    ini_dpt_maxunits    (&driver$dpt, LAX_MAX_UNITS);
     ini_dpt_ucbsize     (&driver$dpt, sizeof(LAX_UCB));
     ini_dpt_struc_init  (&driver$dpt, lax_struc_init );
     ini_dpt_struc_reinit(&driver$dpt, lax_struc_reinit );
@@ -213,7 +609,7 @@ int driver$init_tables (void)  {
     /* Finish initialization of the Driver Dispatch Table (DDT) */
 
     ini_ddt_unitinit    (&driver$ddt, lax_unit_init);
-    ini_ddt_cancel      (&driver$ddt, ioc_std$cancelio);
+    ini_ddt_cancel      (&driver$ddt, lax_cancel);
     ini_ddt_end         (&driver$ddt);
 
     /* Finish initialization of the Function Decision Table (FDT)   */
@@ -312,14 +708,23 @@ static void lax_struc_init (CRB *crb, DDB *ddb, IDB *idb, ORB *orb, LAX_UCB *ucb
     /* ucb->ucb$r_ucb.ucb$b_devtype = LP$_LP11; */  /* we have no device type */
     ucb->ucb$r_ucb.ucb$w_devbufsiz = sizeof(ucb->ucb$fx_avgs);   /* 36 byte buffer */
 
-    /* set up our 1 Hz TQE */
+    /* set up our TQE, firing once per sampling period (1 Hz by default);
+     * each tick queues the next, so they stay in step with other units'
+     */
     ucb->ucb$l_tqe.tqe$w_size = TQE$C_LENGTH;
     ucb->ucb$l_tqe.tqe$b_type = DYN$C_TQE;
-    ucb->ucb$l_tqe.tqe$b_rqtype = TQE$C_SSREPT;
+    ucb->ucb$l_tqe.tqe$b_rqtype = TQE$C_SSSNGL;
     ucb->ucb$l_tqe.tqe$q_fr3 = 0;
     ucb->ucb$l_tqe.tqe$q_fr4 = (__int64) ucb;
-    ucb->ucb$l_tqe.tqe$l_fpc = (int) lax_stats_update_int;
-    ucb->ucb$l_tqe.tqe$q_delta = 10000000;  /* VMS time uses 100 ns units */
+    ucb->ucb$l_tqe.tqe$l_fpc = (void (*)()) lax_stats_update_int;
+
+    /* the standard 1, 5 and 15 minute windows, then the period, which
+     * also sets tqe$q_delta
+     */
+    memcpy(ucb->ucb$l_window_s, lax_coef_window_s, sizeof(ucb->ucb$l_window_s));
+    if (!lax_set_period(ucb, LAX_PERIOD_MS)) {
+	lax_set_period(ucb, 1000);
+    }
 }
 
 
@@ -442,21 +847,60 @@ static int lax_unit_init (IDB *idb, LAX_UCB *ucb)  {
     /* Clear the stats array and priority mask. */
 
     memset(&(ucb->ucb$fx_avgs), 0, sizeof(ucb->ucb$fx_avgs));
+    memset(&(ucb->ucb$q_avgs), 0, sizeof(ucb->ucb$q_avgs));
+    memset(&(ucb->ucb$fx_prio_avgs), 0, sizeof(ucb->ucb$fx_prio_avgs));
+    memset(&(ucb->ucb$fx_class_avgs), 0, sizeof(ucb->ucb$fx_class_avgs));
+    memset(&(ucb->ucb$r_memory), 0, sizeof(ucb->ucb$r_memory));
+    ucb->ucb$q_fault_time = 0;
+    memset(&(ucb->ucb$r_status), 0, sizeof(ucb->ucb$r_status));
+    ucb->ucb$l_seq = 0;
+    ucb->ucb$q_tick_time = 0;
+    ucb->ucb$l_idle_s = 0;		/* until LAX$K_CMD_IDLE */
+    ucb->ucb$b_is_idle = false;
+    ucb->ucb$q_read_time = exe$gq_systime;
+    ucb->ucb$l_disk_gen = 0;		/* follow the list on the first tick */
+    ucb->ucb$l_disk_bank = 0;
+    ucb->ucb$l_disk_max = 0;		/* until there's a disk list */
+    memset(&(ucb->ucb$r_disk_hdr), 0, sizeof(ucb->ucb$r_disk_hdr));
+    ucb->ucb$ps_disks[0] = ucb->ucb$ps_disks[1] = NULL;
+    memset(&(ucb->ucb$r_samples), 0, sizeof(ucb->ucb$r_samples));
+    ucb->ucb$l_sample_seq = 1;
+    ucb->ucb$ps_page = NULL;		/* until LAX$K_CMD_PUBLISH */
+    ucb->ucb$q_page_pfn = 0;
+    ucb->ucb$ps_waitq = NULL;
+    ucb->ucb$ps_peakq = NULL;		/* until LAX$K_CMD_PEAKS */
+    ucb->ucb$l_peak_clock = 0;
+    memset(&(ucb->ucb$r_peaks), 0, sizeof(ucb->ucb$r_peaks));
+    memset(&(ucb->ucb$r_profile), 0, sizeof(ucb->ucb$r_profile));
+    for (int i = 0; i < LAX$K_PROF_COUNT; i++) {
+	ucb->ucb$r_profile.lax$r_stat[i].lax$l_min = UINT32_MAX;
+    }
     ucb->ucb$b_is_stopping = false;
     ucb->ucb$b_is_stopped = false;
 
-    /* This driver can service only a single unit per DDB and IDB.  Thus,
-     * make the single unit the permanent owner of the IDB.  This facilitates
+    /* The first unit allocates the shared scan's lock, with the IPL and
+     * rank of IOLOCK8, so it's taken before the device lock and SCHED, but
+     * not shared with other drivers' fork processing.
+     */
+    if (lax_scan.lock == NULL) {
+	int status = smp_std$alloc_spl(&(lax_scan.lock), IPL$_IOLOCK8,
+				       SPL$C_IOLOCK8);
+	if (!$VMS_STATUS_SUCCESS(status)) {
+	    return status;
+	}
+    }
+
+    /* Make the first unit the permanent owner of the IDB.  This facilitates
      * getting the UCB address in our interrupt service routine.
      * We don't have an ISR, but if we did, that might be useful.
+     * Later units connected to the same IDB leave it alone.
      */
-    idb->idb$ps_owner = &(ucb->ucb$r_ucb); 
+    if (idb->idb$ps_owner == NULL) {
+	idb->idb$ps_owner = &(ucb->ucb$r_ucb);
+    }
 
     /* Start the timer */
-    uint64_t tick_time = exe$gq_systime + ucb->ucb$l_tqe.tqe$q_delta;
-    exe_std$instimq((int) (tick_time & 0xffffffff),
-		    (int) ((tick_time >> 32) & 0xffffffff),
-		    (TQE *) &ucb->ucb$l_tqe);
+    lax_queue_tick(ucb);
 
     /* Mark the device as online and ready to accept I/O requests */
     ucb->ucb$r_ucb.ucb$v_online = 1;
@@ -471,6 +915,9 @@ static int lax_unit_init (IDB *idb, LAX_UCB *ucb)  {
  * Functional description:
  *
  *   Verifies the read arguments, then copies as much data as requested.
+ *   The $QIO P3 parameter selects the record to return: LAX$K_REC_AVGS (0)
+ *   for the classic load averages, or one of the extended records defined
+ *   in laxdef.h.
  *
  *   Since this is an upper-level FDT routine, this routine always returns
  *   the SS$_FDT_COMPL status.  The $QIO status that is to be returned to
@@ -511,14 +958,79 @@ static int lax_read (IRP *irp, PCB *pcb, LAX_UCB *ucb, CCB *ccb) {
      */
     CHAR_PQ qio_bufp = (CHAR_PQ)irp->irp$q_qio_p1;
 
+    /* Find the size of the record selected by P3, or return SS$_BADPARAM. */
+    uint32_t rec_size;
+
+    switch (irp->irp$l_qio_p3) {
+    case LAX$K_REC_AVGS:
+	rec_size = sizeof(ucb->ucb$fx_avgs) + sizeof(uint32_t);
+	break;
+
+    case LAX$K_REC_STATUS:
+	rec_size = sizeof(LAX_STATUS);
+	break;
+
+    case LAX$K_REC_PRIO:
+	rec_size = sizeof(LAX_PRIO);
+	break;
+
+    case LAX$K_REC_CLASSES:
+	rec_size = sizeof(LAX_CLASSES);
+	break;
+
+    case LAX$K_REC_MEMORY:
+	rec_size = sizeof(LAX_MEMORY);
+	break;
+
+    case LAX$K_REC_AVGS64:
+	rec_size = sizeof(LAX_AVGS64);
+	break;
+
+    case LAX$K_REC_PROFILE:
+	rec_size = sizeof(LAX_PROFILE);
+	break;
+
+    case LAX$K_REC_PEAKS:
+	/* only once a privileged write has started tracking them */
+	if (ucb->ucb$ps_peakq == NULL) {
+	    return ( call_abortio (irp, pcb, (UCB *)ucb, SS$_DEVINACT) );
+	}
+	rec_size = sizeof(LAX_PEAKS);
+	break;
+
+    case LAX$K_REC_DISKS:
+	if (irp->irp$l_qio_p2 < sizeof(LAX_DISK_HDR)) {
+	    return ( call_abortio (irp, pcb, (UCB *)ucb, SS$_BADPARAM) );
+	}
+	rec_size = irp->irp$l_qio_p2;	    /* whole entries only, see below */
+	break;
+
+    case LAX$K_REC_PAGE:
+	rec_size = sizeof(LAX_PAGE_INFO);
+	break;
+
+    case LAX$K_REC_WAIT:
+	return ( lax_queue_wait (irp, pcb, ucb) );
+
+    case LAX$K_REC_SAMPLES:
+	if (irp->irp$l_qio_p2 < sizeof(LAX_SAMPLE_HDR)) {
+	    return ( call_abortio (irp, pcb, (UCB *)ucb, SS$_BADPARAM) );
+	}
+	rec_size = irp->irp$l_qio_p2;
+	break;
+
+    default:
+	return ( call_abortio (irp, pcb, (UCB *)ucb, SS$_BADPARAM) );
+    }
+
     /* Return an SS$_BADPARAM error if the read size is too small. */
     if (irp->irp$l_qio_p2 < sizeof(uint32_t)) {
 	return ( call_abortio (irp, pcb, (UCB *)ucb, SS$_BADPARAM) );
     }
 
-    /* Truncate the read size to 36 bytes if needed. */
-    if (irp->irp$l_qio_p2 > sizeof(ucb->ucb$fx_avgs)) {
-	irp->irp$l_qio_p2 = sizeof(ucb->ucb$fx_avgs);
+    /* Truncate the read size to the record size (40 bytes) if needed. */
+    if (irp->irp$l_qio_p2 > rec_size) {
+	irp->irp$l_qio_p2 = rec_size;
     }
 
     int qio_buflen = irp->irp$l_qio_p2;
@@ -533,40 +1045,61 @@ static int lax_read (IRP *irp, PCB *pcb, LAX_UCB *ucb, CCB *ccb) {
                                       qio_bufp, qio_buflen);
         if ( ! $VMS_STATUS_SUCCESS(status) ) return status;
 
-	memcpy( qio_bufp, &(ucb->ucb$fx_avgs), qio_buflen );
+	/* someone is looking, so bring the values up to date first if the
+	 * timer has slowed down for want of readers
+	 */
+	ucb->ucb$q_read_time = exe$gq_systime;
+	if (ucb->ucb$b_is_idle) {
+	    lax_sample_on_demand(ucb);
+	}
+
+	switch (irp->irp$l_qio_p3) {
+	case LAX$K_REC_SAMPLES:
+	    lax_copy_samples(ucb, qio_bufp, qio_buflen, irp->irp$l_qio_p4);
+	    break;
+
+	case LAX$K_REC_PAGE: {
+	    LAX_PAGE_INFO page_info = { 0 };
+
+	    if (ucb->ucb$ps_page != NULL) {
+		page_info.lax$q_pfn = ucb->ucb$q_page_pfn;
+		page_info.lax$l_page_size = mmg$gl_page_size;
+	    }
+	    lax_copy_rec(qio_bufp, &page_info, sizeof(page_info), qio_buflen);
+	    break;
+	}
+
+	default:
+	    lax_copy_snapshot(ucb, qio_bufp, qio_buflen, irp->irp$l_qio_p3);
+	    break;
+	}
     }
 
     return ( call_finishio (irp, (UCB *)ucb, SS$_NORMAL, 0) );
 }
 
 /*
- * LAX_WRITE - FDT Routine for Write Function Codes 
+ * LAX_QUEUE_WAIT - Queue a threshold wait
  *
  * Functional description:
  *
- *   The original LAVDRIVER behavior for writes is to update a mask to
- *   disable specific priorities from being counted. I suspect nobody has
- *   ever used that feature. So this version repurposes writes to set
- *   a single boolean flag to 1 to stop the load average update timer
- *   callback (e.g. for benchmarking), or to 0 to restart the load average
- *   service. Additional bits/bytes are ignored and should be set to zero.
+ *   Checks the LAX$K_REC_WAIT arguments in P4 to P6, and either completes
+ *   the read at once, if LAX$M_WAIT_LEVEL was given and the average is
+ *   already past the threshold, or adds it to the UCB's wait queue for
+ *   the timer routine to complete later.
  *
- *   Since this is an upper-level FDT routine, this routine always returns
- *   the SS$_FDT_COMPL status.  The $QIO status that is to be returned to
- *   the caller of the $QIO system service is returned indirectly by the
- *   FDT completion routines (e. g. exe_std$abortio, exe_std$qiodrvpkt) via
- *   the FDT context structure.
+ *   The read is queued under the device lock, so the timer routine sees
+ *   it with the state it was armed with against the current averages.
  *
  * Calling convention:
  *
- *   status = lax_write (irp, pcb, ucb, ccb)
+ *   status = lax_queue_wait (irp, pcb, ucb)
  *
  * Input parameters:
  *
  *   irp        Pointer to I/O request packet
  *   pcb        Pointer process control block
  *   ucb        Pointer to unit control block
- *   ccb        Pointer to channel control block
  *
  * Output parameters:
  *
@@ -581,99 +1114,125 @@ static int lax_read (IRP *irp, PCB *pcb, LAX_UCB *ucb, CCB *ccb) {
  *   Kernel mode, user process context, IPL 2.
  */
 
-static int lax_write (IRP *irp, PCB *pcb, LAX_UCB *ucb, CCB *ccb) {
+static int lax_queue_wait (IRP *irp, PCB *pcb, LAX_UCB *ucb) {
+    const uint32_t flags = irp->irp$l_qio_p4;
 
-    /* Check if the caller has the required CMKRNL privilege. */
-    if ((pcb->pcb$q_priv & PRV$M_CMKRNL) == 0)
-        return ( call_abortio (irp, pcb, (UCB *)ucb, SS$_NOPRIV) );
+    if ((flags & ~LAX_WAIT_USER_BITS) != 0 ||
+	    (flags & LAX$M_WAIT_INDEX) >= 9) {
+	return ( call_abortio (irp, pcb, (UCB *)ucb, SS$_BADPARAM) );
+    }
 
-    /* Get the pointer to the caller's buffer and the size of the caller's
-     * buffer from the $QIO P1 and P2 parameters respectively.  The caller's
-     * buffer is treated as a 64-bit address although it may be a 32-bit 
-     * address.
-     */
-    CHAR_PQ qio_bufp = (CHAR_PQ)irp->irp$q_qio_p1;
-    int qio_buflen = irp->irp$l_qio_p2;
+    int orig_ipl;
+    device_lock (ucb->ucb$r_ucb.ucb$l_dlck, RAISE_IPL, &orig_ipl);
 
-    /* Return an SS$_BADPARAM error if the write size is too small. */
-    if (qio_buflen < sizeof(bool)) {
-	return ( call_abortio (irp, pcb, (UCB *)ucb, SS$_BADPARAM) );
+    if (ucb->ucb$b_is_stopped || ucb->ucb$b_is_stopping) {
+	device_unlock (ucb->ucb$r_ucb.ucb$l_dlck, orig_ipl, SMP_RESTORE);
+	return ( call_abortio (irp, pcb, (UCB *)ucb, SS$_DEVOFFLINE) );
     }
 
-    /* Assure that the caller has read access to this buffer to do a write
-     * operation.  If not, exe_std$writechk will abort the I/O request and
-     * return the SS$_FDT_COMPL warning status.  If this is the case, we must
-     * return back to the FDT dispatcher in the $QIO system service.
+    /* The wait is armed at once if the average is short of the threshold.
+     * If it's already past, it has to fall back by the hysteresis first.
      */
-    if (qio_buflen != 0) {
-        int status = exe_std$writechk (irp, pcb, &(ucb->ucb$r_ucb), 
-                                   qio_bufp, qio_buflen);
-        if ( ! $VMS_STATUS_SUCCESS(status) ) return status;
+    irp->irp$l_qio_p4 = flags | LAX_WAIT_ARMED;
+    const bool past = lax_wait_done(ucb, irp);
+    if (past) {
+	irp->irp$l_qio_p4 = flags;
+    }
 
-	/* True = stop updating; false = start updating */
-	bool stop_request = (bool)(*qio_bufp);
+    const bool now = (past && (flags & LAX$M_WAIT_LEVEL));
+    const uint32_t value = ucb->ucb$fx_avgs[flags & LAX$M_WAIT_INDEX];
 
-	if (stop_request && !(ucb->ucb$b_is_stopped)) {
-	    /* it's okay if this is already set */
-	    ucb->ucb$b_is_stopping = true;
-	} else if (!stop_request && ucb->ucb$b_is_stopped) {
-	    /* Note: ucb$b_is_stopping should already be false */
-	    ucb->ucb$b_is_stopped = false;
-
-	    /* Restart the timer */
-	    ucb->ucb$l_tqe.tqe$b_rqtype = TQE$C_SSREPT;
-	    uint64_t tick_time = exe$gq_systime + ucb->ucb$l_tqe.tqe$q_delta;
-	    exe_std$instimq((int) (tick_time & 0xffffffff),
-			    (int) ((tick_time >> 32) & 0xffffffff),
-			    (TQE *) &ucb->ucb$l_tqe);
- 	}
+    if (!now) {
+	irp->irp$l_ioqfl = ucb->ucb$ps_waitq;
+	ucb->ucb$ps_waitq = irp;
     }
 
-    return ( call_finishio (irp, (UCB *)ucb, SS$_NORMAL, 0) );
+    device_unlock (ucb->ucb$r_ucb.ucb$l_dlck, orig_ipl, SMP_RESTORE);
+
+    if (now) {
+	return ( call_finishio (irp, (UCB *)ucb, SS$_NORMAL, value) );
+    }
+
+    /* the timer routine or the cancel routine will complete it */
+    return ( call_qioreturn (irp) );
 }
 
-/* Define some constants for the load averaging multiplication factors.
- * I used Python to compute the exponential decays for fixed-point math.
- * The multipliers for the new values have an extra 8 bits of fraction.
- * This is subtracted from the 14 bits that the integers are shifted,
- * so that the old and new coefficients will both have 24 fraction bits.
+/*
+ * LAX_WAIT_DONE - Check a threshold wait against the current averages
+ *
+ * Functional description:
+ *
+ *   Returns true if the average the wait is watching has reached its
+ *   threshold while the wait was armed. Otherwise, arms the wait if the
+ *   average is on the near side of the threshold by more than the
+ *   hysteresis, and returns false.
+ *
+ * Calling convention:
+ *
+ *   done = lax_wait_done (ucb, irp)
+ *
+ * Input parameters:
+ *
+ *   ucb        Pointer to unit control block
+ *   irp        LAX$K_REC_WAIT IRP, with the index and flags in P4, the
+ *              threshold in P5 and the hysteresis in P6
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   done       true if the wait should be completed
+ *
+ * Environment:
+ * 
+ *   Kernel mode, device lock held.
  */
 
-/* old: 1/exp(1s/60s) * (1<<24) */
-/* new: (1 - 1/exp(1s/60s)) * (1<<32) */
-static const uint32_t old_lav_1min = 16499913;
-static const uint32_t new_lav_1min = 70989565;
-
-/* old: 1/exp(1s/300s) * (1<<24) */
-/* new: (1 - 1/exp(1s/300s)) * (1<<32) */
-static const uint32_t old_lav_5min = 16721385;
-static const uint32_t new_lav_5min = 14292723;
+static bool lax_wait_done (const LAX_UCB *ucb, IRP *irp) {
+    const uint32_t flags = irp->irp$l_qio_p4;
+    const uint32_t value = ucb->ucb$fx_avgs[flags & LAX$M_WAIT_INDEX];
+    const uint32_t threshold = irp->irp$l_qio_p5;
+    const uint32_t hysteresis = irp->irp$l_qio_p6;
+    bool past, near;
+
+    /* compare in 64 bits, so threshold +/- hysteresis can't wrap */
+    if (flags & LAX$M_WAIT_BELOW) {
+	past = (value <= threshold);
+	near = ((uint64_t)value > (uint64_t)threshold + hysteresis);
+    } else {
+	past = (value >= threshold);
+	near = ((uint64_t)value + hysteresis < (uint64_t)threshold);
+    }
 
-/* old: 1/exp(1s/900s) * (1<<24) */
-/* new: (1 - 1/exp(1s/900s)) * (1<<32) */
-static const uint32_t old_lav_15min = 16758585;
-static const uint32_t new_lav_15min = 4769536;
+    if (flags & LAX_WAIT_ARMED) {
+	return past;
+    }
+    if (near) {
+	irp->irp$l_qio_p4 = flags | LAX_WAIT_ARMED;
+    }
+    return false;
+}
 
 /*
- * LAX_STATS_UPDATE_INT - Periodic update of load averages
+ * LAX_CHECK_WAITS - Complete satisfied threshold waits
  *
  * Functional description:
  *
- *   This routine performs a once-a-second update of the load average data.
- *   The algorithm is the same as the original LAXDRIVER, except that the
- *   system load average is not divided by the number of active CPUs, and
- *   the values are all returned as 32-bit unsigned integers representing
- *   fixed-point values with a binary scaling factor of 14 bits.
+ *   Called by the timer routine after each update, to complete each queued
+ *   LAX$K_REC_WAIT read whose average has crossed its threshold, with the
+ *   value of that average in the second IOSB longword. When updates are
+ *   being stopped, every queued wait is completed with SS$_ABORT instead.
  *
  * Calling convention:
  *
- *   lax_stats_update_int (fr3, ucb, tqe)
+ *   lax_check_waits (ucb, abort)
  *
  * Input parameters:
  *
- *   fr3	Unused
  *   ucb        Pointer to unit control block
- *   tqe        Pointer to TQE used to time request
+ *   abort      true to complete all waits with SS$_ABORT
  *
  * Output parameters:
  *
@@ -685,79 +1244,2085 @@ static const uint32_t new_lav_15min = 4769536;
  *
  * Environment:
  * 
- *   Kernel mode, system context, at timer IPL.
+ *   Kernel mode, system context, device lock held.
  */
 
-static void lax_stats_update_int (void *fr3, LAX_UCB *ucb, TQE *tqe) {
-    /* acquire the SCHED spinlock, so we can count runnable processes. */
-    int orig_ipl;
-    sys_lock (SCHED, RAISE_IPL, &orig_ipl);
-
-    uint32_t proc_count = 0;
+static void lax_check_waits (LAX_UCB *ucb, bool abort) {
+    IRP **link = &(ucb->ucb$ps_waitq);
 
-    /* Traverse COM and COMO queues for each priority that's in use. */
+    while (*link != NULL) {
+	IRP *irp = *link;
 
-    if (sch$gq_comqs) {
-	bool has_realtime = (sch$gq_comqs & RT_PRIO_MASK);
-	int startbit = has_realtime ? 0 : FIRST_LIKELY_PRIO;
-	uint64_t testmask = (1ULL << startbit);
-
-	for (int idx = startbit; idx < 64; idx++, testmask <<= 1) {
-	    if (sch$gq_comqs & testmask) {
-		KTB* head = sch$aq_comh[idx << 1];
-		KTB* ktb = head;
-		while ((ktb = ktb->ktb$l_sqfl) != head) {
-		    proc_count++;
-		}
-	    }
+	if (!abort && !lax_wait_done(ucb, irp)) {
+	    link = &(irp->irp$l_ioqfl);
+	    continue;
 	}
-    }
-
-    /* now do the COMO queue */
-
-    if (sch$gq_comoqs) {
-	bool has_realtime = (sch$gq_comoqs & RT_PRIO_MASK);
-	int startbit = has_realtime ? 0 : FIRST_LIKELY_PRIO;
-	uint64_t testmask = (1ULL << startbit);
 
-	for (int idx = startbit; idx < 64; idx++, testmask <<= 1) {
-	    if (sch$gq_comoqs & testmask) {
-		KTB* head = sch$aq_comoh[idx << 1];
-		KTB* ktb = head;
-		while ((ktb = ktb->ktb$l_sqfl) != head) {
-		    proc_count++;
-		}
-	    }
-	}
+	*link = irp->irp$l_ioqfl;
+	irp->irp$l_iost1 = abort ? SS$_ABORT : SS$_NORMAL;
+	irp->irp$l_iost2 = ucb->ucb$fx_avgs[irp->irp$l_qio_p4 & LAX$M_WAIT_INDEX];
+	com_std$post(irp, (UCB *)ucb);
     }
+}
 
-    /* add processes from the three page-fault-related wait queues */
+/*
+ * LAX_COPY_REC - Copy a record, or as much of it as fits, to a reader
+ *
+ *   lax_read has already cut the length down to the record's size, but the
+ *   copy is bounded here too, where the compiler can see it.
+ */
 
-    KTB* ktb = sch$gq_colpgwq;
-    while ((ktb = ktb->ktb$l_sqfl) != sch$gq_colpgwq) {
-	proc_count++;
-    }
+static inline void lax_copy_rec (CHAR_PQ bufp, const void *rec,
+				 uint32_t rec_size, uint32_t buflen) {
+    memcpy(bufp, rec, (buflen < rec_size) ? buflen : rec_size);
+}
+
+/*
+ * LAX_COPY_SNAPSHOT - Copy a consistent snapshot of a record
+ *
+ * Functional description:
+ *
+ *   Copies the load averages, status, per-disk, priority or thread class
+ *   record selected by rec_code to the caller's buffer, then stores the
+ *   update sequence number in the record if the buffer has room for it.
+ *
+ *   The timer routine makes ucb$l_seq odd before it changes any of these
+ *   records and even again when it's done, so a copy is retried until it
+ *   started with an even sequence number that was still the same at the
+ *   end. Readers never take the device lock, so any number of them can
+ *   poll without slowing the timer routine or each other down.
+ *
+ *   Only whole entries of the per-disk record are returned, and its count
+ *   is set to the number copied.
+ *
+ * Calling convention:
+ *
+ *   lax_copy_snapshot (ucb, bufp, buflen, rec_code)
+ *
+ * Input parameters:
+ *
+ *   ucb        Pointer to unit control block
+ *   bufp       Caller's buffer, already checked for write access
+ *   buflen     Size of the caller's buffer, no larger than the record
+ *   rec_code   LAX$K_REC_AVGS, LAX$K_REC_AVGS64, LAX$K_REC_STATUS,
+ *              LAX$K_REC_DISKS, LAX$K_REC_PRIO, LAX$K_REC_CLASSES,
+ *              LAX$K_REC_MEMORY, LAX$K_REC_PEAKS or LAX$K_REC_PROFILE
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   None.
+ *
+ * Environment:
+ * 
+ *   Kernel mode, user process context, IPL 2.
+ */
+
+static void lax_copy_snapshot (LAX_UCB *ucb, CHAR_PQ bufp, uint32_t buflen,
+			       uint32_t rec_code) {
+    uint32_t seq;
+    uint32_t seq_offset = buflen;	/* where the record has it, if it does */
+    uint32_t disk_count = 0;
+
+    do {
+	seq = ucb->ucb$l_seq;
+	__MB();		/* read the record after the sequence number */
+
+	switch (rec_code) {
+	case LAX$K_REC_AVGS:
+	    seq_offset = sizeof(ucb->ucb$fx_avgs);
+	    memcpy(bufp, ucb->ucb$fx_avgs,
+		   (buflen < seq_offset) ? buflen : seq_offset);
+	    break;
+
+	case LAX$K_REC_STATUS:
+	    seq_offset = offsetof(LAX_STATUS, lax$l_seq);
+	    lax_copy_rec(bufp, &(ucb->ucb$r_status), sizeof(LAX_STATUS), buflen);
+	    break;
+
+	case LAX$K_REC_PEAKS:
+	    seq_offset = offsetof(LAX_PEAKS, lax$l_seq);
+	    lax_copy_rec(bufp, &(ucb->ucb$r_peaks), sizeof(LAX_PEAKS), buflen);
+	    break;
+
+	case LAX$K_REC_PROFILE:
+	    seq_offset = offsetof(LAX_PROFILE, lax$l_seq);
+	    lax_copy_rec(bufp, &(ucb->ucb$r_profile), sizeof(LAX_PROFILE),
+			 buflen);
+	    break;
+
+	case LAX$K_REC_MEMORY:
+	    seq_offset = offsetof(LAX_MEMORY, lax$l_seq);
+	    lax_copy_rec(bufp, &(ucb->ucb$r_memory), sizeof(LAX_MEMORY), buflen);
+	    break;
+
+	case LAX$K_REC_PRIO: {
+	    const uint32_t avgs_offset = offsetof(LAX_PRIO, lax$fx_avgs);
+	    const uint32_t reserved = 0;
+
+	    seq_offset = offsetof(LAX_PRIO, lax$l_seq);
+	    if (buflen >= avgs_offset) {
+		memcpy(bufp + offsetof(LAX_PRIO, lax$l_reserved), &reserved,
+		       sizeof(reserved));
+	    }
+	    if (buflen > avgs_offset) {
+		memcpy(bufp + avgs_offset, ucb->ucb$fx_prio_avgs,
+		       buflen - avgs_offset);
+	    }
+	    break;
+	}
+
+	case LAX$K_REC_AVGS64: {
+	    LAX_AVGS64 avgs64;
+
+	    avgs64.lax$w_version = LAX$K_AVGS64_VERSION;
+	    avgs64.lax$w_size = sizeof(avgs64);
+	    avgs64.lax$l_seq = 0;	/* filled in below */
+	    avgs64.lax$l_flags = ucb->ucb$r_status.lax$l_flags;
+	    avgs64.lax$l_period_ms = ucb->ucb$r_status.lax$l_period_ms;
+	    avgs64.lax$q_time = ucb->ucb$q_tick_time;
+	    memcpy(avgs64.lax$q_avgs, ucb->ucb$q_avgs, sizeof(avgs64.lax$q_avgs));
+
+	    seq_offset = offsetof(LAX_AVGS64, lax$l_seq);
+	    lax_copy_rec(bufp, &avgs64, sizeof(avgs64), buflen);
+	    break;
+	}
+
+	case LAX$K_REC_CLASSES: {
+	    const uint32_t avgs_offset = offsetof(LAX_CLASSES, lax$fx_avgs);
+	    const uint32_t reserved = 0;
+
+	    seq_offset = offsetof(LAX_CLASSES, lax$l_seq);
+	    if (buflen >= avgs_offset) {
+		memcpy(bufp + offsetof(LAX_CLASSES, lax$l_reserved), &reserved,
+		       sizeof(reserved));
+	    }
+	    if (buflen > avgs_offset) {
+		memcpy(bufp + avgs_offset, ucb->ucb$fx_class_avgs,
+		       buflen - avgs_offset);
+	    }
+	    break;
+	}
+
+	case LAX$K_REC_DISKS: {
+	    const uint32_t bank = ucb->ucb$l_disk_bank;
+	    const LAX_DISK_HDR *hdr = &(ucb->ucb$r_disk_hdr[bank]);
+
+	    disk_count = (buflen - sizeof(LAX_DISK_HDR)) / sizeof(LAX_DISK);
+	    if (disk_count > hdr->lax$l_count) {
+		disk_count = hdr->lax$l_count;
+	    }
+
+	    /* a bank that holds this many disks is in place before its
+	     * count is set, though it may have been given back to pool
+	     * since, in which case the update has the copy retried
+	     */
+	    __MB();
+	    const LAX_DISK *disks = ucb->ucb$ps_disks[bank];
+
+	    seq_offset = offsetof(LAX_DISK_HDR, lax$l_seq);
+	    memcpy(bufp, hdr, sizeof(LAX_DISK_HDR));
+	    if (disk_count != 0) {
+		memcpy(bufp + sizeof(LAX_DISK_HDR), disks,
+		       disk_count * sizeof(LAX_DISK));
+	    }
+	    break;
+	}
+	}
+
+	__MB();		/* and check it again after the copy */
+    } while ((seq & 1) || seq != ucb->ucb$l_seq);
+
+    /* the disk list may have been truncated to fit */
+    if (rec_code == LAX$K_REC_DISKS) {
+	memcpy(bufp + offsetof(LAX_DISK_HDR, lax$l_count), &disk_count,
+	       sizeof(disk_count));
+    }
+
+    if (buflen >= seq_offset + sizeof(seq)) {
+	memcpy(bufp + seq_offset, &seq, sizeof(seq));
+    }
+}
+
+/*
+ * LAX_COPY_SAMPLES - Copy raw samples to a reader's buffer
+ *
+ * Functional description:
+ *
+ *   Copies consecutive samples from the ring, starting with first_seq or
+ *   the oldest sample still held, into the caller's buffer after a
+ *   LAX_SAMPLE_HDR, and fills in the header.
+ *
+ *   The device lock can't be held while touching a user buffer, so each
+ *   sample's sequence number is checked before and after it is copied.
+ *   The timer routine invalidates a slot before rewriting it, so a sample
+ *   that was overwritten during the copy ends the list instead of being
+ *   returned half old and half new.
+ *
+ * Calling convention:
+ *
+ *   lax_copy_samples (ucb, bufp, buflen, first_seq)
+ *
+ * Input parameters:
+ *
+ *   ucb        Pointer to unit control block
+ *   bufp       Caller's buffer, already checked for write access
+ *   buflen     Size of the caller's buffer, at least a LAX_SAMPLE_HDR
+ *   first_seq  First sequence number wanted, or 0 for the oldest
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   None.
+ *
+ * Environment:
+ * 
+ *   Kernel mode, user process context, IPL 2.
+ */
+
+static void lax_copy_samples (LAX_UCB *ucb, CHAR_PQ bufp, uint32_t buflen,
+			      uint32_t first_seq) {
+    LAX_SAMPLE_HDR hdr;
+    const uint32_t max_count = (buflen - sizeof(hdr)) / sizeof(LAX_SAMPLE);
+    const uint32_t next_seq = ucb->ucb$l_sample_seq;
+
+    __MB();		/* read the samples after the sequence number */
+
+    /* Sequence numbers start at 1 and skip 0 when they wrap, so the ring
+     * is full once next_seq has gone past LAX_SAMPLE_RING.
+     */
+    const uint32_t held = (next_seq - 1 < LAX_SAMPLE_RING) ?
+			  next_seq - 1 : LAX_SAMPLE_RING;
+    const uint32_t oldest = next_seq - held;
+
+    /* compare distances back from next_seq, so wrapping doesn't matter */
+    hdr.lax$l_lost = 0;
+    if (first_seq == 0 || (next_seq - first_seq) > held) {
+	if (first_seq != 0 && (next_seq - first_seq) < 0x80000000) {
+	    hdr.lax$l_lost = oldest - first_seq;    /* asked for too old */
+	}
+	first_seq = oldest;
+    }
+
+    uint32_t count = 0;
+    uint32_t seq = first_seq;
+    CHAR_PQ outp = bufp + sizeof(hdr);
+
+    while (count < max_count && seq != next_seq) {
+	const LAX_SAMPLE *slot = &(ucb->ucb$r_samples[seq & (LAX_SAMPLE_RING - 1)]);
+
+	if (slot->lax$l_seq != seq) break;
+	__MB();
+	memcpy(outp, slot, sizeof(LAX_SAMPLE));
+	__MB();
+	if (slot->lax$l_seq != seq) break;	/* overwritten as we copied */
+
+	outp += sizeof(LAX_SAMPLE);
+	count++;
+	seq++;
+    }
+
+    hdr.lax$l_first_seq = first_seq;
+    hdr.lax$l_count = count;
+    hdr.lax$l_next_seq = seq;
+    memcpy(bufp, &hdr, sizeof(hdr));
+}
+
+/*
+ * LAX_ALLOC_PAGE - Allocate the published statistics page
+ *
+ * Functional description:
+ *
+ *   Allocates a page from nonpaged pool for the LAX_PAGE that readers can
+ *   map through a global section, if it hasn't been allocated already,
+ *   and looks up its page frame number for LAX$K_REC_PAGE reads.
+ *
+ *   Pool blocks aren't page aligned, and the rest of a page that a block
+ *   shares must not be visible to unprivileged readers, so two pages are
+ *   allocated and the whole page that falls inside them is used. The
+ *   block is never freed, since a global section may still map the page.
+ *
+ * Calling convention:
+ *
+ *   status = lax_alloc_page (ucb)
+ *
+ * Input parameters:
+ *
+ *   ucb        Pointer to unit control block
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   status     SS$_NORMAL, or the failure status from exe_std$alononpaged
+ *
+ * Environment:
+ * 
+ *   Kernel mode, user process context, IPL 2.
+ */
+
+static int lax_alloc_page (LAX_UCB *ucb) {
+    if (ucb->ucb$ps_page != NULL) {
+	return SS$_NORMAL;	/* already published */
+    }
+
+    const uint32_t page_size = mmg$gl_page_size;
+    int alosize;
+    void *pool;
+
+    int status = exe_std$alononpaged(2 * page_size, &alosize, &pool);
+    if (!$VMS_STATUS_SUCCESS(status)) {
+	return status;
+    }
+
+    LAX_PAGE *page = (LAX_PAGE *)(((uintptr_t)pool + page_size - 1) &
+				  ~(uintptr_t)(page_size - 1));
+    PTE_PQ svapte = va_pte_to_svapte(pte_va((VOID_PQ)page));
+
+    memset(page, 0, page_size);
+    page->lax$l_version = LAX$K_PAGE_VERSION;
+
+    /* another publish request may have got here first */
+    int orig_ipl;
+    device_lock (ucb->ucb$r_ucb.ucb$l_dlck, RAISE_IPL, &orig_ipl);
+    if (ucb->ucb$ps_page == NULL) {
+	ucb->ucb$q_page_pfn = svapte->pte$v_pfn;
+	ucb->ucb$ps_page = page;
+	pool = NULL;
+    }
+    device_unlock (ucb->ucb$r_ucb.ucb$l_dlck, orig_ipl, SMP_RESTORE);
+
+    if (pool != NULL) {
+	exe_std$deanonpaged(pool);
+    }
+    return SS$_NORMAL;
+}
+
+/*
+ * LAX_PUBLISH - Copy the current averages to the published page
+ *
+ * Functional description:
+ *
+ *   Copies the load averages and status of the tick just finished to the
+ *   LAX_PAGE, if one has been allocated. The generation count is made odd
+ *   while the fields change, so readers mapping the page can detect an
+ *   update that raced with their copy and retry.
+ *
+ * Calling convention:
+ *
+ *   lax_publish (ucb)
+ *
+ * Input parameters:
+ *
+ *   ucb        Pointer to unit control block
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   None.
+ *
+ * Environment:
+ * 
+ *   Kernel mode, system context, device lock held.
+ */
+
+static void lax_publish (LAX_UCB *ucb) {
+    LAX_PAGE *page = ucb->ucb$ps_page;
+
+    if (page == NULL) {
+	return;
+    }
+
+    const uint32_t generation = page->lax$l_generation;
+
+    page->lax$l_generation = generation + 1;
+    __MB();
+    page->lax$q_time = exe$gq_systime;
+    page->lax$l_flags = ucb->ucb$r_status.lax$l_flags;
+    page->lax$l_period_ms = ucb->ucb$l_period_ms;
+    memcpy(page->lax$fx_avgs, ucb->ucb$fx_avgs, sizeof(page->lax$fx_avgs));
+    __MB();
+    page->lax$l_generation = generation + 2;
+}
+
+/*
+ * LAX_ALLOC_PEAKS - Allocate the queues for the sliding window peaks
+ *
+ * Functional description:
+ *
+ *   Allocates the four queues, for the maximum and minimum of each
+ *   tracked value, from nonpaged pool in one piece, with room for every
+ *   sample of the longest window at the given period, and clears their
+ *   headers. lax_grow_peaks hands them to the timer routine. Since they
+ *   take about 30 KB at a one second period, and ten times that at the
+ *   shortest, they are only allocated for a LAX$K_CMD_PEAKS write, and
+ *   again for a LAX$K_CMD_PERIOD write that shortens the period once
+ *   tracking has started.
+ *
+ * Calling convention:
+ *
+ *   status = lax_alloc_peaks (period_ms, peakq)
+ *
+ * Input parameters:
+ *
+ *   period_ms  Sampling period the queues must keep up with
+ *
+ * Output parameters:
+ *
+ *   peakq      The queues
+ *
+ * Return value:
+ *
+ *   status     SS$_NORMAL, or the failure status from exe_std$alononpaged
+ *
+ * Environment:
+ * 
+ *   Kernel mode, user process context, IPL 2.
+ */
+
+static int lax_alloc_peaks (uint32_t period_ms, LAX_PEAK_Q **peakq) {
+    const uint32_t slots = LAX_PEAK_SLOTS(period_ms);
+    int alosize;
+    void *pool;
+
+    int status = exe_std$alononpaged(4 * (sizeof(LAX_PEAK_Q) +
+					  slots * sizeof(LAX_PEAK_ENT)),
+				     &alosize, &pool);
+    if (!$VMS_STATUS_SUCCESS(status)) {
+	return status;
+    }
+
+    /* only the queue headers need to start out clear */
+    LAX_PEAK_Q *q = (LAX_PEAK_Q *)pool;
+    LAX_PEAK_ENT *ent = (LAX_PEAK_ENT *)&q[4];
+    for (int i = 0; i < 4; i++) {
+	memset(&q[i], 0, sizeof(q[i]));
+	q[i].slots = slots;
+	q[i].ent = &ent[i * slots];
+    }
+
+    *peakq = q;
+    return SS$_NORMAL;
+}
+
+/*
+ * LAX_GROW_PEAKS - Start tracking the peaks, or track them in more room
+ *
+ * Functional description:
+ *
+ *   Makes the queues from lax_alloc_peaks the unit's, if it has none yet
+ *   or smaller ones, and moves any samples already in the old queues to
+ *   the new, so the peaks carry on as if nothing happened. Otherwise the
+ *   unit keeps the queues it has.
+ *
+ * Calling convention:
+ *
+ *   unused = lax_grow_peaks (ucb, peakq)
+ *
+ * Input parameters:
+ *
+ *   ucb        Pointer to unit control block
+ *   peakq      Queues from lax_alloc_peaks
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   unused     The queues the unit no longer needs, either its old ones
+ *              or peakq, or NULL; the caller returns them to pool once
+ *              it has released the locks.
+ *
+ * Environment:
+ * 
+ *   Kernel mode, lax_scan.lock and device lock held.
+ */
+
+static LAX_PEAK_Q *lax_grow_peaks (LAX_UCB *ucb, LAX_PEAK_Q *peakq) {
+    LAX_PEAK_Q *old = ucb->ucb$ps_peakq;
+
+    if (old != NULL && old[0].slots >= peakq[0].slots) {
+	return peakq;		/* already tracking in enough room */
+    }
+
+    /* the old entries go to the front of the new queues, in order */
+    if (old != NULL) {
+	for (int i = 0; i < 4; i++) {
+	    for (uint32_t n = 0, slot = old[i].head; n < old[i].len; n++) {
+		peakq[i].ent[n] = old[i].ent[slot];
+		slot = (slot + 1 == old[i].slots) ? 0 : slot + 1;
+	    }
+	    peakq[i].len = old[i].len;
+	    memcpy(peakq[i].skip, old[i].skip, sizeof(peakq[i].skip));
+	}
+    }
+
+    ucb->ucb$ps_peakq = peakq;
+    return old;
+}
+
+/*
+ * LAX_TRACK_PEAKS - Update the sliding window peaks
+ *
+ * Functional description:
+ *
+ *   Adds the samples of one tick to the maximum and minimum queues, and
+ *   records the largest and smallest sample of each value over each
+ *   window in ucb$r_peaks.
+ *
+ *   Each queue holds the samples, oldest first, that are larger than
+ *   every sample taken after them, so their values decrease from front to
+ *   back and the front one is the largest in the longest window. A new
+ *   sample removes the ones at the back that it is at least as large as,
+ *   and samples older than the longest window drop off the front. The
+ *   largest sample within a shorter window is the oldest queued sample
+ *   that falls inside it, which each window finds by skipping forward from
+ *   where it was on the last tick. Every sample is added and removed once
+ *   and every skip only moves forward, so a tick costs O(1) on average
+ *   however long the windows are. The minimum queues hold complemented
+ *   samples (flip is all ones), so the same code finds the smallest ones.
+ *
+ *   Samples are stamped with the system time in milliseconds, not counted
+ *   in periods, since ticks come a minute apart while the unit is idle,
+ *   and late or on demand at other times. A window holds the samples taken
+ *   within that much time before this one, however few there are. The
+ *   stamps wrap every 49 days, which the unsigned differences allow for.
+ *
+ *   A value that wasn't sampled on this tick (LAX$K_NO_QLEN) only has old
+ *   samples expire. If none are left in a window, the window's maximum
+ *   and minimum are LAX$K_NO_QLEN.
+ *
+ * Calling convention:
+ *
+ *   lax_track_peaks (ucb, now, proc_count, disk_queue_len)
+ *
+ * Input parameters:
+ *
+ *   ucb        Pointer to unit control block
+ *   now        System time of the samples
+ *   proc_count Runnable and running threads
+ *   disk_queue_len Sum of disk queue lengths, or LAX$K_NO_QLEN
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   None.
+ *
+ * Environment:
+ * 
+ *   Kernel mode, system context, device lock held.
+ */
+
+static inline uint32_t lax_peak_slot (const LAX_PEAK_Q *q, uint32_t slot) {
+    return (slot >= q->slots) ? slot - q->slots : slot;
+}
+
+static void lax_peak_update (LAX_PEAK_Q *q, uint32_t now, uint32_t sample,
+			     uint32_t flip, uint32_t peak[3]) {
+    static const uint32_t window_s[3] = LAX_PEAK_WINDOWS;
+    const uint32_t value = sample ^ flip;
+
+    if (sample != LAX$K_NO_QLEN) {
+	/* drop the samples at the back that can no longer be a peak */
+	while (q->len != 0 &&
+	       q->ent[lax_peak_slot(q, q->head + q->len - 1)].value <= value) {
+	    q->len--;
+	}
+	for (int w = 0; w < 3; w++) {
+	    if (q->skip[w] > q->len) {
+		q->skip[w] = q->len;	/* the new sample is the first */
+	    }
+	}
+
+	/* samples on demand and late ticks can come closer together than
+	 * the period; if they ever fill the queue, the oldest one goes
+	 */
+	if (q->len == q->slots) {
+	    q->head = lax_peak_slot(q, q->head + 1);
+	    q->len--;
+	    for (int w = 0; w < 3; w++) {
+		if (q->skip[w] != 0) {
+		    q->skip[w]--;
+		}
+	    }
+	}
+
+	LAX_PEAK_ENT *ent = &(q->ent[lax_peak_slot(q, q->head + q->len)]);
+	ent->t_ms = now;
+	ent->value = value;
+	q->len++;
+    }
+
+    /* skip the samples that have fallen out of each window */
+    for (int w = 0; w < 3; w++) {
+	while (q->skip[w] < q->len &&
+	       now - q->ent[lax_peak_slot(q, q->head + q->skip[w])].t_ms >=
+		   window_s[w] * 1000) {
+	    q->skip[w]++;
+	}
+    }
+
+    /* and remove those that are out of the longest one */
+    const uint32_t expired = q->skip[2];
+    q->head = lax_peak_slot(q, q->head + expired);
+    q->len -= expired;
+    for (int w = 0; w < 3; w++) {
+	q->skip[w] -= expired;
+	peak[w] = (q->skip[w] < q->len) ?
+		  q->ent[lax_peak_slot(q, q->head + q->skip[w])].value ^ flip :
+		  LAX$K_NO_QLEN;
+    }
+}
+
+static void lax_track_peaks (LAX_UCB *ucb, uint64_t now, uint32_t proc_count,
+			     uint32_t disk_queue_len) {
+    LAX_PEAKS *peaks = &(ucb->ucb$r_peaks);
+    const uint32_t now_ms = (uint32_t)(now / 10000);
+    const uint32_t sample[2] = { proc_count, disk_queue_len };
+
+    for (int m = 0; m < 2; m++) {
+	LAX_PEAK_Q *q = &(ucb->ucb$ps_peakq[m * 2]);
+
+	lax_peak_update(&q[0], now_ms, sample[m], 0, peaks->lax$l_max[m]);
+	lax_peak_update(&q[1], now_ms, sample[m], ~0U, peaks->lax$l_min[m]);
+    }
+
+    /* the first sample covers a period, and each later one the time
+     * since the one before
+     */
+    const uint32_t longest_ms = LAX_PEAK_LONGEST * 1000;
+    const uint32_t covered = (peaks->lax$l_tracked_ms == 0) ?
+			     ucb->ucb$l_period_ms :
+			     now_ms - ucb->ucb$l_peak_clock;
+
+    ucb->ucb$l_peak_clock = now_ms;
+    peaks->lax$l_tracked_ms =
+	(covered >= longest_ms - peaks->lax$l_tracked_ms) ? longest_ms :
+	peaks->lax$l_tracked_ms + covered;
+}
+
+/*
+ * LAX_PROFILE_TICK - Add the cost of a tick to the profile
+ *
+ * Functional description:
+ *
+ *   Adds the cycles spent so far in this tick, the cycles SCHED was held,
+ *   the KTBs and UCBs visited and how late the tick came to the minimum,
+ *   maximum, sum and histogram of each, and counts late and missed ticks
+ *   and ticks that couldn't lock the I/O database. The histogram bucket
+ *   of a value is the number of significant bits in it, found with
+ *   _leadz, so the whole update is a few dozen instructions.
+ *
+ *   A tick is late if it came at least half a period after it was due,
+ *   and each whole period beyond the one it was due in counts as missed.
+ *   The first tick after loading or restarting has nothing to be late
+ *   after, and ticks at the idle rate or for a read weren't due at all.
+ *
+ * Calling convention:
+ *
+ *   lax_profile_tick (ucb, prof)
+ *
+ * Input parameters:
+ *
+ *   ucb        Pointer to unit control block
+ *   prof       Costs of this tick
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   None.
+ *
+ * Environment:
+ * 
+ *   Kernel mode, system context, device lock held.
+ */
+
+static void lax_profile_tick (LAX_UCB *ucb, const LAX_TICK_PROF *prof) {
+    LAX_PROFILE *profile = &(ucb->ucb$r_profile);
+    const uint64_t period = (uint64_t)ucb->ucb$l_period_ms * 10000;
+    uint32_t value[LAX$K_PROF_COUNT];
+    int count = LAX$K_PROF_COUNT;
+
+    value[LAX$K_PROF_TICK] = (uint32_t)(LAX_CYCLES() - prof->start);
+    value[LAX$K_PROF_SCHED] = prof->sched;
+    value[LAX$K_PROF_KTBS] = prof->ktbs;
+    value[LAX$K_PROF_UCBS] = prof->ucbs;
+
+    if (prof->interval != 0 && !prof->unscheduled) {
+	const uint64_t late = (prof->interval > period) ?
+			      prof->interval - period : 0;
+
+	value[LAX$K_PROF_LATE] = (late / 10 > UINT32_MAX) ?
+				 UINT32_MAX : (uint32_t)(late / 10);
+	if (late >= period / 2) {
+	    profile->lax$q_late_ticks++;
+	    profile->lax$q_missed += late / period;
+	}
+    } else {
+	count = LAX$K_PROF_LATE;	/* nothing to measure it against */
+    }
+
+    for (int i = 0; i < count; i++) {
+	LAX_PROF_STAT *stat = &(profile->lax$r_stat[i]);
+	uint32_t bucket = 64 - (uint32_t)_leadz((uint64_t)value[i]);
+
+	if (bucket >= LAX$K_PROF_BUCKETS) {
+	    bucket = LAX$K_PROF_BUCKETS - 1;
+	}
+	if (value[i] < stat->lax$l_min) stat->lax$l_min = value[i];
+	if (value[i] > stat->lax$l_max) stat->lax$l_max = value[i];
+	stat->lax$q_sum += value[i];
+	stat->lax$l_hist[bucket]++;
+    }
+
+    profile->lax$q_ticks++;
+    if (prof->iodb_busy) {
+	profile->lax$q_iodb_busy++;
+    }
+    if (prof->shared) {
+	profile->lax$q_shared++;
+    }
+}
+
+/*
+ * LAX_CHECK_IDLE - Decide whether the unit is idle
+ *
+ * Functional description:
+ *
+ *   The unit is idle once LAX$K_CMD_IDLE has been set and nothing has read
+ *   it for that many seconds, as long as no threshold waits are queued and
+ *   the page hasn't been published, since their readers don't issue reads
+ *   at all. While it's idle the timer ticks every LAX$K_IDLE_PERIOD_MS,
+ *   and otherwise every period. The new delta takes effect when the TQE is
+ *   next requeued, and setting it on every tick also restores it after a
+ *   change of period.
+ *
+ * Calling convention:
+ *
+ *   lax_check_idle (ucb, now)
+ *
+ * Input parameters:
+ *
+ *   ucb        Pointer to unit control block
+ *   now        exe$gq_systime of this tick
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   None.
+ *
+ * Environment:
+ * 
+ *   Kernel mode, system context, device lock held.
+ */
+
+static void lax_check_idle (LAX_UCB *ucb, uint64_t now) {
+    const uint64_t idle_after = (uint64_t)ucb->ucb$l_idle_s * 10000000;
+    const uint64_t read_time = ucb->ucb$q_read_time;
+
+    ucb->ucb$b_is_idle = idle_after != 0 && ucb->ucb$ps_waitq == NULL &&
+			 ucb->ucb$ps_page == NULL && now > read_time &&
+			 now - read_time >= idle_after;
+    ucb->ucb$l_tqe.tqe$q_delta = ucb->ucb$b_is_idle ?
+				 LAX$K_IDLE_PERIOD_MS * 10000ULL :
+				 (uint64_t)ucb->ucb$l_period_ms * 10000;
+}
+
+/*
+ * LAX_CANCEL - Cancel I/O Routine
+ *
+ * Functional description:
+ *
+ *   Completes the LAX$K_REC_WAIT reads that the process queued on the
+ *   channel being cancelled or deassigned, with SS$_CANCEL. No other
+ *   request is ever left outstanding.
+ *
+ * Calling convention:
+ *
+ *   lax_cancel (chan, irp, pcb, ucb, reason)
+ *
+ * Input parameters:
+ *
+ *   chan       Channel index of the channel being cancelled
+ *   irp        Pointer to the current IRP, unused
+ *   pcb        Pointer to the process control block of the canceller
+ *   ucb        Pointer to unit control block
+ *   reason     Reason for the cancel, unused
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   None.
+ *
+ * Environment:
+ * 
+ *   Kernel mode, fork IPL, fork lock held.
+ */
+
+static void lax_cancel (int chan, IRP *irp, PCB *pcb, LAX_UCB *ucb, int reason) {
+    int orig_ipl;
+    device_lock (ucb->ucb$r_ucb.ucb$l_dlck, RAISE_IPL, &orig_ipl);
+
+    IRP **link = &(ucb->ucb$ps_waitq);
+
+    while (*link != NULL) {
+	IRP *wait = *link;
+
+	if (wait->irp$l_pid != pcb->pcb$l_pid || wait->irp$l_chan != chan) {
+	    link = &(wait->irp$l_ioqfl);
+	    continue;
+	}
+
+	*link = wait->irp$l_ioqfl;
+	wait->irp$l_iost1 = SS$_CANCEL;
+	wait->irp$l_iost2 = 0;
+	com_std$post(wait, (UCB *)ucb);
+    }
+
+    device_unlock (ucb->ucb$r_ucb.ucb$l_dlck, orig_ipl, SMP_RESTORE);
+}
+
+/*
+ * LAX_WRITE - FDT Routine for Write Function Codes 
+ *
+ * Functional description:
+ *
+ *   The original LAVDRIVER behavior for writes is to update a mask to
+ *   disable specific priorities from being counted. I suspect nobody has
+ *   ever used that feature. So this version repurposes writes to set
+ *   a single boolean flag to 1 to stop the load average update timer
+ *   callback (e.g. for benchmarking), or to 0 to restart the load average
+ *   service. Additional bits/bytes are ignored and should be set to zero.
+ *
+ *   A non-zero $QIO P3 parameter selects one of the other commands defined
+ *   in laxdef.h instead, with its argument in the write buffer.
+ *
+ *   Since this is an upper-level FDT routine, this routine always returns
+ *   the SS$_FDT_COMPL status.  The $QIO status that is to be returned to
+ *   the caller of the $QIO system service is returned indirectly by the
+ *   FDT completion routines (e. g. exe_std$abortio, exe_std$qiodrvpkt) via
+ *   the FDT context structure.
+ *
+ * Calling convention:
+ *
+ *   status = lax_write (irp, pcb, ucb, ccb)
+ *
+ * Input parameters:
+ *
+ *   irp        Pointer to I/O request packet
+ *   pcb        Pointer process control block
+ *   ucb        Pointer to unit control block
+ *   ccb        Pointer to channel control block
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   status     SS$_FDT_COMPL
+ *
+ * Environment:
+ * 
+ *   Kernel mode, user process context, IPL 2.
+ */
+
+static int lax_write (IRP *irp, PCB *pcb, LAX_UCB *ucb, CCB *ccb) {
+
+    /* Check if the caller has the required CMKRNL privilege. */
+    if ((pcb->pcb$q_priv & PRV$M_CMKRNL) == 0)
+        return ( call_abortio (irp, pcb, (UCB *)ucb, SS$_NOPRIV) );
+
+    /* Get the pointer to the caller's buffer and the size of the caller's
+     * buffer from the $QIO P1 and P2 parameters respectively.  The caller's
+     * buffer is treated as a 64-bit address although it may be a 32-bit 
+     * address.
+     */
+    CHAR_PQ qio_bufp = (CHAR_PQ)irp->irp$q_qio_p1;
+    int qio_buflen = irp->irp$l_qio_p2;
+
+    /* Return an SS$_BADPARAM error if the write size is too small. */
+    uint32_t cmd = irp->irp$l_qio_p3;
+    if ((qio_buflen < sizeof(bool)) ||
+	    ((cmd != LAX$K_CMD_STOP) && (qio_buflen < sizeof(uint32_t)))) {
+	return ( call_abortio (irp, pcb, (UCB *)ucb, SS$_BADPARAM) );
+    }
+
+    /* Assure that the caller has read access to this buffer to do a write
+     * operation.  If not, exe_std$writechk will abort the I/O request and
+     * return the SS$_FDT_COMPL warning status.  If this is the case, we must
+     * return back to the FDT dispatcher in the $QIO system service.
+     */
+    if (qio_buflen != 0) {
+        int status = exe_std$writechk (irp, pcb, &(ucb->ucb$r_ucb), 
+                                   qio_bufp, qio_buflen);
+        if ( ! $VMS_STATUS_SUCCESS(status) ) return status;
+
+	switch (cmd) {
+	case LAX$K_CMD_STOP:
+	    break;
+
+	case LAX$K_CMD_WALK_BUDGET:
+	    /* picked up by the next scan, which every unit shares; no lock
+	     * needed for an aligned store
+	     */
+	    memcpy(&(lax_scan.walk_budget), qio_bufp, sizeof(uint32_t));
+	    return ( call_finishio (irp, (UCB *)ucb, SS$_NORMAL, 0) );
+
+	case LAX$K_CMD_PERIOD: {
+	    LAX_PEAK_Q *peakq = NULL;
+	    uint32_t period_ms;
+	    int lock_ipl, orig_ipl;
+	    bool valid;
+
+	    memcpy(&period_ms, qio_bufp, sizeof(period_ms));
+
+	    /* peaks already tracked need room for the samples of a shorter
+	     * period before it starts
+	     */
+	    if (ucb->ucb$ps_peakq != NULL &&
+		    period_ms >= lax_coef_period_ms[0] &&
+		    period_ms < ucb->ucb$l_period_ms) {
+		int status = lax_alloc_peaks(period_ms, &peakq);
+		if (!$VMS_STATUS_SUCCESS(status)) {
+		    return ( call_abortio (irp, pcb, (UCB *)ucb, status) );
+		}
+	    }
+
+	    /* keep an update from seeing half-updated coefficients; it
+	     * reads the period and windows for a late tick's coefficients
+	     * before taking the device lock, but under the scan's lock. The
+	     * new delta takes effect when the TQE is next requeued.
+	     */
+	    device_lock (lax_scan.lock, RAISE_IPL, &lock_ipl);
+	    device_lock (ucb->ucb$r_ucb.ucb$l_dlck, RAISE_IPL, &orig_ipl);
+	    valid = lax_set_period(ucb, period_ms);
+	    if (valid && peakq != NULL) {
+		peakq = lax_grow_peaks(ucb, peakq);
+	    }
+	    device_unlock (ucb->ucb$r_ucb.ucb$l_dlck, orig_ipl, SMP_RESTORE);
+	    device_unlock (lax_scan.lock, lock_ipl, SMP_RESTORE);
+
+	    if (peakq != NULL) {
+		exe_std$deanonpaged(peakq);
+	    }
+	    return ( call_finishio (irp, (UCB *)ucb,
+				    valid ? SS$_NORMAL : SS$_BADPARAM, 0) );
+	}
+
+	case LAX$K_CMD_PUBLISH:
+	    return ( call_finishio (irp, (UCB *)ucb, lax_alloc_page(ucb), 0) );
+
+	case LAX$K_CMD_PEAKS:
+	    /* tracking starts now, and the queues are kept from then on */
+	    while (ucb->ucb$ps_peakq == NULL) {
+		LAX_PEAK_Q *peakq;
+		int lock_ipl, orig_ipl;
+
+		int status = lax_alloc_peaks(ucb->ucb$l_period_ms, &peakq);
+		if (!$VMS_STATUS_SUCCESS(status)) {
+		    return ( call_abortio (irp, pcb, (UCB *)ucb, status) );
+		}
+
+		/* another writer may have got here first, or shortened the
+		 * period, in which case try again with room for it
+		 */
+		device_lock (lax_scan.lock, RAISE_IPL, &lock_ipl);
+		device_lock (ucb->ucb$r_ucb.ucb$l_dlck, RAISE_IPL, &orig_ipl);
+		if (peakq[0].slots >= LAX_PEAK_SLOTS(ucb->ucb$l_period_ms)) {
+		    peakq = lax_grow_peaks(ucb, peakq);
+		}
+		device_unlock (ucb->ucb$r_ucb.ucb$l_dlck, orig_ipl,
+			       SMP_RESTORE);
+		device_unlock (lax_scan.lock, lock_ipl, SMP_RESTORE);
+
+		if (peakq != NULL) {
+		    exe_std$deanonpaged(peakq);
+		}
+	    }
+	    return ( call_finishio (irp, (UCB *)ucb, SS$_NORMAL, 0) );
+
+	case LAX$K_CMD_IDLE:
+	    /* picked up by the next tick, counting from now */
+	    ucb->ucb$q_read_time = exe$gq_systime;
+	    memcpy(&(ucb->ucb$l_idle_s), qio_bufp, sizeof(uint32_t));
+	    return ( call_finishio (irp, (UCB *)ucb, SS$_NORMAL, 0) );
+
+	case LAX$K_CMD_WINDOWS: {
+	    uint32_t window_s[3];
+	    int lock_ipl, orig_ipl;
+	    bool valid;
+
+	    if (qio_buflen < sizeof(window_s)) {
+		return ( call_abortio (irp, pcb, (UCB *)ucb, SS$_BADPARAM) );
+	    }
+	    memcpy(window_s, qio_bufp, sizeof(window_s));
+
+	    /* the averages of any changed window restart from 0, so make
+	     * readers retry a copy that overlaps the change, and hold off
+	     * updates for the whole of it, as for LAX$K_CMD_PERIOD
+	     */
+	    device_lock (lax_scan.lock, RAISE_IPL, &lock_ipl);
+	    device_lock (ucb->ucb$r_ucb.ucb$l_dlck, RAISE_IPL, &orig_ipl);
+	    ucb->ucb$l_seq++;
+	    __MB();
+	    valid = lax_set_windows(ucb, window_s);
+	    __MB();
+	    ucb->ucb$l_seq++;
+	    device_unlock (ucb->ucb$r_ucb.ucb$l_dlck, orig_ipl, SMP_RESTORE);
+	    device_unlock (lax_scan.lock, lock_ipl, SMP_RESTORE);
+
+	    return ( call_finishio (irp, (UCB *)ucb,
+				    valid ? SS$_NORMAL : SS$_BADPARAM, 0) );
+	}
+
+	default:
+	    return ( call_abortio (irp, pcb, (UCB *)ucb, SS$_BADPARAM) );
+	}
+
+	/* True = stop updating; false = start updating */
+	bool stop_request = (bool)(*qio_bufp);
+
+	if (stop_request && !(ucb->ucb$b_is_stopped)) {
+	    /* it's okay if this is already set */
+	    ucb->ucb$b_is_stopping = true;
+	} else if (!stop_request && ucb->ucb$b_is_stopped) {
+	    int lock_ipl;
+
+	    /* the last tick decides under the scan's lock whether to queue
+	     * another, so look again under it before queueing one here
+	     */
+	    device_lock (lax_scan.lock, RAISE_IPL, &lock_ipl);
+	    if (ucb->ucb$b_is_stopped) {
+		/* Note: ucb$b_is_stopping should already be false */
+		ucb->ucb$b_is_stopped = false;
+		ucb->ucb$q_tick_time = 0;	/* the gap isn't lateness */
+
+		/* Restart the timer */
+		lax_queue_tick(ucb);
+	    }
+	    device_unlock (lax_scan.lock, lock_ipl, SMP_RESTORE);
+ 	}
+    }
+
+    return ( call_finishio (irp, (UCB *)ucb, SS$_NORMAL, 0) );
+}
+
+/*
+ * LAX_SET_PERIOD - Select the sampling period
+ *
+ * Functional description:
+ *
+ *   Looks up the coefficients for the requested sampling period in the
+ *   generated table and makes them current, along with the timer
+ *   interval. Coefficients for windows other than the standard ones are
+ *   computed instead. The averages themselves are left alone, so they
+ *   carry on smoothly at the new rate.
+ *
+ * Calling convention:
+ *
+ *   valid = lax_set_period (ucb, period_ms)
+ *
+ * Input parameters:
+ *
+ *   ucb        Pointer to unit control block
+ *   period_ms  Sampling period in milliseconds
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   valid      False if the period isn't in the table; nothing is changed.
+ *
+ * Environment:
+ * 
+ *   Kernel mode, lax_scan.lock and device lock held, or unit not yet
+ *   initialized.
+ */
+
+static bool lax_set_period (LAX_UCB *ucb, uint32_t period_ms) {
+    for (int i = 0; i < LAXCOEF_NPERIODS; i++) {
+	if (lax_coef_period_ms[i] == period_ms) {
+	    for (int w = 0; w < 3; w++) {
+		if (ucb->ucb$l_window_s[w] == lax_coef_window_s[w]) {
+		    ucb->ucb$r_coef[w] = lax_coef_table[i][w];
+		    ucb->ucb$r_coef64[w] = lax_coef64_table[i][w];
+		} else {
+		    lax_compute_coef(period_ms, ucb->ucb$l_window_s[w],
+				     &(ucb->ucb$r_coef[w]),
+				     &(ucb->ucb$r_coef64[w]));
+		}
+	    }
+	    ucb->ucb$l_period_ms = period_ms;
+	    ucb->ucb$l_tqe.tqe$q_delta = (uint64_t)period_ms * 10000; /* 100 ns units */
+	    return true;
+	}
+    }
+
+    return false;
+}
+
+/*
+ * LAX_SET_WINDOWS - Select the averaging windows
+ *
+ * Functional description:
+ *
+ *   Makes the three window lengths current, in place of the standard 1, 5
+ *   and 15 minutes, and computes their coefficients for the current
+ *   sampling period. A length of 0 selects the standard window for that
+ *   slot. Every average over a window that changes restarts from 0, as it
+ *   would when the driver is loaded; the others are left alone.
+ *
+ * Calling convention:
+ *
+ *   valid = lax_set_windows (ucb, window_s)
+ *
+ * Input parameters:
+ *
+ *   ucb        Pointer to unit control block
+ *   window_s   Window lengths in seconds, each 0 or from
+ *              LAX$K_WINDOW_MIN to LAX$K_WINDOW_MAX
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   valid      False if a length is out of range; nothing is changed.
+ *
+ * Environment:
+ * 
+ *   Kernel mode, lax_scan.lock and device lock held.
+ */
+
+static void lax_zero_window (uint32_t *avgs, uint32_t stride, uint32_t count,
+			     int w) {
+    for (uint32_t i = 0; i < count; i++) {
+	avgs[i * stride + w] = 0;
+    }
+}
+
+static bool lax_set_windows (LAX_UCB *ucb, const uint32_t window_s[3]) {
+    uint32_t new_window_s[3];
+
+    for (int w = 0; w < 3; w++) {
+	new_window_s[w] = window_s[w] ? window_s[w] : lax_coef_window_s[w];
+	if (new_window_s[w] < LAX$K_WINDOW_MIN ||
+	    new_window_s[w] > LAX$K_WINDOW_MAX) {
+	    return false;
+	}
+    }
+
+    for (int w = 0; w < 3; w++) {
+	if (new_window_s[w] == ucb->ucb$l_window_s[w]) {
+	    continue;
+	}
+	ucb->ucb$l_window_s[w] = new_window_s[w];
+
+	for (int m = 0; m < 3; m++) {
+	    ucb->ucb$q_avgs[m * 3 + w] = 0;
+	}
+	lax_zero_window(ucb->ucb$fx_avgs, 3, 3, w);
+	lax_zero_window(ucb->ucb$fx_prio_avgs[0], 3, 64, w);
+	lax_zero_window(ucb->ucb$fx_class_avgs[0], 3, 4, w);
+	for (int m = 0; m < LAX$K_MEM_COUNT; m++) {
+	    ucb->ucb$r_memory.lax$q_avgs[m][w] = 0;
+	}
+	for (int bank = 0; bank < 2 && ucb->ucb$l_disk_max != 0; bank++) {
+	    lax_zero_window(ucb->ucb$ps_disks[bank][0].lax$fx_avgs,
+			    sizeof(LAX_DISK) / sizeof(uint32_t),
+			    ucb->ucb$l_disk_max, w);
+	}
+    }
+
+    /* the period is unchanged, so this only picks up the coefficients */
+    return lax_set_period(ucb, ucb->ucb$l_period_ms);
+}
+
+/*
+ * LAX_EXP_NEG - Fixed-point exponential
+ *
+ * Functional description:
+ *
+ *   Computes exp(-num/den) with 63 fraction bits, without floating point,
+ *   so that coefficients for any window can be computed in the kernel.
+ *
+ *   The argument is divided out to 60 fraction bits, then reduced to
+ *   r = x - k*ln(2), with 0 <= r < ln(2), so that exp(-x) = exp(-r) / 2^k.
+ *   exp(-r) is summed as a Taylor series until the terms underflow; they
+ *   alternate in sign and shrink, so the partial sums stay between 0 and
+ *   1 and the result is good to a few units in the last place.
+ *
+ * Calling convention:
+ *
+ *   value = lax_exp_neg (num, den)
+ *
+ * Input parameters:
+ *
+ *   num        Numerator of the argument
+ *   den        Denominator of the argument, less than 2^34 and such
+ *              that num/den < 16
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   value      exp(-num/den) * 2^63
+ *
+ * Environment:
+ * 
+ *   Any.
+ */
+
+#define LAX_LN2_Q60	0x0B17217F7D1CF79BULL	/* ln(2) * 2^60 */
+
+static uint64_t lax_exp_neg (uint32_t num, uint32_t den) {
+    uint64_t rem = num % den;
+    uint64_t x = (uint64_t)(num / den) << 60;
+
+    /* the fraction, 30 bits at a time */
+    x |= ((rem << 30) / den) << 30;
+    rem = (rem << 30) % den;
+    x |= (rem << 30) / den;
+
+    uint32_t k = 0;
+    while (x >= LAX_LN2_Q60) {
+	x -= LAX_LN2_Q60;
+	k++;
+    }
+
+    const uint64_t r = x << 3;		/* 63 fraction bits, r < 1 */
+    uint64_t term = 1ULL << 63;
+    uint64_t sum = term;
+
+    for (uint32_t n = 1; term != 0; n++) {
+	term = (__UMULH(term, r) << 1) / n;
+	sum = (n & 1) ? sum - term : sum + term;
+    }
+
+    return sum >> k;
+}
+
+/*
+ * LAX_COMPUTE_COEF - Compute the coefficients for a window
+ *
+ * Functional description:
+ *
+ *   Computes the coefficient pairs for an averaging window of any length
+ *   at the given sampling period, rounding exp(-T/W) to the fraction bits
+ *   of each old_lav. Unlike the generated table, each new_lav is then set
+ *   so that the pair adds up to exactly 1, so that a long window, whose
+ *   new_lav is small, doesn't settle on a scaled copy of a steady sample.
+ *
+ * Calling convention:
+ *
+ *   lax_compute_coef (period_ms, window_s, coef, coef64)
+ *
+ * Input parameters:
+ *
+ *   period_ms  Sampling period, or time between samples, in milliseconds,
+ *              less than 16 windows
+ *   window_s   Window length in seconds, at most LAX$K_WINDOW_MAX
+ *
+ * Output parameters:
+ *
+ *   coef       Coefficients for the 32-bit averages
+ *   coef64     Coefficients for the 64-bit averages
+ *
+ * Return value:
+ *
+ *   None.
+ *
+ * Environment:
+ * 
+ *   Any.
+ */
+
+static void lax_compute_coef (uint32_t period_ms, uint32_t window_s,
+			      LAX_COEF *coef, LAX_COEF64 *coef64) {
+    const uint64_t decay = lax_exp_neg(period_ms, window_s * 1000);
+    uint64_t old;
+
+    /* round to FX_RSHIFT bits, keeping both weights above 0 so that the
+     * new one fits in 32 bits
+     */
+    old = (decay + (1ULL << (62 - FX_RSHIFT))) >> (63 - FX_RSHIFT);
+    if (old >= (1ULL << FX_RSHIFT)) {
+	old = (1ULL << FX_RSHIFT) - 1;
+    } else if (old == 0) {
+	old = 1;
+    }
+    coef->old_lav = (uint32_t)old;
+    coef->new_lav = (uint32_t)(((1ULL << FX_RSHIFT) - old) << (FX_SCALE - FX_LSHIFT));
+
+    /* and to 32 bits */
+    old = (decay + (1ULL << 30)) >> 31;
+    if (old > UINT32_MAX) {
+	old = UINT32_MAX;
+    } else if (old == 0) {
+	old = 1;
+    }
+    coef64->old_lav = (uint32_t)old;
+    coef64->new_lav = (uint32_t)((1ULL << 32) - old);
+}
+
+/*
+ * LAX_ELAPSED_COEF - Compute the coefficients for a late or early tick
+ *
+ * Functional description:
+ *
+ *   The coefficients selected for the sampling period assume that each
+ *   tick comes one period after the last. When the timer routine runs
+ *   late, as it does under a heavy interrupt load, or several periods'
+ *   ticks are merged, or the system is stopped in the debugger, a tick
+ *   stands for more time than that, and the tick after a late one often
+ *   for less. This decides whether a tick was on time, within
+ *   LAX_TICK_SLACK ms, and if it wasn't, computes the coefficients for the
+ *   time that did pass, so the averages decay as if every period had been
+ *   sampled with the value taken now.
+ *
+ *   Beyond 16 windows the decay rounds to the smallest weight there is,
+ *   so longer gaps are cut to that, which also keeps the argument of
+ *   lax_exp_neg in range.
+ *
+ * Calling convention:
+ *
+ *   late = lax_elapsed_coef (interval, period_ms, window_s, coef, coef64)
+ *
+ * Input parameters:
+ *
+ *   interval   Time since the last tick in 100 ns units, or 0 if unknown
+ *   period_ms  Sampling period in milliseconds
+ *   window_s   Window lengths in seconds
+ *
+ * Output parameters:
+ *
+ *   coef       Coefficients for the 32-bit averages over the interval
+ *   coef64     Coefficients for the 64-bit averages over the interval
+ *
+ * Return value:
+ *
+ *   late       True if coef and coef64 were filled in; false if the
+ *              period's own coefficients should be used
+ *
+ * Environment:
+ * 
+ *   Any.
+ */
+
+static bool lax_elapsed_coef (uint64_t interval, uint32_t period_ms,
+			      const uint32_t window_s[3], LAX_COEF coef[3],
+			      LAX_COEF64 coef64[3]) {
+    const uint64_t elapsed_ms = (interval + 5000) / 10000;
+
+    if (interval == 0 || (elapsed_ms + LAX_TICK_SLACK >= period_ms &&
+			  elapsed_ms <= period_ms + LAX_TICK_SLACK)) {
+	return false;
+    }
+
+    for (int w = 0; w < 3; w++) {
+	const uint64_t limit = (uint64_t)window_s[w] * 16000 - 1;
+
+	lax_compute_coef((uint32_t)((elapsed_ms < limit) ? elapsed_ms : limit),
+			 window_s[w], &coef[w], &coef64[w]);
+    }
+    return true;
+}
+
+/*
+ * LAX_EWMA_UPDATE - Fold a set of new samples into their load averages
+ *
+ * Functional description:
+ *
+ *   Applies the same coefficients to every metric in a table: for each
+ *   sample, each of its nwin averages becomes
+ *
+ *     avg = (avg * old_lav + sample * new_lav) >> FX_RSHIFT
+ *
+ *   with the sample clamped to FX_MAX_SAMPLE and the result saturating at
+ *   UINT32_MAX, so a sample too large to represent can't wrap an average
+ *   around to a small value.
+ *
+ *   The averages of one metric are adjacent, one per window, and stride
+ *   longwords from those of the next. Each sample is then loaded once and
+ *   its averages are updated from the same cache line, walking the table
+ *   from start to end, and the coefficients stay in registers throughout.
+ *   A new metric needs only a slot in a table, not more code here.
+ *
+ * Calling convention:
+ *
+ *   lax_ewma_update (avgs, stride, samples, count, coef, nwin)
+ *
+ * Input parameters:
+ *
+ *   avgs       Averages of the first metric
+ *   stride     Longwords from the averages of one metric to the next
+ *   samples    New sample for each metric
+ *   count      Number of metrics
+ *   coef       Coefficients for each window
+ *   nwin       Number of windows, at most stride
+ *
+ * Output parameters:
+ *
+ *   avgs       Updated averages
+ *
+ * Return value:
+ *
+ *   None.
+ *
+ * Environment:
+ * 
+ *   Kernel mode, system context, device lock held.
+ */
+
+static inline uint32_t lax_fx_clamp (uint64_t value) {
+    return (value > UINT32_MAX) ? UINT32_MAX : (uint32_t)value;
+}
+
+static inline void lax_ewma_update (uint32_t *avgs, uint32_t stride,
+				    const uint32_t samples[], uint32_t count,
+				    const LAX_COEF coef[], uint32_t nwin) {
+    for (uint32_t i = 0; i < count; i++, avgs += stride) {
+	const uint64_t x = (uint64_t)((samples[i] > FX_MAX_SAMPLE) ?
+				      FX_MAX_SAMPLE : samples[i]) << FX_LSHIFT;
+
+	for (uint32_t w = 0; w < nwin; w++) {
+	    avgs[w] = lax_fx_clamp(((((uint64_t)avgs[w]) * coef[w].old_lav) +
+				    (x * coef[w].new_lav)) >> FX_RSHIFT);
+	}
+    }
+}
+
+/* The same for averages with 32 fraction bits, laid out the same way. The
+ * old average is split into 32-bit halves so each product fits in 64 bits;
+ * since the weights add up to 1 the sum can only overflow by rounding, and
+ * saturates.
+ */
+
+static inline void lax_ewma_update64 (uint64_t *avgs, uint32_t stride,
+				      const uint32_t samples[], uint32_t count,
+				      const LAX_COEF64 coef[], uint32_t nwin) {
+    for (uint32_t i = 0; i < count; i++, avgs += stride) {
+	const uint64_t x = samples[i];
+
+	for (uint32_t w = 0; w < nwin; w++) {
+	    const uint64_t old = (avgs[w] >> 32) * coef[w].old_lav +
+				 (((avgs[w] & 0xffffffff) * coef[w].old_lav) >> 32);
+	    const uint64_t sum = old + x * coef[w].new_lav;
+
+	    avgs[w] = (sum < old) ? UINT64_MAX : sum;
+	}
+    }
+}
+
+/*
+ * LAX_WALK_QUEUES - Count the KTBs in a set of scheduler state queues
+ *
+ * Functional description:
+ *
+ *   Counts the KTBs in each queue whose bit is set in the summary mask,
+ *   jumping from one set bit to the next with _trailz instead of testing
+ *   all 64 bits. Bit n of the mask selects the queue whose head is
+ *   heads[n * stride].
+ *
+ *   If the walk budget runs out, each queue not yet visited is assumed to
+ *   be as deep as it was the last time it was walked completely, and the
+ *   first such queue is remembered so that the caller can start there on
+ *   the next tick. A queue too deep to walk even with the whole budget is
+ *   counted as at least the budget, and skipped over next time; its depth
+ *   is only learned again by a walk without a limit, which lax_take_scan
+ *   makes every LAX_DEPTH_REFRESH seconds.
+ *
+ * Calling convention:
+ *
+ *   count = lax_walk_queues (summary, heads, stride, depth, counts, walk)
+ *
+ * Input parameters:
+ *
+ *   summary    Bit mask of the queues to count
+ *   heads      Array of queue head pointers
+ *   stride     Distance between consecutive queue heads in the array
+ *   depth      Depths of these queues from their last full walk
+ *   counts     Per-queue totals to add this tick's counts to, or NULL
+ *   walk       Pointer to walk budget and progress for this tick
+ *
+ * Output parameters:
+ *
+ *   depth      Updated for the queues that were walked completely
+ *   counts     Incremented by the number counted or estimated in each queue
+ *   walk       Updated with the KTBs visited and estimated
+ *
+ * Return value:
+ *
+ *   count      Number of KTBs counted or estimated in the queues
+ *
+ * Environment:
+ * 
+ *   Kernel mode, system context, SCHED spinlock held.
+ */
+
+static uint32_t lax_walk_queues (uint64_t summary, KTB * const heads[],
+				 int stride, uint32_t depth[], uint32_t counts[],
+				 LAX_WALK *walk) {
+    uint32_t count = 0;
+
+    while (summary) {
+	int idx = (int)_trailz(summary);
+	summary &= (summary - 1);	/* clear the lowest set bit */
+
+	uint32_t limit = walk->limited ? walk->budget : UINT32_MAX;
+	uint32_t visited = 0;
+	bool complete = true;
+
+	if (limit == 0) {
+	    complete = false;		/* out of budget */
+	} else {
+	    KTB* head = heads[idx * stride];
+	    KTB* ktb = head;
+
+	    while ((ktb = ktb->ktb$l_sqfl) != head) {
+		if (++visited == limit) {
+		    complete = (ktb->ktb$l_sqfl == head);
+		    break;
+		}
+	    }
+
+	    walk->walked += visited;
+	    if (walk->limited) {
+		walk->budget -= visited;
+	    }
+	}
+
+	uint32_t queued;
+
+	if (complete) {
+	    depth[idx] = visited;
+	    queued = visited;
+	} else if (visited == walk->walked) {
+	    /* had the whole budget to itself: keep a lower bound and move on */
+	    if (depth[idx] < visited) {
+		depth[idx] = visited;
+	    }
+	    walk->estimated += depth[idx] - visited;
+	    queued = depth[idx];
+	    walk->approx = true;
+	} else {
+	    /* assume at least as many as last time, and at least one */
+	    uint32_t last = depth[idx] ? depth[idx] : 1;
+	    uint32_t est = (last > visited) ? last - visited : 0;
+
+	    walk->estimated += est;
+	    queued = visited + est;
+	    walk->approx = true;
+	    if (walk->missed_bit < 0) {
+		walk->missed_set = walk->set;
+		walk->missed_bit = idx;
+	    }
+	}
+
+	count += queued;
+	if (counts != NULL) {
+	    counts[idx] += queued;
+	}
+    }
+
+    return count;
+}
+
+/*
+ * LAX_IS_SAMPLED_DISK - Test whether a device counts toward disk queue length
+ *
+ *   Returns true for a mounted disk that isn't a class driver port or a
+ *   shadow set member.
+ */
+
+static inline bool lax_is_sampled_disk (const UCB *dev) {
+    return ((dev->ucb$b_devclass == DC$_DISK) &&
+	    (dev->ucb$l_devchar & DEV$M_MNT) &&
+	    !(dev->ucb$l_devchar2 & (DEV$M_CDP | DEV$M_SSM)));
+}
+
+/*
+ * LAX_FORMAT_DEVNAM - Build a device name such as "DKA100" for a disk
+ *
+ *   The name is the DDB's counted ASCII controller name followed by the
+ *   decimal unit number, truncated and zero-padded to 16 bytes.
+ */
+
+static void lax_format_devnam (char name[16], const DDB *ddb, uint32_t unit) {
+    int len = ddb->ddb$t_name[0];
+    char digits[10];
+    int ndigits = 0;
+
+    if (len > 15) len = 15;
+    memset(name, 0, 16);
+    memcpy(name, &(ddb->ddb$t_name[1]), len);
+
+    do {
+	digits[ndigits++] = '0' + (unit % 10);
+	unit /= 10;
+    } while (unit != 0);
+
+    while (ndigits > 0 && len < 15) {
+	name[len++] = digits[--ndigits];
+    }
+}
+
+/*
+ * LAX_SCAN_DISKS - Rebuild the list of disks to sample
+ *
+ * Functional description:
+ *
+ *   Scans the whole I/O database and records every disk that qualifies in
+ *   the dense array lax_scan.disks, with its name, so that the periodic
+ *   update doesn't need to visit every terminal, LAT port and network
+ *   device in the system. If there are more such disks than the list has
+ *   room for, room is allocated for them all, rounded up, and the I/O
+ *   database is scanned again to fill it in; that happens on the first
+ *   scan, and then only when more disks are mounted than ever before. If
+ *   there is no pool for it, the list keeps the disks it has room for,
+ *   and is marked as overflowed until a later rebuild finds the pool.
+ *
+ *   Each unit moves its per-disk averages over to the new list the next
+ *   time it updates them, with lax_remap_disks.
+ *
+ * Calling convention:
+ *
+ *   visited = lax_scan_disks (scan, now)
+ *
+ * Input parameters:
+ *
+ *   scan       Pointer to the shared scan
+ *   now        exe$gq_systime of the scan
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   visited	Number of UCBs looked at
+ *
+ * Environment:
+ * 
+ *   Kernel mode, system context, IOC database mutex held for read.
+ */
+
+static uint32_t lax_list_disks (LAX_SCAN *scan, uint32_t *visited) {
+    UCB* cur_ucb = NULL;
+    DDB* cur_ddb = NULL;
+    uint32_t ndisks = 0;
+
+    /* this will return low bit clear when there are no more devices */
+    while ($VMS_STATUS_SUCCESS(
+	    ioc_std$scan_iodb(cur_ucb, cur_ddb, &cur_ucb, &cur_ddb))) {
+	(*visited)++;
+	if (!lax_is_sampled_disk(cur_ucb)) {
+	    continue;
+	}
+
+	/* count the ones there's no room for, to make room next time */
+	if (ndisks < scan->max_disks) {
+	    lax_format_devnam(scan->disk_name[ndisks], cur_ddb,
+			      cur_ucb->ucb$w_unit);
+	    scan->disk_ddb[ndisks] = cur_ddb;
+	    scan->disk_gone[ndisks] = false;
+	    scan->disks[ndisks] = cur_ucb;
+	}
+	ndisks++;
+    }
+
+    return ndisks;
+}
+
+static bool lax_alloc_disk_list (LAX_SCAN *scan, uint32_t ndisks) {
+    const uint32_t max_disks =
+	(ndisks + LAX_DISK_ROUND - 1) / LAX_DISK_ROUND * LAX_DISK_ROUND;
+    int alosize;
+    void *pool;
+
+    int status = exe_std$alononpaged(max_disks * (sizeof(UCB *) +
+						  sizeof(DDB *) +
+						  sizeof(uint32_t) + 16 +
+						  sizeof(bool)),
+				     &alosize, &pool);
+    if (!$VMS_STATUS_SUCCESS(status)) {
+	return false;
+    }
+
+    /* the old list is about to be rebuilt, so nothing in it is needed */
+    if (scan->disks != NULL) {
+	exe_std$deanonpaged(scan->disks);
+    }
+
+    scan->disks = (UCB **)pool;
+    scan->disk_ddb = (DDB **)&(scan->disks[max_disks]);
+    scan->disk_qlen = (uint32_t *)&(scan->disk_ddb[max_disks]);
+    scan->disk_name = (char (*)[16])&(scan->disk_qlen[max_disks]);
+    scan->disk_gone = (bool *)&(scan->disk_name[max_disks]);
+    scan->max_disks = max_disks;
+    return true;
+}
+
+static uint32_t lax_scan_disks (LAX_SCAN *scan, uint64_t now) {
+    uint32_t visited = 0;
+    uint32_t ndisks = lax_list_disks(scan, &visited);
+
+    if (ndisks > scan->max_disks && lax_alloc_disk_list(scan, ndisks)) {
+	ndisks = lax_list_disks(scan, &visited);
+    }
+
+    scan->disks_overflow = (ndisks > scan->max_disks);
+    scan->ndisks = scan->disks_overflow ? scan->max_disks : ndisks;
+    scan->disk_gen++;
+    scan->rescan = false;
+    scan->rescan_time = now + LAX_DISK_RESCAN * 10000000ULL;
+    return visited;
+}
+
+/*
+ * LAX_REMAP_DISKS - Move a unit's per-disk averages to a new disk list
+ *
+ * Functional description:
+ *
+ *   Rebuilds the per-disk averages in the bank of ucb$ps_disks that isn't
+ *   in use, in the order of the shared disk list, carrying over the
+ *   averages of disks that were already known, and then makes that bank
+ *   the current one. The list is in the same order from one scan to the
+ *   next, so each disk is looked for where the last one was found.
+ *
+ *   If the list is longer than the banks, both are allocated again from
+ *   nonpaged pool with as much room as the list has, and the old ones are
+ *   given back once the new bank is current. A reader may still be
+ *   copying the old bank then, but pool stays mapped, and the sequence
+ *   number is odd throughout, so the reader retries with the new one. If
+ *   there is no pool, the unit keeps the averages of as many disks as its
+ *   banks hold, and its record is marked as overflowed.
+ *
+ * Calling convention:
+ *
+ *   lax_remap_disks (ucb, scan)
+ *
+ * Input parameters:
+ *
+ *   ucb        Pointer to unit control block
+ *   scan       Pointer to the shared scan
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   None.
+ *
+ * Environment:
+ * 
+ *   Kernel mode, lax_scan.lock and device lock held, ucb$l_seq odd.
+ */
+
+static void lax_remap_disks (LAX_UCB *ucb, const LAX_SCAN *scan) {
+    const uint32_t bank = ucb->ucb$l_disk_bank;
+    const LAX_DISK_HDR *old_hdr = &(ucb->ucb$r_disk_hdr[bank]);
+    const LAX_DISK *old = ucb->ucb$ps_disks[bank];
+    LAX_DISK *new = ucb->ucb$ps_disks[bank ^ 1];
+    LAX_DISK *pool = NULL;
+    uint32_t count = scan->ndisks;
+    uint32_t flags = scan->disks_overflow ? LAX$M_DISKS_OVERFLOW : 0;
+    uint32_t next_old = 0;	/* scan order is stable, so try here first */
+
+    /* make room for the whole list if the banks are too small */
+    if (count > ucb->ucb$l_disk_max) {
+	const uint32_t size = 2 * scan->max_disks * sizeof(LAX_DISK);
+	int alosize;
+
+	int status = exe_std$alononpaged(size, &alosize, (void **)&pool);
+	if ($VMS_STATUS_SUCCESS(status)) {
+	    new = &pool[(bank ^ 1) * scan->max_disks];
+	} else {
+	    pool = NULL;
+	    count = ucb->ucb$l_disk_max;
+	    flags |= LAX$M_DISKS_OVERFLOW;
+	}
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+	const uint64_t id = (uint64_t)(__int64)scan->disks[i];
+	LAX_DISK *disk = &(new[i]);
+	uint32_t j = next_old;
+
+	/* look for this disk in the old list, starting where we left off */
+	for (uint32_t n = 0; n < old_hdr->lax$l_count; n++) {
+	    if (j >= old_hdr->lax$l_count) j = 0;
+	    if (old[j].lax$q_ucb == id) break;
+	    j++;
+	}
+
+	if (j < old_hdr->lax$l_count && old[j].lax$q_ucb == id) {
+	    *disk = old[j];
+	    next_old = j + 1;
+	} else {
+	    memset(disk, 0, sizeof(*disk));
+	    disk->lax$q_ucb = id;
+	    memcpy(disk->lax$t_name, scan->disk_name[i], sizeof(disk->lax$t_name));
+	}
+    }
+
+    /* readers take a bank's count as the room in it, so put the larger
+     * banks in place first
+     */
+    LAX_DISK *retired = NULL;
+    if (pool != NULL) {
+	retired = ucb->ucb$ps_disks[0];
+	ucb->ucb$ps_disks[0] = &pool[0];
+	ucb->ucb$ps_disks[1] = &pool[scan->max_disks];
+	ucb->ucb$l_disk_max = scan->max_disks;
+	__MB();
+    }
+
+    ucb->ucb$r_disk_hdr[bank ^ 1].lax$l_count = count;
+    ucb->ucb$r_disk_hdr[bank ^ 1].lax$l_flags = flags;
+    __MB();
+    ucb->ucb$l_disk_bank = bank ^ 1;
+    ucb->ucb$l_disk_gen = scan->disk_gen;
+
+    if (retired != NULL) {
+	exe_std$deanonpaged(retired);
+    }
+}
+
+/*
+ * LAX_FIND_DISKS - Check that the cached disks are still in the I/O database
+ *
+ * Functional description:
+ *
+ *   The disk list is kept from one hold of the IOC database mutex to the
+ *   next, and a UCB in it may have been deleted in between, as a shadow
+ *   set's virtual unit or an LD unit can be, so no cached UCB may be read
+ *   until it's found again. DDBs are never deleted, so each DDB's chain
+ *   of UCBs is followed from the DDB, and a cached UCB is only taken to
+ *   exist if it's on its DDB's chain. The list holds each DDB's disks
+ *   together, in the order of the chain, which units being added or
+ *   removed doesn't change, so one pass along each chain finds them all.
+ *
+ *   A disk that isn't found is marked gone, and the list is rebuilt on
+ *   the next scan; its UCB address still names it in the records until
+ *   then. Only the chains of DDBs with disks in the list are followed, not
+ *   every terminal and network device in the system.
+ *
+ * Calling convention:
+ *
+ *   visited = lax_find_disks (scan)
+ *
+ * Input parameters:
+ *
+ *   scan       Pointer to the shared scan
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   visited	Number of UCBs looked at
+ *
+ * Environment:
+ * 
+ *   Kernel mode, system context, IOC database mutex held for read.
+ */
+
+static uint32_t lax_find_disks (LAX_SCAN *scan) {
+    uint32_t visited = 0;
+    uint32_t i = 0;
+
+    while (i < scan->ndisks) {
+	const DDB *ddb = scan->disk_ddb[i];
+
+	for (const UCB *cur_ucb = ddb->ddb$ps_ucb;
+	     cur_ucb != NULL && i < scan->ndisks && scan->disk_ddb[i] == ddb;
+	     cur_ucb = cur_ucb->ucb$l_link) {
+	    visited++;
+
+	    /* a disk found here means the ones before it that weren't are
+	     * gone
+	     */
+	    for (uint32_t j = i; j < scan->ndisks &&
+				 scan->disk_ddb[j] == ddb; j++) {
+		if (cur_ucb == scan->disks[j]) {
+		    while (i < j) {
+			scan->disk_gone[i++] = true;
+			scan->rescan = true;
+		    }
+		    scan->disk_gone[i++] = false;
+		    break;
+		}
+	    }
+	}
+
+	/* the rest of this DDB's disks are gone */
+	while (i < scan->ndisks && scan->disk_ddb[i] == ddb) {
+	    scan->disk_gone[i++] = true;
+	    scan->rescan = true;
+	}
+    }
+
+    return visited;
+}
+
+/*
+ * LAX_DISK_QUEUE_LEN - Sum the I/O queue lengths of all mounted disks
+ *
+ * Functional description:
+ *
+ *   Adds up the queue lengths of the disks in the cached list, rebuilding
+ *   the list first if it's due, and saves each disk's queue length for the
+ *   units' per-disk averages. Drivers aren't told when the I/O database
+ *   changes, so the list is rebuilt every LAX_DISK_RESCAN seconds to pick up
+ *   newly mounted disks, and on the next scan after any disk in it is found
+ *   to be dismounted or deleted. A list kept from an earlier scan is
+ *   checked against the I/O database with lax_find_disks before any of
+ *   its UCBs are read. Disks left out of an overflowed list aren't
+ *   counted until a rebuild finds pool for them.
+ *
+ * Calling convention:
+ *
+ *   disk_queue_len = lax_disk_queue_len (scan, now, &visited)
+ *
+ * Input parameters:
+ *
+ *   scan       Pointer to the shared scan
+ *   now        exe$gq_systime of the scan
+ *
+ * Output parameters:
+ *
+ *   visited	Number of UCBs looked at, in the list and any scans
+ *
+ * Return value:
+ *
+ *   disk_queue_len	Total number of I/O requests queued to mounted disks
+ *
+ * Environment:
+ * 
+ *   Kernel mode, system context, IOC database mutex held for read.
+ */
 
-    ktb = sch$gq_pfwq;
-    while ((ktb = ktb->ktb$l_sqfl) != sch$gq_pfwq) {
-	proc_count++;
+static uint32_t lax_disk_queue_len (LAX_SCAN *scan, uint64_t now,
+				    uint32_t *visited) {
+    uint32_t disk_queue_len = 0;
+
+    if (scan->rescan || now >= scan->rescan_time) {
+	*visited = lax_scan_disks(scan, now);
+    } else {
+	*visited = lax_find_disks(scan);
     }
 
-    ktb = sch$gq_fpgwq;
-    while ((ktb = ktb->ktb$l_sqfl) != sch$gq_fpgwq) {
-	proc_count++;
+    for (uint32_t i = 0; i < scan->ndisks; i++) {
+	const UCB *disk = scan->disks[i];
+	uint32_t qlen = 0;
+
+	if (!scan->disk_gone[i] && lax_is_sampled_disk(disk)) {
+	    qlen = disk->ucb$l_qlen;
+	} else {
+	    scan->rescan = true;	    /* dismounted: rescan next time */
+	}
+
+	scan->disk_qlen[i] = qlen;	/* copied to the records later */
+	disk_queue_len += qlen;
     }
 
-    /* check active CPUs for running processes and their priorities */
-    uint32_t lowest_pri = UINT32_MAX;	/* first active CPU will replace this */
+    return disk_queue_len;
+}
+
+/*
+ * LAX_SCAN_CPUS - Count the CPUs that are running threads
+ *
+ * Functional description:
+ *
+ *   Counts the active CPUs that are running a kernel thread, and finds the
+ *   lowest priority among those threads, inverted so that 0 is the lowest.
+ *   Each running thread is also added to the count for its priority.
+ *
+ *   The active and idle CPU bitmask blocks are scanned a quadword at a
+ *   time, and only the bits of active CPUs that aren't idle are visited,
+ *   so the cost depends on the number of busy CPUs rather than on the
+ *   highest CPU ID.
+ *
+ * Calling convention:
+ *
+ *   count = lax_scan_cpus (&lowest_pri, prio_count)
+ *
+ * Input parameters:
+ *
+ *   None.
+ *
+ * Output parameters:
+ *
+ *   lowest_pri Lowest running priority, or UINT32_MAX if no CPU is
+ *              running a thread
+ *   prio_count Incremented for each running thread, indexed by internal
+ *              priority like the run queues
+ *
+ * Return value:
+ *
+ *   count      Number of CPUs running a thread
+ *
+ * Environment:
+ * 
+ *   Kernel mode, system context, SCHED spinlock held.
+ */
+
+static uint32_t lax_scan_cpus (uint32_t *lowest_pri, uint32_t prio_count[64]) {
+    const CBB *active = &smp$ar_active_set_cbb;
+    const CBB *idle = &sch$ar_idle_cpus_cbb;
+    uint32_t max_cpuid = smp$gl_max_cpuid;
+    uint32_t count = 0;
+    uint32_t lowest = UINT32_MAX;	/* first busy CPU will replace this */
+
+    if (max_cpuid >= active->cbb$l_valid_bits) {
+	max_cpuid = active->cbb$l_valid_bits - 1;
+    }
+
+    for (uint32_t word = 0; word <= (max_cpuid >> 6); word++) {
+	uint64_t busy = active->cbb$q_bits[word] & ~(idle->cbb$q_bits[word]);
+
+	/* drop any bits past the highest CPU ID */
+	if (word == (max_cpuid >> 6) && (max_cpuid & 63) != 63) {
+	    busy &= ((1ULL << ((max_cpuid & 63) + 1)) - 1);
+	}
 
-    /* TODO: support >64 CPUs using CBB instead of bitmask */
-    const uint64_t cpu_bitmask = (smp$gq_active_set & ~(sch$gq_idle_cpus));
-    const int max_cpuid = (smp$gl_max_cpuid > 63 ? 63 : smp$gl_max_cpuid);
+	while (busy != 0) {
+	    const uint32_t cpuid = (word << 6) + (uint32_t)_trailz(busy);
+	    busy &= (busy - 1);
 
-    uint64_t testmask = 0x01;
-    for (int cpuid = 0; cpuid <= max_cpuid; cpuid++, testmask <<= 1) {
-	if (cpu_bitmask & testmask) {
 	    /* assume this is non-NULL; otherwise, something's very wrong */
 	    const CPU *cpu = smp$gl_cpu_data[cpuid];
 
@@ -765,106 +3330,577 @@ static void lax_stats_update_int (void *fr3, LAX_UCB *ucb, TQE *tqe) {
 	     * Skip this CPU if the idle loop is trying to acquire SCHED.
 	     */
 	    if (cpu->cpu$l_cur_pri != UINT32_MAX && !(cpu->cpu$v_sched)) {
-		proc_count++;
+		count++;
+		prio_count[cpu->cpu$l_cur_pri & 63]++;
 
 		/* invert internal priority by subtracting from 63 */
 		uint32_t cur_pri = (63 - cpu->cpu$l_cur_pri);
-		if (cur_pri < lowest_pri) {
-		    lowest_pri = cur_pri;
+		if (cur_pri < lowest) {
+		    lowest = cur_pri;
 		}
 	    }
 	}
     }
 
-    /* get the sum of all disk queue lengths */
-    uint32_t disk_queue_len = UINT32_MAX;
-    UCB* cur_ucb = NULL;
-    DDB* cur_ddb = NULL;
+    *lowest_pri = lowest;
+    return count;
+}
+
+/*
+ * LAX_TAKE_SCAN - Scan the scheduler and I/O database
+ *
+ * Functional description:
+ *
+ *   Counts the runnable threads in each scheduler queue and the threads
+ *   running on each CPU, with their priorities, and the I/O requests
+ *   queued to each mounted disk, into the shared scan that every unit's
+ *   update takes its sample from.
+ *
+ * Calling convention:
+ *
+ *   lax_take_scan (scan, now, prof)
+ *
+ * Input parameters:
+ *
+ *   scan       Pointer to the shared scan
+ *   now        exe$gq_systime of this update
+ *   prof       Costs of this update so far
+ *
+ * Output parameters:
+ *
+ *   scan       The counts, and the state for the next scan
+ *   prof       Updated with the cost of the scan
+ *
+ * Return value:
+ *
+ *   None.
+ *
+ * Environment:
+ * 
+ *   Kernel mode, lax_scan.lock held.
+ */
+
+static void lax_take_scan (LAX_SCAN *scan, uint64_t now, LAX_TICK_PROF *prof) {
+    /* acquire the SCHED spinlock, so we can count runnable processes. */
+    int orig_ipl;
+    sys_lock (SCHED, RAISE_IPL, &orig_ipl);
+    uint64_t sched_start = LAX_CYCLES();
+
+    uint32_t *prio_count = scan->prio_count;	/* by internal priority, */
+						/*   0 = 63, until reversed */
+    uint32_t *class_count = scan->class_count;	/* by LAX$K_CLASS_xxx */
+    LAX_WALK walk = { 0 };
 
-    /* skip disk queue length update if we can't lock the IOC database */
-    if (!$VMS_STATUS_SUCCESS(sch_std$lockrexec_quad(&ioc$gq_mutex))) {
-	goto skip_scan_queue_len;
+    memset(scan->prio_count, 0, sizeof(scan->prio_count));
+    memset(scan->class_count, 0, sizeof(scan->class_count));
+    memset(scan->wait_count, 0, sizeof(scan->wait_count));
+    walk.budget = scan->walk_budget;
+    walk.limited = (walk.budget != 0);
+
+    /* now and then, walk everything to learn the depths of the queues the
+     * budget keeps cutting off
+     */
+    if (walk.limited && scan->approx && now >= scan->depth_time) {
+	walk.limited = false;
+	scan->depth_time = now + LAX_DEPTH_REFRESH * 10000000ULL;
     }
 
-    disk_queue_len = 0;	    /* distinguish between 0 and failure to lock mutex */
+    walk.missed_bit = -1;
 
-    /* this will return low bit clear when there are no more devices */
-    while ($VMS_STATUS_SUCCESS(
-	    ioc_std$scan_iodb(cur_ucb, cur_ddb, &cur_ucb, &cur_ddb))) {
-	/* is this a mounted disk and not a class driver or shadow set member? */
-	if ((cur_ucb->ucb$b_devclass == DC$_DISK) &&
-		(cur_ucb->ucb$l_devchar & DEV$M_MNT) &&
-		!(cur_ucb->ucb$l_devchar2 & (DEV$M_CDP | DEV$M_SSM)) &&
-		(cur_ucb->ucb$l_qlen > 0)) {
-	    disk_queue_len += cur_ucb->ucb$l_qlen;
+    /* Count the COM and COMO queues for each priority that's in use, and
+     * the three page-fault-related wait queues. Queue heads and tails
+     * alternate in the COM and COMO arrays, hence the stride of 2.
+     */
+
+    KTB* const waitq[3] = { sch$gq_colpgwq, sch$gq_pfwq, sch$gq_fpgwq };
+    KTB* const *heads[3] = { sch$aq_comh, sch$aq_comoh, waitq };
+    const int stride[3] = { 2, 2, 1 };
+    uint64_t summary[3] = { sch$gq_comqs, sch$gq_comoqs, 0 };
+
+    for (int i = 0; i < 3; i++) {
+	if (waitq[i]->ktb$l_sqfl != waitq[i]) {
+	    summary[2] |= (1ULL << i);
+	}
+    }
+
+    /* Start where the last tick ran out of budget, if it did, and treat
+     * the three sets as a single ring of queues so none of them starves.
+     */
+
+    const int first_set = scan->walk_set;
+    const uint64_t first_mask = (~0ULL << scan->walk_bit);
+
+    for (int pass = 0; pass <= 3; pass++) {
+	walk.set = (first_set + pass) % 3;
+	uint64_t mask = summary[walk.set];
+
+	if (pass == 0) {
+	    mask &= first_mask;
+	} else if (pass == 3) {
+	    mask &= ~first_mask;
 	}
+
+	/* the page wait queues aren't ordered by priority, so they're
+	 * counted by queue instead. The sets are in the same order as
+	 * LAX$K_CLASS_COM, _COMO and _PGWAIT.
+	 */
+	class_count[walk.set] +=
+	    lax_walk_queues(mask, heads[walk.set], stride[walk.set],
+			    scan->qdepth[walk.set],
+			    (walk.set < 2) ? prio_count : scan->wait_count,
+			    &walk);
+    }
+
+    if (walk.missed_bit >= 0) {
+	scan->walk_set = walk.missed_set;
+	scan->walk_bit = walk.missed_bit;
+    } else {
+	scan->walk_set = 0;
+	scan->walk_bit = 0;
     }
 
-    /* lock and unlock mutex need to acquire SCHED, so do both before releasing it */
-    sch_std$unlockexec_quad(&ioc$gq_mutex);
+    /* check active CPUs for running processes and their priorities */
+    class_count[LAX$K_CLASS_RUNNING] = lax_scan_cpus(&scan->lowest_pri,
+						     prio_count);
+
+    scan->proc_count = class_count[LAX$K_CLASS_COM] + class_count[LAX$K_CLASS_COMO] +
+		 class_count[LAX$K_CLASS_PGWAIT] + class_count[LAX$K_CLASS_RUNNING];
 
-skip_scan_queue_len:
+    /* Lock the IOC database for read, so the disk UCBs can't go away while
+     * we look at them. Lock and unlock mutex need to acquire SCHED, so take
+     * it here while we still hold SCHED, and briefly again to unlock it.
+     */
+    bool have_iodb = $VMS_STATUS_SUCCESS(sch_std$lockrexec_quad(&ioc$gq_mutex));
 
     /* release the SCHED spinlock */
+    prof->sched = (uint32_t)(LAX_CYCLES() - sched_start);
     sys_unlock (SCHED, orig_ipl, SMP_RESTORE);
 
+    /* get the sum of all disk queue lengths, or skip disk queue length
+     * update if we couldn't lock the IOC database.
+     */
+    scan->disk_queue_len = UINT32_MAX;
+
+    if (have_iodb) {
+	scan->disk_queue_len = lax_disk_queue_len(scan, now, &prof->ucbs);
+
+	sys_lock (SCHED, RAISE_IPL, &orig_ipl);
+	sched_start = LAX_CYCLES();
+	sch_std$unlockexec_quad(&ioc$gq_mutex);
+	prof->sched += (uint32_t)(LAX_CYCLES() - sched_start);
+	sys_unlock (SCHED, orig_ipl, SMP_RESTORE);
+    } else {
+	prof->iodb_busy = true;
+    }
+    prof->ktbs = walk.walked;
+    scan->approx = walk.approx;
+    scan->ktbs_walked = walk.walked;
+    scan->ktbs_estimated = walk.estimated;
+
+    /* put the run queue counts in the order of the priority averages */
+    for (int pri = 0; pri < 32; pri++) {
+	const uint32_t count = prio_count[pri];
+
+	prio_count[pri] = prio_count[63 - pri];
+	prio_count[63 - pri] = count;
+    }
+
+    /* the memory counters need no lock; a torn read can't happen on an
+     * aligned longword, and the free count only needs to be close
+     */
+    const int64_t free_pages = sch$gi_freecnt;
+
+    scan->free_pages = (free_pages < 0) ? 0 :
+		       (free_pages > UINT32_MAX) ? UINT32_MAX : (uint32_t)free_pages;
+    scan->faults = pms$gl_faults;
+    scan->time = now;
+}
+
+/*
+ * LAX_STATS_UPDATE_INT - Periodic update of load averages
+ *
+ * Functional description:
+ *
+ *   This routine updates the load average data once per sampling period,
+ *   which is once a second unless changed with LAX$K_CMD_PERIOD, or once
+ *   every LAX$K_IDLE_PERIOD_MS while the unit is idle, then queues the next
+ *   tick unless updates were stopped. The shared scan's lock keeps
+ *   it from running at the same time as another unit's tick or an update
+ *   taken for a read.
+ *
+ * Calling convention:
+ *
+ *   lax_stats_update_int (fr3, ucb, tqe)
+ *
+ * Input parameters:
+ *
+ *   fr3	Unused
+ *   ucb        Pointer to unit control block
+ *   tqe        Pointer to TQE used to time request
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   None.
+ *
+ * Environment:
+ * 
+ *   Kernel mode, system context, at timer IPL.
+ */
+
+static void lax_stats_update_int (void *fr3, LAX_UCB *ucb, TQE *tqe) {
+    int lock_ipl;
+
+    device_lock (lax_scan.lock, RAISE_IPL, &lock_ipl);
+    lax_update(ucb, false);
+    if (!ucb->ucb$b_is_stopped) {
+	lax_queue_tick(ucb);
+    }
+    device_unlock (lax_scan.lock, lock_ipl, SMP_RESTORE);
+}
+
+/*
+ * LAX_QUEUE_TICK - Queue the next timer tick
+ *
+ * Functional description:
+ *
+ *   Queues the unit's TQE for the next multiple of its delta in system
+ *   time: the period, or LAX$K_IDLE_PERIOD_MS while idle. Every unit's
+ *   ticks fall on the same grid, so units whose ticks are due together
+ *   run together and can share a scan, even after a change of period
+ *   or a late tick, which a repeating TQE would carry forward.
+ *
+ * Calling convention:
+ *
+ *   lax_queue_tick (ucb)
+ *
+ * Input parameters:
+ *
+ *   ucb        Pointer to unit control block
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   None.
+ *
+ * Environment:
+ * 
+ *   Kernel mode, lax_scan.lock held or unit being initialized, TQE not
+ *   queued.
+ */
+
+static void lax_queue_tick (LAX_UCB *ucb) {
+    const uint64_t delta = ucb->ucb$l_tqe.tqe$q_delta;
+    const uint64_t tick_time = (exe$gq_systime / delta + 1) * delta;
+
+    exe_std$instimq((int) (tick_time & 0xffffffff),
+		    (int) ((tick_time >> 32) & 0xffffffff),
+		    (TQE *) &ucb->ucb$l_tqe);
+}
+
+/*
+ * LAX_SAMPLE_ON_DEMAND - Update the load averages for a read
+ *
+ * Functional description:
+ *
+ *   Called by lax_read while the unit is idle, so the reader gets values
+ *   as fresh as the timer would have kept them. If the last update is
+ *   less than a period old, because another read got here first, or if
+ *   updates are being stopped, nothing is done. The new sample stands for
+ *   the whole time since the last update, so the averages decay over that
+ *   time as they would have at full rate with this load throughout.
+ *
+ * Calling convention:
+ *
+ *   lax_sample_on_demand (ucb)
+ *
+ * Input parameters:
+ *
+ *   ucb        Pointer to unit control block
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   None.
+ *
+ * Environment:
+ * 
+ *   Kernel mode, user process context, IPL 2.
+ */
+
+static void lax_sample_on_demand (LAX_UCB *ucb) {
+    const uint64_t period = (uint64_t)ucb->ucb$l_period_ms * 10000;
+    int lock_ipl;
+
+    device_lock (lax_scan.lock, RAISE_IPL, &lock_ipl);
+    if (ucb->ucb$b_is_idle && !ucb->ucb$b_is_stopping &&
+	!ucb->ucb$b_is_stopped &&
+	exe$gq_systime - ucb->ucb$q_tick_time >= period) {
+	lax_update(ucb, true);
+    }
+    device_unlock (lax_scan.lock, lock_ipl, SMP_RESTORE);
+}
+
+/*
+ * LAX_UPDATE - Update the load averages
+ *
+ * Functional description:
+ *
+ *   Takes a sample of the run queues, CPUs and disks, and updates the
+ *   averages with it. The algorithm is the same as the original LAXDRIVER,
+ *   except that the system load average is not divided by the number of
+ *   active CPUs, and the values are all returned as 32-bit unsigned
+ *   integers representing fixed-point values with a binary scaling factor
+ *   of 14 bits.
+ *
+ *   Only the timer's updates stop the updates when asked to, and decide
+ *   whether the unit is idle.
+ *
+ * Calling convention:
+ *
+ *   lax_update (ucb, on_demand)
+ *
+ * Input parameters:
+ *
+ *   ucb        Pointer to unit control block
+ *   on_demand  True if this update is for a read, not the timer
+ *
+ * Output parameters:
+ *
+ *   None.
+ *
+ * Return value:
+ *
+ *   None.
+ *
+ * Environment:
+ * 
+ *   Kernel mode, lax_scan.lock held.
+ */
+
+static void lax_update (LAX_UCB *ucb, bool on_demand) {
+    const bool idle = on_demand || ucb->ucb$b_is_idle;
+    const uint64_t now = exe$gq_systime;
+    const LAX_SCAN *scan = &lax_scan;
+    LAX_TICK_PROF prof = { 0 };
+    int orig_ipl;
+
+    prof.start = LAX_CYCLES();
+    prof.unscheduled = idle;
+
+    /* scan the scheduler and I/O database, unless another unit just did */
+    if (lax_scan.time == 0 || now < lax_scan.time ||
+	now - lax_scan.time >= LAX_SCAN_SHARE * 10000ULL) {
+	lax_take_scan(&lax_scan, now, &prof);
+    } else {
+	prof.shared = true;
+    }
+
+    const uint32_t proc_count = scan->proc_count;
+    const uint32_t *prio_count = scan->prio_count;
+    const uint32_t *class_count = scan->class_count;
+    const uint32_t disk_queue_len = scan->disk_queue_len;
+    uint32_t lowest_pri = scan->lowest_pri;
+
+    /* Decay the averages by the time since the last tick, if that wasn't
+     * one period. Only this routine sets ucb$q_tick_time, and a restart
+     * clears it while no ticks are coming, so it can be read unlocked;
+     * the period, windows and coefficients are only changed under
+     * lax_scan.lock, which is held here, as well as the device lock.
+     */
+    const uint64_t last_tick = ucb->ucb$q_tick_time;
+    const LAX_COEF *coef = ucb->ucb$r_coef;
+    const LAX_COEF64 *coef64 = ucb->ucb$r_coef64;
+    LAX_COEF late_coef[3];
+    LAX_COEF64 late_coef64[3];
+
+    prof.interval = (last_tick != 0 && now > last_tick) ? now - last_tick : 0;
+    if (lax_elapsed_coef(prof.interval, ucb->ucb$l_period_ms,
+			 ucb->ucb$l_window_s, late_coef, late_coef64)) {
+	coef = late_coef;
+	coef64 = late_coef64;
+    }
+
     /* acquire the UCB device lock, raising IPL, saving previous IPL */
     device_lock (ucb->ucb$r_ucb.ucb$l_dlck, RAISE_IPL, &orig_ipl);
 
+    /* make readers retry any copy that overlaps the changes below */
+    ucb->ucb$l_seq++;
+    __MB();
+    ucb->ucb$q_tick_time = now;
+
+    /* move this unit's disk averages over to a new disk list */
+    if (disk_queue_len != UINT32_MAX && ucb->ucb$l_disk_gen != scan->disk_gen) {
+	lax_remap_disks(ucb, scan);
+    }
+
+    /* record how the run queue count was obtained, and how long ago the
+     * last sample was
+     */
+    uint32_t flags = scan->approx ? LAX$M_APPROX : 0;
+
+    if (idle) {
+	flags |= LAX$M_IDLE;
+    }
+
+    if (last_tick == 0) {
+	flags |= LAX$M_RESTARTED;
+    } else if (prof.interval >
+	       (uint64_t)ucb->ucb$l_period_ms * 10000 * LAX_STALE_PERIODS) {
+	flags |= LAX$M_STALE;
+    }
+    ucb->ucb$r_status.lax$l_flags = flags;
+    ucb->ucb$r_status.lax$l_walk_budget = scan->walk_budget;
+    ucb->ucb$r_status.lax$l_ktbs_walked = scan->ktbs_walked;
+    ucb->ucb$r_status.lax$l_ktbs_estimated = scan->ktbs_estimated;
+    ucb->ucb$r_status.lax$l_period_ms = ucb->ucb$l_period_ms;
+    memcpy(ucb->ucb$r_status.lax$l_window_s, ucb->ucb$l_window_s,
+	   sizeof(ucb->ucb$r_status.lax$l_window_s));
+    ucb->ucb$r_status.lax$l_idle_s = ucb->ucb$l_idle_s;
+
     /* bail out now if the user asked us to stop updating */
-    if (ucb->ucb$b_is_stopping) {
+    if (ucb->ucb$b_is_stopping && !on_demand) {
 	ucb->ucb$b_is_stopping = false;
 	ucb->ucb$b_is_stopped = true;
 
+	/* a restart ticks at the period's rate until it sees who's reading */
+	ucb->ucb$b_is_idle = false;
+	ucb->ucb$l_tqe.tqe$q_delta = (uint64_t)ucb->ucb$l_period_ms * 10000;
+
 	/* all 0 bits is +0.0 in IEEE-754 */
     	memset(&(ucb->ucb$fx_avgs), 0, sizeof(ucb->ucb$fx_avgs));
+	memset(&(ucb->ucb$q_avgs), 0, sizeof(ucb->ucb$q_avgs));
+	memset(&(ucb->ucb$fx_prio_avgs), 0, sizeof(ucb->ucb$fx_prio_avgs));
+	memset(&(ucb->ucb$fx_class_avgs), 0, sizeof(ucb->ucb$fx_class_avgs));
+	memset(&(ucb->ucb$r_memory.lax$q_avgs), 0,
+	       sizeof(ucb->ucb$r_memory.lax$q_avgs));
+	ucb->ucb$q_fault_time = 0;	/* the rate starts over, too */
+
+	/* the peaks start over too, when updates are restarted */
+	if (ucb->ucb$ps_peakq != NULL) {
+	    for (int i = 0; i < 4; i++) {
+		memset(&(ucb->ucb$ps_peakq[i]), 0,
+		       offsetof(LAX_PEAK_Q, slots));
+	    }
+	}
+	memset(&(ucb->ucb$r_peaks), 0, sizeof(ucb->ucb$r_peaks));
 
-	/* cancel the timer */
-	tqe->tqe$b_rqtype = 0;
-
-	goto unlock;	/* release device lock and return */
-    }
-
-    proc_count <<= FX_LSHIFT;
-    ucb->ucb$fx_avgs[0] = (uint32_t)(((((uint64_t)ucb->ucb$fx_avgs[0]) * old_lav_1min) +
-				((uint64_t)proc_count * new_lav_1min)) >> FX_RSHIFT);
+	const uint32_t bank = ucb->ucb$l_disk_bank;
+	for (uint32_t i = 0; i < ucb->ucb$r_disk_hdr[bank].lax$l_count; i++) {
+	    memset(ucb->ucb$ps_disks[bank][i].lax$fx_avgs, 0,
+		   sizeof(ucb->ucb$ps_disks[bank][i].lax$fx_avgs));
+	}
 
-    ucb->ucb$fx_avgs[1] = (uint32_t)(((((uint64_t)ucb->ucb$fx_avgs[1]) * old_lav_5min) +
-				((uint64_t)proc_count * new_lav_5min)) >> FX_RSHIFT);
+	/* nothing will change from now on, so don't keep anyone waiting */
+	lax_check_waits(ucb, true);
 
-    ucb->ucb$fx_avgs[2] = (uint32_t)(((((uint64_t)ucb->ucb$fx_avgs[2]) * old_lav_15min) +
-				((uint64_t)proc_count * new_lav_15min)) >> FX_RSHIFT);
+	goto unlock;	/* release device lock; no more ticks are queued */
+    }
 
+    /* Save the raw sample in the ring, invalidating the slot first so a
+     * reader copying it without the lock can tell it changed.
+     */
+    const uint32_t seq = ucb->ucb$l_sample_seq;
+    LAX_SAMPLE *sample = &(ucb->ucb$r_samples[seq & (LAX_SAMPLE_RING - 1)]);
+
+    sample->lax$l_seq = 0;
+    __MB();
+    sample->lax$q_time = now;
+    sample->lax$l_flags = ucb->ucb$r_status.lax$l_flags;
+    sample->lax$l_proc_count = proc_count;
+    sample->lax$l_lowest_pri = lowest_pri;	/* UINT32_MAX is LAX$K_NO_PRI */
+    sample->lax$l_disk_qlen = disk_queue_len;	/* and LAX$K_NO_QLEN */
+    sample->lax$l_period_ms = ucb->ucb$l_period_ms;
+    __MB();
+    sample->lax$l_seq = seq;
+    __MB();
+    ucb->ucb$l_sample_seq = (seq + 1) ? seq + 1 : 1;	/* 0 means oldest */
+
+    /* The nine classic averages are three metrics of three windows each,
+     * the disk queue length last so it can be left out if we failed to
+     * lock the IOC database mutex.
+     */
     if (lowest_pri == UINT32_MAX) {
 	lowest_pri = 0;	    /* no CPUs are running processes */
-    } else {
-	lowest_pri <<= FX_LSHIFT;
     }
-    ucb->ucb$fx_avgs[3] = (uint32_t)(((((uint64_t)ucb->ucb$fx_avgs[3]) * old_lav_1min) +
-				((uint64_t)lowest_pri * new_lav_1min)) >> FX_RSHIFT);
+    const uint32_t main_samples[3] = { proc_count, lowest_pri, disk_queue_len };
+    const uint32_t main_count = (disk_queue_len != UINT32_MAX) ? 3 : 2;
 
-    ucb->ucb$fx_avgs[4] = (uint32_t)(((((uint64_t)ucb->ucb$fx_avgs[4]) * old_lav_5min) +
-				((uint64_t)lowest_pri * new_lav_5min)) >> FX_RSHIFT);
+    lax_ewma_update(ucb->ucb$fx_avgs, 3, main_samples, main_count, coef, 3);
+    lax_ewma_update64(ucb->ucb$q_avgs, 3, main_samples, main_count, coef64, 3);
 
-    ucb->ucb$fx_avgs[5] = (uint32_t)(((((uint64_t)ucb->ucb$fx_avgs[5]) * old_lav_15min) +
-				((uint64_t)lowest_pri * new_lav_15min)) >> FX_RSHIFT);
+    /* and each class of thread that makes it up, and each priority */
+    lax_ewma_update(ucb->ucb$fx_class_avgs[0], 3, class_count, 4, coef, 3);
+    lax_ewma_update(ucb->ucb$fx_prio_avgs[0], 3, prio_count, 64, coef, 3);
 
-    /* skip this section if we failed to lock the IOC database mutex */
-    if (disk_queue_len != UINT32_MAX) {
-	disk_queue_len <<= FX_LSHIFT;
+    /* and memory pressure. The fault rate is measured between the scans
+     * this unit used, and left out, last, until there are two of them.
+     */
+    LAX_MEMORY *mem = &(ucb->ucb$r_memory);
+    uint32_t mem_count = LAX$K_MEM_FAULT_RATE;
+
+    memcpy(mem->lax$l_sample, scan->wait_count, sizeof(scan->wait_count));
+    mem->lax$l_sample[LAX$K_MEM_FREE] = scan->free_pages;
+    if (ucb->ucb$q_fault_time != 0 && scan->time > ucb->ucb$q_fault_time) {
+	const uint64_t faults = (uint32_t)(scan->faults - ucb->ucb$l_faults);
+	const uint64_t rate = faults * 10000000 /
+			      (scan->time - ucb->ucb$q_fault_time);
+
+	mem->lax$l_sample[LAX$K_MEM_FAULT_RATE] =
+	    (rate > UINT32_MAX) ? UINT32_MAX : (uint32_t)rate;
+	mem_count = LAX$K_MEM_COUNT;
+    }
+    ucb->ucb$l_faults = scan->faults;
+    ucb->ucb$q_fault_time = scan->time;
+    lax_ewma_update64(mem->lax$q_avgs[0], 3, mem->lax$l_sample, mem_count,
+		      coef64, 3);
+
+    /* and the averages for each disk */
+    const uint32_t disk_count =
+	ucb->ucb$r_disk_hdr[ucb->ucb$l_disk_bank].lax$l_count;
+    if (disk_queue_len != UINT32_MAX && disk_count != 0) {
+	LAX_DISK *disks = ucb->ucb$ps_disks[ucb->ucb$l_disk_bank];
+	for (uint32_t i = 0; i < disk_count; i++) {
+	    disks[i].lax$l_qlen = scan->disk_qlen[i];
+	}
+	lax_ewma_update(disks[0].lax$fx_avgs,
+			sizeof(LAX_DISK) / sizeof(uint32_t),
+			scan->disk_qlen, disk_count, coef, 3);
+    }
 
-	ucb->ucb$fx_avgs[6] = (uint32_t)(((((uint64_t)ucb->ucb$fx_avgs[6]) * old_lav_1min) +
-				    ((uint64_t)disk_queue_len * new_lav_1min)) >> FX_RSHIFT);
+    /* and the sliding window peaks, once someone has asked for them */
+    if (ucb->ucb$ps_peakq != NULL) {
+	lax_track_peaks(ucb, now, proc_count, disk_queue_len);
+    }
 
-	ucb->ucb$fx_avgs[7] = (uint32_t)(((((uint64_t)ucb->ucb$fx_avgs[7]) * old_lav_5min) +
-				    ((uint64_t)disk_queue_len * new_lav_5min)) >> FX_RSHIFT);
+    /* complete any threshold waits the new values satisfy */
+    lax_check_waits(ucb, false);
 
-	ucb->ucb$fx_avgs[8] = (uint32_t)(((((uint64_t)ucb->ucb$fx_avgs[8]) * old_lav_15min) +
-				    ((uint64_t)disk_queue_len * new_lav_15min)) >> FX_RSHIFT);
+    /* and slow the timer down if nobody's reading, or speed it back up */
+    if (!on_demand) {
+	lax_check_idle(ucb, now);
     }
 
 unlock:
 
+    /* what this tick cost, not counting the last few steps */
+    lax_profile_tick(ucb, &prof);
+
+    /* let readers of the global section see the new values */
+    lax_publish(ucb);
+
+    __MB();
+    ucb->ucb$l_seq++;
+
     /* Release the UCB device lock, returning to the previous IPL */
     device_unlock (ucb->ucb$r_ucb.ucb$l_dlck, orig_ipl, SMP_RESTORE);
 }
@@ -0,0 +1,456 @@
+/*
+ * Host-side (Linux) mock of the OpenVMS kernel globals and system routines
+ * that LAXDRIVER reads, for benchmarking the driver in user mode.
+ *
+ * The scheduler queues, per-CPU data and I/O database are synthetic, built
+ * on demand by the lax_host_build_* routines. Spinlocks are real enough to
+ * be used from several threads, and the SCHED spinlock records how long it
+ * was held on each acquisition.
+ *
+ * Copyright 2022, Jake Hamby.
+ * MIT License.
+ */
+
+#include "laxhost.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* Kernel globals, with the same names and shapes the driver declares */
+
+uint64_t exe$gq_systime = 0x00a0000000000000ULL;  /* some time in the 1990s */
+uint32_t mmg$gl_page_size = 8192;
+
+uint64_t sch$gq_comqs;
+uint64_t sch$gq_comoqs;
+KTB *sch$aq_comh[128];
+KTB *sch$aq_comoh[128];
+
+KTB *sch$gq_colpgwq;
+KTB *sch$gq_pfwq;
+KTB *sch$gq_fpgwq;
+
+int64_t sch$gi_freecnt = 65536;		/* 512 MB of 8 KB pages */
+uint32_t pms$gl_faults;
+
+uint32_t smp$gl_max_cpuid;
+CBB smp$ar_active_set_cbb;
+CBB sch$ar_idle_cpus_cbb;
+CPU *smp$gl_cpu_data[LAX_HOST_MAX_CPUS];
+
+MUTEX ioc$gq_mutex;
+
+/* The prototype driver tables, pulled in from a library on VMS and
+ * filled in by driver$init_tables
+ */
+
+DPT driver$dpt;
+DDT driver$ddt;
+FDT driver$fdt;
+
+LAX_HOST_HOLD lax_host_sched_hold = { 0, 0, UINT64_MAX, 0, 0 };
+
+/* Private mock state */
+
+static KTB  queue_heads[2 * 64 + 3];	/* COM, COMO and wait queue sentinels */
+static KTB *ktb_pool;			/* every synthetic KTB */
+static CPU  cpu_pool[LAX_HOST_MAX_CPUS];
+static DDB *ddb_pool;
+static UCB *ucb_pool;
+static DDB *first_ddb;
+static SPL  sched_lock;
+static SPL  iolock8;
+static uint64_t sched_t0;
+
+uint64_t lax_host_nanotime (void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* CPU cycle counter where there is one, otherwise nanoseconds */
+
+uint64_t lax_host_cycles (void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ volatile ("mrs %0, cntvct_el0" : "=r" (ticks));
+    return ticks;
+#else
+    return lax_host_nanotime();
+#endif
+}
+
+static void spin_acquire (SPL *lock) {
+    while (__atomic_exchange_n(&lock->spl$l_own_cnt, 1, __ATOMIC_ACQUIRE)) {
+	while (__atomic_load_n(&lock->spl$l_own_cnt, __ATOMIC_RELAXED))
+	    ;
+    }
+}
+
+static void spin_release (SPL *lock) {
+    __atomic_store_n(&lock->spl$l_own_cnt, 0, __ATOMIC_RELEASE);
+}
+
+void lax_host_sys_lock (int spl, int raise, int *saved_ipl) {
+    *saved_ipl = 0;
+    if (spl == SPL$C_SCHED) {
+	spin_acquire(&sched_lock);
+	sched_t0 = lax_host_nanotime();
+    }
+}
+
+void lax_host_sys_unlock (int spl, int new_ipl, int restore) {
+    if (spl == SPL$C_SCHED) {
+	uint64_t held = lax_host_nanotime() - sched_t0;
+	LAX_HOST_HOLD *h = &lax_host_sched_hold;
+
+	h->count++;
+	h->last_ns = held;
+	h->total_ns += held;
+	if (held < h->min_ns) h->min_ns = held;
+	if (held > h->max_ns) h->max_ns = held;
+	spin_release(&sched_lock);
+    }
+}
+
+void lax_host_fork_lock (int spl, int *saved_ipl) {
+    *saved_ipl = 0;
+    if (spl == SPL$C_IOLOCK8) {
+	spin_acquire(&iolock8);
+    }
+}
+
+void lax_host_fork_unlock (int spl, int new_ipl, int restore) {
+    if (spl == SPL$C_IOLOCK8) {
+	spin_release(&iolock8);
+    }
+}
+
+int smp_std$alloc_spl (SPL **spl, int ipl, int rank) {
+    *spl = calloc(1, sizeof(SPL));
+    return (*spl != NULL) ? SS$_NORMAL : 0;
+}
+
+void lax_host_device_lock (SPL *lock, int raise, int *saved_ipl) {
+    *saved_ipl = 0;
+    spin_acquire(lock);
+}
+
+void lax_host_device_unlock (SPL *lock, int new_ipl, int restore) {
+    spin_release(lock);
+}
+
+void lax_host_reset_hold (void) {
+    memset(&lax_host_sched_hold, 0, sizeof(lax_host_sched_hold));
+    lax_host_sched_hold.min_ns = UINT64_MAX;
+}
+
+/* System routines */
+
+int exe_std$instimq (int time_lo, int time_hi, TQE *tqe) {
+    tqe->tqe$q_time = ((uint64_t)(uint32_t)time_hi << 32) | (uint32_t)time_lo;
+    return SS$_NORMAL;
+}
+
+int exe_std$readchk (IRP *irp, PCB *pcb, UCB *ucb, void *buf, int len) {
+    return SS$_NORMAL;
+}
+
+int exe_std$writechk (IRP *irp, PCB *pcb, UCB *ucb, void *buf, int len) {
+    return SS$_NORMAL;
+}
+
+int exe_std$abortio (IRP *irp, PCB *pcb, UCB *ucb, int status) {
+    irp->irp$l_iost1 = status;
+    irp->irp$l_iost2 = 0;
+    return SS$_FDT_COMPL;
+}
+
+int exe_std$finishio (IRP *irp, UCB *ucb, int iost1, int iost2) {
+    irp->irp$l_iost1 = iost1;
+    irp->irp$l_iost2 = iost2;
+    return SS$_FDT_COMPL;
+}
+
+int exe_std$alononpaged (int reqsize, int *alosize, void **pool) {
+    *pool = calloc(1, reqsize);
+    if (*pool == NULL)
+	return 0;
+    *alosize = reqsize;
+    return SS$_NORMAL;
+}
+
+void exe_std$deanonpaged (void *pool) {
+    free(pool);
+}
+
+PTE_PQ lax_host_svapte (VOID_PQ va) {
+    static PTE pte;
+    pte.pte$v_pfn = (uintptr_t)va / mmg$gl_page_size;
+    return &pte;
+}
+
+int exe_std$qioreturn (IRP *irp) {
+    return SS$_FDT_COMPL;
+}
+
+uint64_t lax_host_posted;
+IRP *lax_host_last_post;
+
+void com_std$post (IRP *irp, UCB *ucb) {
+    lax_host_posted++;
+    lax_host_last_post = irp;
+}
+
+int sch_std$lockrexec_quad (MUTEX *mutex) {
+    if (mutex->mutex$q_owncnt != 0)
+	return 0;			/* held for write: fail */
+    return SS$_NORMAL;
+}
+
+void sch_std$unlockexec_quad (MUTEX *mutex) {
+}
+
+/* Walk the I/O database one UCB at a time, like the real routine. */
+
+int ioc_std$scan_iodb (UCB *ucb, DDB *ddb, UCB **new_ucb, DDB **new_ddb) {
+    if (ucb == NULL) {
+	ddb = first_ddb;
+	ucb = ddb ? ddb->ddb$ps_ucb : NULL;
+    } else {
+	ucb = ucb->ucb$l_link;
+    }
+
+    while (ucb == NULL && ddb != NULL) {
+	ddb = ddb->ddb$ps_link;
+	ucb = ddb ? ddb->ddb$ps_ucb : NULL;
+    }
+
+    *new_ucb = ucb;
+    *new_ddb = ddb;
+    return ucb ? SS$_NORMAL : 0;
+}
+
+/*
+ * Synthetic state builders
+ */
+
+static void init_queue (KTB *head) {
+    head->ktb$l_sqfl = head->ktb$l_sqbl = head;
+}
+
+static void insque_tail (KTB *head, KTB *ktb) {
+    ktb->ktb$l_sqfl = head;
+    ktb->ktb$l_sqbl = head->ktb$l_sqbl;
+    head->ktb$l_sqbl->ktb$l_sqfl = ktb;
+    head->ktb$l_sqbl = ktb;
+}
+
+/* Spread count KTBs round-robin across the priority bits set in mask,
+ * setting the matching summary bits. Bit 0 is priority 63.
+ */
+static void fill_queues (KTB *heads, KTB *pool, int count, uint64_t mask,
+			 uint64_t *summary) {
+    int idx = 0;
+
+    *summary = 0;
+    if (mask == 0)
+	return;
+
+    for (int i = 0; i < count; i++) {
+	while (!(mask & (1ULL << idx)))
+	    idx = (idx + 1) & 63;
+	pool[i].ktb$l_pri = 63 - idx;
+	insque_tail(&heads[idx], &pool[i]);
+	*summary |= (1ULL << idx);
+	idx = (idx + 1) & 63;
+    }
+}
+
+void lax_host_build_runq (int com_ktbs, int como_ktbs, int pgw_ktbs,
+			  uint64_t prio_mask) {
+    KTB *com_heads = &queue_heads[0];
+    KTB *como_heads = &queue_heads[64];
+    KTB *wait_heads = &queue_heads[128];
+
+    free(ktb_pool);
+    ktb_pool = calloc(com_ktbs + como_ktbs + pgw_ktbs + 1, sizeof(KTB));
+    if (!ktb_pool) {
+	perror("calloc");
+	exit(EXIT_FAILURE);
+    }
+
+    for (int i = 0; i < 64; i++) {
+	init_queue(&com_heads[i]);
+	init_queue(&como_heads[i]);
+	sch$aq_comh[i << 1] = &com_heads[i];
+	sch$aq_comh[(i << 1) + 1] = &com_heads[i];
+	sch$aq_comoh[i << 1] = &como_heads[i];
+	sch$aq_comoh[(i << 1) + 1] = &como_heads[i];
+    }
+    for (int i = 0; i < 3; i++)
+	init_queue(&wait_heads[i]);
+
+    sch$gq_colpgwq = &wait_heads[0];
+    sch$gq_pfwq = &wait_heads[1];
+    sch$gq_fpgwq = &wait_heads[2];
+
+    KTB *pool = ktb_pool;
+    fill_queues(com_heads, pool, com_ktbs, prio_mask, &sch$gq_comqs);
+    pool += com_ktbs;
+    fill_queues(como_heads, pool, como_ktbs, prio_mask, &sch$gq_comoqs);
+    pool += como_ktbs;
+
+    for (int i = 0; i < pgw_ktbs; i++)
+	insque_tail(&wait_heads[i % 3], &pool[i]);
+}
+
+/* Make cpus CPUs active, the first busy of which are running a thread. */
+
+void lax_host_build_cpus (int cpus, int busy) {
+    if (cpus > LAX_HOST_MAX_CPUS)
+	cpus = LAX_HOST_MAX_CPUS;
+
+    memset(cpu_pool, 0, sizeof(cpu_pool));
+    memset(smp$gl_cpu_data, 0, sizeof(smp$gl_cpu_data));
+    memset(&smp$ar_active_set_cbb, 0, sizeof(CBB));
+    memset(&sch$ar_idle_cpus_cbb, 0, sizeof(CBB));
+    smp$ar_active_set_cbb.cbb$l_valid_bits = LAX_HOST_MAX_CPUS;
+    sch$ar_idle_cpus_cbb.cbb$l_valid_bits = LAX_HOST_MAX_CPUS;
+    smp$gl_max_cpuid = cpus ? cpus - 1 : 0;
+
+    for (int i = 0; i < cpus; i++) {
+	smp$gl_cpu_data[i] = &cpu_pool[i];
+	if (i < busy) {
+	    cpu_pool[i].cpu$l_cur_pri = 63 - (4 + (i % 12));
+	} else {
+	    cpu_pool[i].cpu$l_cur_pri = UINT32_MAX;
+	}
+	smp$ar_active_set_cbb.cbb$q_bits[i / 64] |= (1ULL << (i % 64));
+	if (i >= busy)
+	    sch$ar_idle_cpus_cbb.cbb$q_bits[i / 64] |= (1ULL << (i % 64));
+    }
+}
+
+/* Build an I/O database of disks mounted disks (every tenth of them a
+ * shadow set member) followed by others terminal-class devices, eight
+ * units per DDB.
+ */
+
+void lax_host_build_iodb (int disks, int others) {
+    int total = disks + others;
+    int nddb = (total + 7) / 8;
+
+    free(ddb_pool);
+    free(ucb_pool);
+    ddb_pool = calloc(nddb + 1, sizeof(DDB));
+    ucb_pool = calloc(total + 1, sizeof(UCB));
+    if (!ddb_pool || !ucb_pool) {
+	perror("calloc");
+	exit(EXIT_FAILURE);
+    }
+
+    first_ddb = total ? &ddb_pool[0] : NULL;
+
+    for (int i = 0; i < total; i++) {
+	UCB *ucb = &ucb_pool[i];
+	DDB *ddb = &ddb_pool[i / 8];
+
+	if (i % 8 == 0) {
+	    const char *name = (i < disks) ? "DKA" : "TNA";
+	    ddb->ddb$t_name[0] = 3;
+	    memcpy(&ddb->ddb$t_name[1], name, 3);
+	    ddb->ddb$ps_ucb = ucb;
+	    if (i / 8 + 1 < nddb)
+		ddb->ddb$ps_link = &ddb_pool[i / 8 + 1];
+	} else {
+	    ucb_pool[i - 1].ucb$l_link = ucb;
+	}
+
+	ucb->ucb$l_ddb = ddb;
+	ucb->ucb$w_unit = (i % 8) * 100;
+	if (i < disks) {
+	    ucb->ucb$b_devclass = DC$_DISK;
+	    ucb->ucb$l_devchar = DEV$M_MNT | DEV$M_AVL | DEV$M_SHR;
+	    ucb->ucb$l_devchar2 = (i % 10 == 9) ? DEV$M_SSM : 0;
+	    ucb->ucb$l_qlen = i % 4;
+	} else {
+	    ucb->ucb$b_devclass = DC$_TERM;
+	    ucb->ucb$l_devchar = DEV$M_REC | DEV$M_AVL;
+	}
+    }
+}
+
+/* Driver units */
+
+void lax_host_unit_init (UCB *ucb) {
+    static bool loaded;
+    static IDB idb;
+
+    if (!loaded) {
+	driver$init_tables();
+	loaded = true;
+    }
+    if (ucb->ucb$l_dlck == NULL) {
+	ucb->ucb$l_dlck = calloc(1, sizeof(SPL));
+	if (ucb->ucb$l_dlck == NULL) {
+	    perror("calloc");
+	    exit(EXIT_FAILURE);
+	}
+    }
+
+    driver$dpt.dpt$ps_init_pd(NULL, NULL, &idb, NULL, ucb);
+    driver$ddt.ddt$ps_unitinit(&idb, ucb);
+}
+
+int lax_host_read (UCB *ucb, void *buf, uint32_t len, uint32_t rec_code,
+		   uint32_t p4) {
+    PCB pcb;
+    IRP irp;
+
+    memset(&pcb, 0, sizeof(pcb));
+    memset(&irp, 0, sizeof(irp));
+    irp.irp$q_qio_p1 = (uint64_t)buf;
+    irp.irp$l_qio_p2 = len;
+    irp.irp$l_qio_p3 = rec_code;
+    irp.irp$l_qio_p4 = p4;
+    driver$fdt.fdt$ps_func_rtn[IO$_READVBLK](&irp, &pcb, ucb, NULL);
+    return irp.irp$l_iost1;
+}
+
+int lax_host_write (UCB *ucb, const void *buf, uint32_t len, uint32_t cmd) {
+    PCB pcb;
+    IRP irp;
+
+    memset(&pcb, 0, sizeof(pcb));
+    memset(&irp, 0, sizeof(irp));
+    pcb.pcb$q_priv = PRV$M_CMKRNL;
+    irp.irp$q_qio_p1 = (uint64_t)buf;
+    irp.irp$l_qio_p2 = len;
+    irp.irp$l_qio_p3 = cmd;
+    driver$fdt.fdt$ps_func_rtn[IO$_WRITEVBLK](&irp, &pcb, ucb, NULL);
+    return irp.irp$l_iost1;
+}
+
+/* Random numbers */
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ULL;
+
+void lax_host_seed (uint64_t seed) {
+    rng_state = seed;
+}
+
+uint64_t lax_host_random64 (void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return rng_state;
+}
+
+uint32_t lax_host_random (void) {
+    return (uint32_t)(lax_host_random64() >> 32);
+}
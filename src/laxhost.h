@@ -0,0 +1,351 @@
+/*
+ * Host-side (Linux) stand-ins for the OpenVMS kernel headers, data
+ * structures and system routines used by LAXDRIVER.
+ *
+ * This lets laxdriver.c be compiled and exercised as ordinary user-mode
+ * code, so the cost of the timer callback can be measured against
+ * synthetic scheduler queues and I/O databases. Only the fields and
+ * routines that the driver actually touches are defined here, and the
+ * layouts have nothing to do with the real VMS structures.
+ *
+ * Build the driver with LAX_HOST defined to pick up this header instead
+ * of the SYS$LIB_C.TLB modules. The mock kernel lives in laxhost.c.
+ *
+ * Copyright 2022, Jake Hamby.
+ * MIT License.
+ */
+
+#ifndef LAXHOST_H
+#define LAXHOST_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* DEC C extensions */
+
+#define __int64		long long
+typedef char *		CHAR_PQ;	/* 64-bit char pointer */
+typedef void *		VOID_PQ;	/* 64-bit void pointer */
+
+/* Alpha/IA64 bit-scan, multiply and memory barrier builtins from builtins.h */
+
+#define _leadz(x)	((__int64)((x) ? __builtin_clzll(x) : 64))
+#define _trailz(x)	((__int64)__builtin_ctzll(x))
+#define _popcnt(x)	((__int64)__builtin_popcountll(x))
+#define __MB()		__atomic_thread_fence(__ATOMIC_SEQ_CST)
+#define __UMULH(a, b)	((uint64_t)(((unsigned __int128)(a) * (b)) >> 64))
+
+/* Status codes and the success test from stsdef.h */
+
+#define SS$_NORMAL	1
+#define SS$_BADPARAM	20
+#define SS$_ABORT	44
+#define SS$_DEVOFFLINE	132
+#define SS$_CANCEL	2096
+#define SS$_NOPRIV	36
+#define SS$_ENDOFFILE	2160
+#define SS$_DEVINACT	8404
+#define SS$_FDT_COMPL	8417
+
+#define $VMS_STATUS_SUCCESS(code)	(((code) & 1) != 0)
+
+/* I/O function codes */
+
+#define IO$_WRITEPBLK	11
+#define IO$_READPBLK	12
+#define IO$_WRITELBLK	32
+#define IO$_READLBLK	33
+#define IO$_WRITEVBLK	48
+#define IO$_READVBLK	49
+
+/* Device classes and characteristics */
+
+#define DC$_DISK	1
+#define DC$_TERM	66
+#define DC$_MISC	160
+
+#define DEV$M_REC	0x00000001
+#define DEV$M_SHR	0x00010000
+#define DEV$M_AVL	0x00040000
+#define DEV$M_MNT	0x00080000
+#define DEV$M_IDV	0x04000000
+
+#define DEV$M_CDP	0x00000002	/* devchar2: class driver port */
+#define DEV$M_NNM	0x00000200	/* devchar2: prefix with node name */
+#define DEV$M_SSM	0x00004000	/* devchar2: shadow set member */
+
+/* Privileges, pool and timer constants */
+
+#define PRV$M_CMKRNL	0x0000000000000001ULL
+
+#define AT$_NULL	0
+#define DYN$C_TQE	15
+#define TQE$C_LENGTH	64
+#define TQE$C_SSSNGL	1
+#define TQE$C_SSREPT	5
+
+#define SPL$C_IOLOCK8	8
+#define SPL$C_SCHED	9
+#define IOC$K_DEVICE_IPL 21
+#define IPL$_IOLOCK8	8
+
+#define RAISE_IPL	1
+#define NORAISE_IPL	0
+#define SMP_RESTORE	1
+
+/* Kernel data structures */
+
+typedef struct _spl {
+    volatile int spl$l_own_cnt;		/* 0 = free, 1 = held */
+} SPL;
+
+typedef struct _ktb {
+    struct _ktb *ktb$l_sqfl;		/* state queue forward link */
+    struct _ktb *ktb$l_sqbl;		/* state queue backward link */
+    uint32_t	 ktb$l_pri;		/* current internal priority */
+} KTB;
+
+typedef struct _cpu {
+    uint32_t	cpu$l_cur_pri;		/* current priority, -1 if idle */
+    unsigned	cpu$v_sched : 1;	/* idle loop wants SCHED */
+} CPU;
+
+#define LAX_HOST_MAX_CPUS	1024
+
+typedef struct _cbb {
+    uint32_t	cbb$l_valid_bits;	/* number of bits in use */
+    uint64_t	cbb$q_bits[LAX_HOST_MAX_CPUS / 64];
+} CBB;
+
+typedef struct _mutex {
+    uint64_t	mutex$q_owncnt;
+} MUTEX;
+
+typedef struct _tqe {
+    struct _tqe	*tqe$l_tqfl;
+    struct _tqe	*tqe$l_tqbl;
+    uint16_t	tqe$w_size;
+    uint8_t	tqe$b_type;
+    uint8_t	tqe$b_rqtype;
+    void	(*tqe$l_fpc)();		/* timer routine */
+    __int64	tqe$q_fr3;
+    __int64	tqe$q_fr4;
+    uint64_t	tqe$q_time;
+    uint64_t	tqe$q_delta;
+} TQE;
+
+struct _ddb;
+
+typedef struct _ucb {
+    struct _ucb	*ucb$l_link;		/* next UCB on the same DDB */
+    struct _ddb	*ucb$l_ddb;		/* owning DDB */
+    SPL		*ucb$l_dlck;		/* device lock */
+    uint32_t	ucb$l_devchar;
+    uint32_t	ucb$l_devchar2;
+    uint32_t	ucb$l_qlen;		/* I/O queue length */
+    uint16_t	ucb$w_unit;
+    uint16_t	ucb$w_devbufsiz;
+    uint8_t	ucb$b_devclass;
+    uint8_t	ucb$b_flck;
+    uint8_t	ucb$b_dipl;
+    unsigned	ucb$v_online : 1;
+} UCB;
+
+typedef struct _crb { int crb$l_dummy; } CRB;
+typedef struct _orb { int orb$l_dummy; } ORB;
+typedef struct _ccb { int ccb$l_dummy; } CCB;
+
+typedef struct _idb {
+    UCB		*idb$ps_owner;
+} IDB;
+
+typedef struct _ddb {
+    struct _ddb	*ddb$ps_link;		/* next DDB */
+    UCB		*ddb$ps_ucb;		/* first UCB */
+    struct _ddt	*ddb$ps_ddt;
+    char	ddb$t_name[16];		/* counted ASCII device name */
+} DDB;
+
+typedef struct _pte {
+    uint64_t	pte$v_pfn;		/* page frame number */
+} PTE;
+
+typedef PTE *		PTE_PQ;
+
+typedef struct _pcb {
+    uint64_t	pcb$q_priv;
+    uint32_t	pcb$l_pid;
+} PCB;
+
+typedef struct _irp {
+    struct _irp	*irp$l_ioqfl;		/* I/O queue forward link */
+    uint32_t	irp$l_pid;		/* requesting process */
+    int		irp$l_chan;		/* channel index */
+    uint64_t	irp$q_qio_p1;
+    uint32_t	irp$l_qio_p2;
+    uint32_t	irp$l_qio_p3;
+    uint32_t	irp$l_qio_p4;
+    uint32_t	irp$l_qio_p5;
+    uint32_t	irp$l_qio_p6;
+    int		irp$l_iost1;		/* final status, set on completion */
+    int		irp$l_iost2;
+} IRP;
+
+/* Driver tables. The ini_* macros below fill in the routines the mock
+ * kernel calls, by function code for the FDT.
+ */
+
+typedef void LAX_HOST_STRUC_INIT (CRB *crb, DDB *ddb, IDB *idb, ORB *orb,
+				  UCB *ucb);
+typedef int  LAX_HOST_UNITINIT (IDB *idb, UCB *ucb);
+typedef void LAX_HOST_CANCEL (int chan, IRP *irp, PCB *pcb, UCB *ucb,
+			      int reason);
+typedef int  LAX_HOST_FDT_RTN (IRP *irp, PCB *pcb, UCB *ucb, CCB *ccb);
+
+typedef struct _dpt {
+    LAX_HOST_STRUC_INIT *dpt$ps_init_pd;
+    LAX_HOST_STRUC_INIT *dpt$ps_reinit_pd;
+} DPT;
+
+typedef struct _ddt {
+    LAX_HOST_UNITINIT *ddt$ps_unitinit;
+    LAX_HOST_CANCEL *ddt$ps_cancel;
+} DDT;
+
+typedef struct _fdt {
+    LAX_HOST_FDT_RTN *fdt$ps_func_rtn[64];
+} FDT;
+
+extern DPT driver$dpt;
+extern DDT driver$ddt;
+extern FDT driver$fdt;
+
+int driver$init_tables (void);
+
+/* Spinlocks. Only SCHED, the IOLOCK8 fork lock and dynamic spinlocks
+ * such as device locks are modelled; SCHED hold times are accumulated by
+ * the mock kernel for the benchmark.
+ */
+
+int  smp_std$alloc_spl (SPL **spl, int ipl, int rank);
+
+void lax_host_sys_lock (int spl, int raise, int *saved_ipl);
+void lax_host_sys_unlock (int spl, int new_ipl, int restore);
+void lax_host_fork_lock (int spl, int *saved_ipl);
+void lax_host_fork_unlock (int spl, int new_ipl, int restore);
+void lax_host_device_lock (SPL *lock, int raise, int *saved_ipl);
+void lax_host_device_unlock (SPL *lock, int new_ipl, int restore);
+
+#define sys_lock(name, raise, ipl)	lax_host_sys_lock (SPL$C_##name, raise, ipl)
+#define sys_unlock(name, ipl, rst)	lax_host_sys_unlock (SPL$C_##name, ipl, rst)
+#define fork_lock(idx, ipl)		lax_host_fork_lock (idx, ipl)
+#define fork_unlock(idx, ipl, rst)	lax_host_fork_unlock (idx, ipl, rst)
+#define device_lock(lck, raise, ipl)	lax_host_device_lock (lck, raise, ipl)
+#define device_unlock(lck, ipl, rst)	lax_host_device_unlock (lck, ipl, rst)
+
+/* System routines */
+
+int  exe_std$instimq (int time_lo, int time_hi, TQE *tqe);
+int  exe_std$readchk (IRP *irp, PCB *pcb, UCB *ucb, void *buf, int len);
+int  exe_std$writechk (IRP *irp, PCB *pcb, UCB *ucb, void *buf, int len);
+int  exe_std$abortio (IRP *irp, PCB *pcb, UCB *ucb, int status);
+int  exe_std$alononpaged (int reqsize, int *alosize, void **pool);
+void exe_std$deanonpaged (void *pool);
+int  exe_std$finishio (IRP *irp, UCB *ucb, int iost1, int iost2);
+int  exe_std$qioreturn (IRP *irp);
+void com_std$post (IRP *irp, UCB *ucb);
+int  ioc_std$scan_iodb (UCB *ucb, DDB *ddb, UCB **new_ucb, DDB **new_ddb);
+int  sch_std$lockrexec_quad (MUTEX *mutex);
+void sch_std$unlockexec_quad (MUTEX *mutex);
+
+/* Page table lookup: the mock PFN is just the address over the page size */
+
+PTE_PQ lax_host_svapte (VOID_PQ va);
+
+#define pte_va(va)			(va)
+#define va_pte_to_svapte(pte)		lax_host_svapte (pte)
+
+#define call_abortio(irp, pcb, ucb, sts)	exe_std$abortio (irp, pcb, ucb, sts)
+#define call_finishio(irp, ucb, s1, s2)		exe_std$finishio (irp, ucb, s1, s2)
+#define call_qioreturn(irp)			exe_std$qioreturn (irp)
+
+/* Driver table initialization, keeping only the routines */
+
+#define ini_dpt_name(dpt, name)		((void)(dpt), (void)(name))
+#define ini_dpt_adapt(dpt, type)	((void)(dpt), (void)(type))
+#define ini_dpt_defunits(dpt, n)	((void)(dpt), (void)(n))
+#define ini_dpt_maxunits(dpt, n)	((void)(dpt), (void)(n))
+#define ini_dpt_ucbsize(dpt, size)	((void)(dpt), (void)(size))
+#define ini_dpt_struc_init(dpt, rtn) \
+    ((dpt)->dpt$ps_init_pd = (LAX_HOST_STRUC_INIT *)(rtn))
+#define ini_dpt_struc_reinit(dpt, rtn) \
+    ((dpt)->dpt$ps_reinit_pd = (LAX_HOST_STRUC_INIT *)(rtn))
+#define ini_dpt_end(dpt)		((void)(dpt))
+#define ini_ddt_unitinit(ddt, rtn) \
+    ((ddt)->ddt$ps_unitinit = (LAX_HOST_UNITINIT *)(rtn))
+#define ini_ddt_cancel(ddt, rtn) \
+    ((ddt)->ddt$ps_cancel = (LAX_HOST_CANCEL *)(rtn))
+#define ini_ddt_end(ddt)		((void)(ddt))
+#define ini_fdt_act(fdt, func, rtn, type) \
+    ((fdt)->fdt$ps_func_rtn[func] = (LAX_HOST_FDT_RTN *)(rtn))
+#define ini_fdt_end(fdt)		((void)(fdt))
+
+/*
+ * Mock kernel control, implemented in laxhost.c.
+ */
+
+/* Statistics for SCHED spinlock hold times, in nanoseconds */
+
+typedef struct {
+    uint64_t	count;			/* number of acquisitions */
+    uint64_t	last_ns;		/* duration of the last hold */
+    uint64_t	min_ns;
+    uint64_t	max_ns;
+    uint64_t	total_ns;
+} LAX_HOST_HOLD;
+
+extern LAX_HOST_HOLD lax_host_sched_hold;
+
+void lax_host_reset_hold (void);
+
+/* I/O requests completed by com_std$post, and the last one posted */
+
+extern uint64_t lax_host_posted;
+extern IRP *lax_host_last_post;
+
+/* Build synthetic kernel state. Each call frees what the previous one built. */
+
+void lax_host_build_runq (int com_ktbs, int como_ktbs, int pgw_ktbs,
+			  uint64_t prio_mask);
+void lax_host_build_cpus (int cpus, int busy);
+void lax_host_build_iodb (int disks, int others);
+
+/* Connect a unit of the driver compiled into the program, as IO CONNECT
+ * would, through its tables: the first call initializes them, then the
+ * unit gets a device lock of its own, and all units share one IDB.
+ */
+
+void lax_host_unit_init (UCB *ucb);
+
+/* Issue a $QIO to a unit through the driver's FDT routines, with the
+ * same P1 to P4, and return the I/O status. Writes are made with CMKRNL.
+ * LAX$K_REC_WAIT reads, which complete later, can't be issued this way.
+ */
+
+int  lax_host_read (UCB *ucb, void *buf, uint32_t len, uint32_t rec_code,
+		    uint32_t p4);
+int  lax_host_write (UCB *ucb, const void *buf, uint32_t len, uint32_t cmd);
+
+/* A repeatable xorshift64 random number generator for the tests, with a
+ * fixed seed unless given one
+ */
+
+void     lax_host_seed (uint64_t seed);
+uint64_t lax_host_random64 (void);
+uint32_t lax_host_random (void);
+
+uint64_t lax_host_nanotime (void);
+uint64_t lax_host_cycles (void);
+
+#endif /* LAXHOST_H */
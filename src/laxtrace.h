@@ -0,0 +1,36 @@
+/*
+ * Trace files of LAXDRIVER's raw samples.
+ *
+ * trace-lax-driver drains the driver's ring of raw samples (see
+ * LAX$K_REC_SAMPLES in laxdef.h) into a trace file, and replay-lax-trace
+ * feeds a trace back through the driver's averaging code on Linux, with
+ * whatever windows are asked for. A trace is this header followed by
+ * LAX_SAMPLE records exactly as the driver returns them, oldest first,
+ * in the byte order of the system that recorded it (little-endian on
+ * both Alpha and x86). Samples lost because the collector fell behind
+ * show up as gaps in the sequence numbers, and a collector restarted on
+ * the same file may repeat some; readers skip those.
+ *
+ * Copyright 2022, Jake Hamby.
+ * MIT License.
+ */
+
+#ifndef LAXTRACE_H
+#define LAXTRACE_H
+
+#include <stdint.h>
+
+#include "laxdef.h"
+
+#define LAX$K_TRACE_MAGIC	"LAXTRACE"
+#define LAX$K_TRACE_VERSION	1
+
+typedef struct {
+    char	lax$t_magic[8];		/* LAX$K_TRACE_MAGIC, not terminated */
+    uint16_t	lax$w_version;		/* LAX$K_TRACE_VERSION */
+    uint16_t	lax$w_size;		/* size of this header */
+    uint32_t	lax$l_sample_size;	/* size of each LAX_SAMPLE that follows */
+    uint64_t	lax$q_created;		/* system time the file was started */
+} LAX_TRACE_HDR;
+
+#endif /* LAXTRACE_H */
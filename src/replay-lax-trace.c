@@ -0,0 +1,396 @@
+/*
+ * Host-side (Linux) replay of LAXDRIVER trace files.
+ *
+ * Feeds the raw samples in a trace recorded by trace-lax-driver (see
+ * laxtrace.h) through the driver's own averaging routines, as
+ * lax_stats_update_int does, with any three averaging windows, and prints
+ * the nine averages at regular intervals of trace time. That shows what
+ * the load averages would have been with other windows without
+ * rerunning the load. Coefficients follow the sampling period recorded
+ * with each sample, and the time between samples when a tick was late or
+ * some were lost, so traces that span a change of period or a stall
+ * replay the way the driver ran them. A sample flagged LAX$M_RESTARTED
+ * starts the averages over from 0, as the driver did.
+ *
+ *   replay-lax-trace [-w s1,s2,s3] [-e seconds] [-x] trace
+ *
+ *   -w		averaging windows in seconds, 60,300,900 by default
+ *   -e		print the averages every so many seconds of trace time, 60
+ *		by default; 0 prints only the last
+ *   -x		print the 64-bit averages to more places instead of the
+ *		classic 32-bit ones
+ *
+ * Times are printed as the VMS system recorded them, in its local time.
+ * The number of samples replayed, any missing or repeated, and how many
+ * were replayed a second are printed on stderr at the end.
+ *
+ *   replay-lax-trace -r ticks trace
+ *
+ * runs the driver compiled into this program on the mock kernel for that
+ * many ticks of changing load, with a change of period half way through
+ * and some late ticks, records its samples into the trace file as trace-lax-driver would, and
+ * checks that replaying the trace gives exactly the driver's averages.
+ *
+ * Build on Linux with:
+ *
+ *   cc -O2 -o replay-lax-trace replay-lax-trace.c laxhost.c
+ *
+ * Copyright 2022, Jake Hamby.
+ * MIT License.
+ */
+
+#define LAX_HOST 1
+
+#include "laxdriver.c"
+#include "laxtrace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define REPLAY_CHUNK	65536		/* samples read from the file at once */
+
+/* VMS system time of the Unix epoch, in 100 ns units since 17-Nov-1858 */
+
+#define VMS_UNIX_EPOCH	35067168000000000ULL
+
+typedef struct {
+    uint32_t	window_s[3];
+    uint32_t	period_ms;		/* period the coefficients are for */
+    LAX_COEF	coef[3];
+    LAX_COEF64	coef64[3];
+    uint32_t	fx_avgs[9];		/* as ucb$fx_avgs */
+    uint64_t	q_avgs[9];		/*   and ucb$q_avgs */
+    uint32_t	last_seq;
+    uint64_t	last_time;		/* system time of the last sample */
+    uint64_t	samples;		/* samples replayed */
+    uint64_t	missing;		/* gaps in the sequence numbers */
+    uint64_t	repeated;		/* samples seen before */
+    uint64_t	nanoseconds;		/* time spent replaying */
+} REPLAY;
+
+/* Pick coefficients the way lax_set_period does: from the generated table
+ * for the standard windows, whose 32-bit weights are rounded a little
+ * differently from computed ones, and computed for any others.
+ */
+
+static void replay_set_period (REPLAY *r, uint32_t period_ms) {
+    int period = -1;
+
+    for (int i = 0; i < LAXCOEF_NPERIODS; i++) {
+	if (lax_coef_period_ms[i] == period_ms) {
+	    period = i;
+	}
+    }
+
+    r->period_ms = period_ms;
+    for (int w = 0; w < 3; w++) {
+	if (period >= 0 && r->window_s[w] == lax_coef_window_s[w]) {
+	    r->coef[w] = lax_coef_table[period][w];
+	    r->coef64[w] = lax_coef64_table[period][w];
+	} else {
+	    lax_compute_coef(period_ms, r->window_s[w], &r->coef[w], &r->coef64[w]);
+	}
+    }
+}
+
+/* Replay one sample: the averaging part of lax_stats_update_int */
+
+static inline void replay_sample (REPLAY *r, const LAX_SAMPLE *s) {
+    if (r->samples != 0) {
+	const uint32_t expect = (r->last_seq + 1) ? r->last_seq + 1 : 1;
+	const uint32_t ahead = s->lax$l_seq - expect;
+
+	if (ahead >= 0x80000000) {
+	    r->repeated++;
+	    return;
+	}
+	r->missing += ahead;
+    }
+    r->last_seq = s->lax$l_seq;
+    r->samples++;
+
+    if (s->lax$l_period_ms != r->period_ms) {
+	replay_set_period(r, s->lax$l_period_ms);
+    }
+
+    /* decay by the time since the last sample, as the driver does */
+    const LAX_COEF *coef = r->coef;
+    const LAX_COEF64 *coef64 = r->coef64;
+    LAX_COEF late_coef[3];
+    LAX_COEF64 late_coef64[3];
+    uint64_t interval = 0;
+
+    if (s->lax$l_flags & LAX$M_RESTARTED) {
+	memset(r->fx_avgs, 0, sizeof(r->fx_avgs));
+	memset(r->q_avgs, 0, sizeof(r->q_avgs));
+    } else if (r->last_time != 0 && s->lax$q_time > r->last_time) {
+	interval = s->lax$q_time - r->last_time;
+    }
+    r->last_time = s->lax$q_time;
+    if (lax_elapsed_coef(interval, r->period_ms, r->window_s, late_coef,
+			 late_coef64)) {
+	coef = late_coef;
+	coef64 = late_coef64;
+    }
+
+    const uint32_t lowest_pri = (s->lax$l_lowest_pri == LAX$K_NO_PRI) ?
+				0 : s->lax$l_lowest_pri;
+    const uint32_t samples[3] = { s->lax$l_proc_count, lowest_pri,
+				  s->lax$l_disk_qlen };
+    const uint32_t count = (s->lax$l_disk_qlen != LAX$K_NO_QLEN) ? 3 : 2;
+
+    lax_ewma_update(r->fx_avgs, 3, samples, count, coef, 3);
+    lax_ewma_update64(r->q_avgs, 3, samples, count, coef64, 3);
+}
+
+static void replay_print (const REPLAY *r, uint64_t vms_time, bool wide) {
+    const time_t t = (time_t)((vms_time - VMS_UNIX_EPOCH) / 10000000);
+    struct tm tm;
+    char when[32];
+
+    gmtime_r(&t, &tm);
+    strftime(when, sizeof(when), "%Y-%m-%d %H:%M:%S", &tm);
+    printf("%s", when);
+    for (int i = 0; i < 9; i++) {
+	if (wide) {
+	    printf(" %11.6f", (double)r->q_avgs[i] / 4294967296.0);
+	} else {
+	    printf(" %6.2f", (double)r->fx_avgs[i] / (1 << FX_SCALE));
+	}
+    }
+    printf("\n");
+}
+
+static void replay_heading (const REPLAY *r, bool wide) {
+    static const char *metrics[3] = { "load", "pri", "diskq" };
+
+    printf("%-19s", "time");
+    for (int m = 0; m < 3; m++) {
+	for (int w = 0; w < 3; w++) {
+	    char label[24];
+
+	    snprintf(label, sizeof(label), "%s %us", metrics[m], r->window_s[w]);
+	    printf(wide ? " %11s" : " %6s", label);
+	}
+    }
+    printf("\n");
+}
+
+static bool replay_open (const char *path, FILE **fpp) {
+    LAX_TRACE_HDR hdr;
+    FILE *fp = fopen(path, "rb");
+
+    if (fp == NULL) {
+	perror(path);
+	return false;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	memcmp(hdr.lax$t_magic, LAX$K_TRACE_MAGIC, sizeof(hdr.lax$t_magic)) != 0 ||
+	hdr.lax$w_version != LAX$K_TRACE_VERSION ||
+	hdr.lax$l_sample_size != sizeof(LAX_SAMPLE)) {
+	fprintf(stderr, "%s: not a version %d LAX trace\n", path, LAX$K_TRACE_VERSION);
+	fclose(fp);
+	return false;
+    }
+    fseek(fp, hdr.lax$w_size, SEEK_SET);
+    *fpp = fp;
+    return true;
+}
+
+/* Replay a whole trace file, printing every interval seconds if asked */
+
+static bool replay_file (const char *path, REPLAY *r, uint32_t interval,
+			 bool print, bool wide) {
+    static LAX_SAMPLE chunk[REPLAY_CHUNK];
+    const uint64_t every = (uint64_t)interval * 10000000;
+    uint64_t next_print = 0;
+    uint64_t last_time = 0;
+    FILE *fp;
+    size_t n;
+
+    if (!replay_open(path, &fp)) {
+	return false;
+    }
+    if (print) {
+	replay_heading(r, wide);
+    }
+
+    while ((n = fread(chunk, sizeof(LAX_SAMPLE), REPLAY_CHUNK, fp)) != 0) {
+	const uint64_t t0 = lax_host_nanotime();
+
+	for (size_t i = 0; i < n; i++) {
+	    const LAX_SAMPLE *s = &chunk[i];
+
+	    replay_sample(r, s);
+	    last_time = s->lax$q_time;
+	    if (print && every != 0 && s->lax$q_time >= next_print) {
+		replay_print(r, s->lax$q_time, wide);
+		next_print = s->lax$q_time - (s->lax$q_time % every) + every;
+	    }
+	}
+	r->nanoseconds += lax_host_nanotime() - t0;
+    }
+    fclose(fp);
+
+    if (print && r->samples != 0 && (every == 0 || last_time + 1 != next_print)) {
+	replay_print(r, last_time, wide);
+    }
+    return true;
+}
+
+/* Record a trace from the driver compiled in, then check the replay */
+
+static LAX_UCB record_ucb;
+
+static bool record_drain (FILE *fp, uint32_t *next_seq) {
+    static struct {
+	LAX_SAMPLE_HDR hdr;
+	LAX_SAMPLE sample[64];
+    } samples;
+
+    do {
+	int status = lax_host_read((UCB *)&record_ucb, &samples,
+				   sizeof(samples), LAX$K_REC_SAMPLES,
+				   *next_seq);
+
+	if (!(status & 1) || samples.hdr.lax$l_lost != 0) {
+	    fprintf(stderr, "read of samples failed or lost some\n");
+	    return false;
+	}
+	if (fwrite(samples.sample, sizeof(LAX_SAMPLE), samples.hdr.lax$l_count, fp) !=
+	    samples.hdr.lax$l_count) {
+	    perror("fwrite");
+	    return false;
+	}
+	*next_seq = samples.hdr.lax$l_next_seq;
+    } while (samples.hdr.lax$l_count == 64);
+    return true;
+}
+
+static int record_and_check (uint32_t ticks, const char *path) {
+    LAX_TRACE_HDR hdr;
+    uint32_t next_seq = 0;
+    FILE *fp = fopen(path, "wb");
+
+    if (fp == NULL) {
+	perror(path);
+	return EXIT_FAILURE;
+    }
+
+    lax_host_build_runq(100, 10, 3, 0xffff000000000000ULL);
+    lax_host_build_cpus(32, 16);
+    lax_host_build_iodb(16, 100);
+    lax_host_unit_init((UCB *)&record_ucb);
+
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.lax$t_magic, LAX$K_TRACE_MAGIC, sizeof(hdr.lax$t_magic));
+    hdr.lax$w_version = LAX$K_TRACE_VERSION;
+    hdr.lax$w_size = sizeof(hdr);
+    hdr.lax$l_sample_size = sizeof(LAX_SAMPLE);
+    hdr.lax$q_created = exe$gq_systime;
+    fwrite(&hdr, sizeof(hdr), 1, fp);
+
+    srand(1);
+    for (uint32_t tick = 0; tick < ticks; tick++) {
+	if (tick == ticks / 2) {
+	    lax_set_period(&record_ucb, 250);
+	}
+	if (tick % 32 == 0) {
+	    lax_host_build_runq(rand() % 400, rand() % 40, rand() % 10,
+				0xffff000000000000ULL >> (rand() % 8));
+	}
+	/* and one tick in ten up to three periods late */
+	uint64_t period = (uint64_t)record_ucb.ucb$l_period_ms * 10000;
+	if (tick % 10 == 9) {
+	    period += period * (uint64_t)(rand() % 300) / 100;
+	}
+	exe$gq_systime += period;
+	lax_stats_update_int(NULL, &record_ucb, &record_ucb.ucb$l_tqe);
+
+	if (tick % 256 == 255 && !record_drain(fp, &next_seq)) {
+	    return EXIT_FAILURE;
+	}
+    }
+    if (!record_drain(fp, &next_seq) || fclose(fp) != 0) {
+	return EXIT_FAILURE;
+    }
+
+    REPLAY r;
+    memset(&r, 0, sizeof(r));
+    memcpy(r.window_s, record_ucb.ucb$l_window_s, sizeof(r.window_s));
+    if (!replay_file(path, &r, 0, false, false)) {
+	return EXIT_FAILURE;
+    }
+
+    const bool same = r.samples == ticks && r.missing == 0 &&
+		      !memcmp(r.fx_avgs, record_ucb.ucb$fx_avgs, sizeof(r.fx_avgs)) &&
+		      !memcmp(r.q_avgs, record_ucb.ucb$q_avgs, sizeof(r.q_avgs));
+
+    printf("%u ticks recorded in %s, %llu samples replayed: %s\n", ticks, path,
+	(unsigned long long)r.samples, same ? "same averages as the driver" :
+	"DIFFERENT averages from the driver");
+    return same ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static void usage (const char *prog) {
+    fprintf(stderr, "usage: %s [-w s1,s2,s3] [-e seconds] [-x] trace\n", prog);
+    fprintf(stderr, "       %s -r ticks trace\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+int main (int argc, char *argv[]) {
+    REPLAY r;
+    uint32_t interval = 60;
+    uint32_t record_ticks = 0;
+    bool wide = false;
+    int i;
+
+    memset(&r, 0, sizeof(r));
+    r.window_s[0] = 60;
+    r.window_s[1] = 300;
+    r.window_s[2] = 900;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+	if (!strcmp(argv[i], "-w") && i + 1 < argc) {
+	    if (sscanf(argv[++i], "%u,%u,%u", &r.window_s[0], &r.window_s[1],
+		       &r.window_s[2]) != 3) {
+		usage(argv[0]);
+	    }
+	    for (int w = 0; w < 3; w++) {
+		if (r.window_s[w] < LAX$K_WINDOW_MIN || r.window_s[w] > LAX$K_WINDOW_MAX) {
+		    fprintf(stderr, "windows must be %u to %u seconds\n",
+			LAX$K_WINDOW_MIN, LAX$K_WINDOW_MAX);
+		    return EXIT_FAILURE;
+		}
+	    }
+	} else if (!strcmp(argv[i], "-e") && i + 1 < argc) {
+	    interval = (uint32_t)strtoul(argv[++i], NULL, 10);
+	} else if (!strcmp(argv[i], "-x")) {
+	    wide = true;
+	} else if (!strcmp(argv[i], "-r") && i + 1 < argc) {
+	    record_ticks = (uint32_t)strtoul(argv[++i], NULL, 10);
+	    if (record_ticks == 0) {
+		usage(argv[0]);
+	    }
+	} else {
+	    usage(argv[0]);
+	}
+    }
+    if (i + 1 != argc) {
+	usage(argv[0]);
+    }
+
+    if (record_ticks != 0) {
+	return record_and_check(record_ticks, argv[i]);
+    }
+
+    if (!replay_file(argv[i], &r, interval, true, wide)) {
+	return EXIT_FAILURE;
+    }
+    fprintf(stderr, "%llu samples replayed, %llu missing, %llu repeated, "
+	"%.1f million a second\n", (unsigned long long)r.samples,
+	(unsigned long long)r.missing, (unsigned long long)r.repeated,
+	(r.nanoseconds == 0) ? 0.0 : r.samples * 1e3 / r.nanoseconds);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,218 @@
+/*
+ * Host-side (Linux) stress test for LAXDRIVER's lock-free reads.
+ *
+ * One thread runs the timer routine lax_stats_update_int as fast as it can,
+ * changing the number of busy mock CPUs on every tick so the averages never
+ * settle, while several reader threads call lax_read for the load average,
+ * status and per-disk records. After each tick the updater saves the values
+ * it produced under their update sequence number, and the readers check
+ * every snapshot they get against those, so a read that mixed the values
+ * of two ticks is reported as torn.
+ *
+ * Build and run on Linux with:
+ *
+ *   cc -O2 -pthread -o stress-lax-driver stress-lax-driver.c laxhost.c
+ *   ./stress-lax-driver [ticks [readers]]
+ *
+ * Copyright 2022, Jake Hamby.
+ * MIT License.
+ */
+
+#define LAX_HOST 1
+
+#include "laxdriver.c"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define STRESS_CPUS	64
+#define STRESS_DISKS	4	/* per-disk averages to check */
+
+/* The values published by one tick, indexed by sequence number / 2 */
+
+typedef struct {
+    volatile uint32_t done;		/* set once the rest is filled in */
+    uint32_t	avgs[9];
+    uint32_t	disk_avgs[STRESS_DISKS][3];
+} STRESS_TICK;
+
+static LAX_UCB stress_ucb;
+
+static STRESS_TICK *history;
+static uint32_t ticks = 100000;
+static volatile bool finished;
+
+/* Counts kept by each reader */
+
+typedef struct {
+    pthread_t	thread;
+    int		id;
+    uint64_t	reads;
+    uint64_t	torn;
+    uint64_t	stale;			/* same sequence number as last time */
+} STRESS_READER;
+
+static void stress_save_tick (void) {
+    const uint32_t seq = stress_ucb.ucb$l_seq;
+    STRESS_TICK *tick = &history[seq / 2];
+    const LAX_DISK *disks =
+	stress_ucb.ucb$ps_disks[stress_ucb.ucb$l_disk_bank];
+
+    memcpy(tick->avgs, stress_ucb.ucb$fx_avgs, sizeof(tick->avgs));
+    for (int i = 0; i < STRESS_DISKS; i++) {
+	memcpy(tick->disk_avgs[i], disks[i].lax$fx_avgs,
+	       sizeof(tick->disk_avgs[i]));
+    }
+    __atomic_store_n(&tick->done, 1, __ATOMIC_RELEASE);
+}
+
+static void *stress_update (void *arg) {
+    for (uint32_t i = 1; i <= ticks; i++) {
+	lax_host_build_cpus(STRESS_CPUS, (i * 7) % (STRESS_CPUS + 1));
+	exe$gq_systime += stress_ucb.ucb$l_tqe.tqe$q_delta;
+	lax_stats_update_int(NULL, &stress_ucb, &stress_ucb.ucb$l_tqe);
+	stress_save_tick();
+    }
+    finished = true;
+    return NULL;
+}
+
+/* Wait for the updater to save the tick with this sequence number */
+
+static const STRESS_TICK *stress_tick (uint32_t seq) {
+    const STRESS_TICK *tick = &history[seq / 2];
+
+    while (!__atomic_load_n(&tick->done, __ATOMIC_ACQUIRE))
+	;
+    return tick;
+}
+
+static bool stress_read (void *buf, uint32_t len, uint32_t rec) {
+    return lax_host_read((UCB *)&stress_ucb, buf, len, rec, 0) == SS$_NORMAL;
+}
+
+static void *stress_reader (void *arg) {
+    STRESS_READER *reader = arg;
+    uint32_t last_seq = UINT32_MAX;
+
+    for (uint32_t n = reader->id; !finished; n++) {
+	uint32_t seq = 0;
+	bool torn = false;
+
+	switch (n % 3) {
+	case 0: {
+	    uint32_t rec[10];
+
+	    if (!stress_read(rec, sizeof(rec), LAX$K_REC_AVGS)) {
+		torn = true;
+		break;
+	    }
+	    seq = rec[9];
+	    torn = (seq & 1) || (seq / 2 > ticks) ||
+		   memcmp(rec, stress_tick(seq)->avgs, sizeof(uint32_t) * 9);
+	    break;
+	}
+
+	case 1: {
+	    LAX_STATUS status;
+
+	    if (!stress_read(&status, sizeof(status), LAX$K_REC_STATUS)) {
+		torn = true;
+		break;
+	    }
+	    seq = status.lax$l_seq;
+	    torn = (seq & 1) || (seq / 2 > ticks) ||
+		   (seq != 0 && status.lax$l_period_ms != LAX_PERIOD_MS);
+	    break;
+	}
+
+	default: {
+	    struct {
+		LAX_DISK_HDR hdr;
+		LAX_DISK disk[STRESS_DISKS];
+	    } disks;
+
+	    if (!stress_read(&disks, sizeof(disks), LAX$K_REC_DISKS)) {
+		torn = true;
+		break;
+	    }
+	    seq = disks.hdr.lax$l_seq;
+	    torn = (seq & 1) || (seq / 2 > ticks);
+	    if (!torn && seq != 0) {
+		const STRESS_TICK *tick = stress_tick(seq);
+
+		torn = (disks.hdr.lax$l_count != STRESS_DISKS);
+		for (int i = 0; !torn && i < STRESS_DISKS; i++) {
+		    torn = memcmp(disks.disk[i].lax$fx_avgs, tick->disk_avgs[i],
+				  sizeof(tick->disk_avgs[i]));
+		}
+	    }
+	    break;
+	}
+	}
+
+	if (torn) {
+	    reader->torn++;
+	} else if (seq == last_seq) {
+	    reader->stale++;
+	}
+	last_seq = seq;
+	reader->reads++;
+    }
+
+    return NULL;
+}
+
+int main (int argc, char *argv[]) {
+    int nreaders = 4;
+
+    if (argc >= 2) {
+	ticks = (uint32_t)strtoul(argv[1], NULL, 10);
+    }
+    if (argc >= 3) {
+	nreaders = atoi(argv[2]);
+    }
+    if (ticks == 0 || nreaders <= 0) {
+	fprintf(stderr, "usage: %s [ticks [readers]]\n", argv[0]);
+	return EXIT_FAILURE;
+    }
+
+    history = calloc(ticks + 1, sizeof(STRESS_TICK));
+    STRESS_READER *readers = calloc(nreaders, sizeof(STRESS_READER));
+    if (!history || !readers) {
+	perror("calloc");
+	return EXIT_FAILURE;
+    }
+
+    /* a moderately busy system, with the disks in the per-disk record */
+    lax_host_build_runq(1000, 100, 30, 0xffff000000000000ULL);
+    lax_host_build_cpus(STRESS_CPUS, STRESS_CPUS);
+    lax_host_build_iodb(STRESS_DISKS, 100);
+
+    lax_host_unit_init((UCB *)&stress_ucb);
+    history[0].done = 1;		/* all zero before the first tick */
+
+    pthread_t updater;
+    for (int i = 0; i < nreaders; i++) {
+	readers[i].id = i;
+	pthread_create(&readers[i].thread, NULL, stress_reader, &readers[i]);
+    }
+    pthread_create(&updater, NULL, stress_update, NULL);
+
+    pthread_join(updater, NULL);
+
+    uint64_t reads = 0, torn = 0, stale = 0;
+    for (int i = 0; i < nreaders; i++) {
+	pthread_join(readers[i].thread, NULL);
+	reads += readers[i].reads;
+	torn += readers[i].torn;
+	stale += readers[i].stale;
+    }
+
+    printf("%u ticks, %d readers: %llu reads, %llu unchanged, %llu torn\n",
+	ticks, nreaders, (unsigned long long)reads,
+	(unsigned long long)stale, (unsigned long long)torn);
+
+    return torn ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -1,11 +1,13 @@
 /* Test the Load Average driver by reading from it.
  * You'll need to compile with /FLOAT=G_FLOAT to use the old driver,
  * and with /FLOAT=IEEE_FLOAT for the new, fixed-point driver.
+ * A first argument ending in a colon, such as LAX1:, picks the unit.
  */
 
 #define __NEW_STARLET 1
 #include <descrip.h>
 #include <iodef.h>
+#include <ssdef.h>
 #include <stsdef.h>
 #include <starlet.h>
 
@@ -15,6 +17,14 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if __IEEE_FLOAT == 1
+#include <gen64def.h>
+#include <secdef.h>
+#include <vadef.h>
+#include <builtins.h>
+#include "laxdef.h"
+#endif
+
 int main(int argc, char *argv[]) {
 
 #if __IEEE_FLOAT == 1
@@ -27,6 +37,28 @@ int main(int argc, char *argv[]) {
     int status = EXIT_SUCCESS;
     unsigned short channel;
 
+    /* use another unit if one is named */
+    if (argc >= 2 && argv[1][0] != '\0' &&
+	argv[1][strlen(argv[1]) - 1] == ':') {
+	devnam.dsc$w_length = (unsigned short)strlen(argv[1]);
+	devnam.dsc$a_pointer = argv[1];
+	argv++;
+	argc--;
+    }
+
+#if __IEEE_FLOAT == 1
+    /* LAX0: publishes LAX$STATS, and other units LAX$STATS_LAXn */
+    char secname_buf[64] = LAX$K_SECTION_NAME;
+    $DESCRIPTOR (secnam, secname_buf);
+
+    if (devnam.dsc$w_length > 1 && (devnam.dsc$w_length != 5 ||
+	strncasecmp(devnam.dsc$a_pointer, "LAX0:", 5) != 0)) {
+	snprintf(secname_buf, sizeof(secname_buf), "%s_%.*s",
+	    LAX$K_SECTION_NAME, devnam.dsc$w_length - 1, devnam.dsc$a_pointer);
+    }
+    secnam.dsc$w_length = (unsigned short)strlen(secname_buf);
+#endif
+
     /* assign the channel */
     status = sys$assign(&devnam, &channel, 0, NULL);
     if (!$VMS_STATUS_SUCCESS(status)) {
@@ -34,6 +66,414 @@ int main(int argc, char *argv[]) {
 	return status;
     }
 
+#if __IEEE_FLOAT == 1
+    /* print the per-disk queue length averages */
+    if (argc >= 2 && !strcasecmp("-q", argv[1])) {
+	static struct {
+	    LAX_DISK_HDR hdr;
+	    LAX_DISK disk[256];
+	} disks;
+	static const double scale = (1.0 / (1 << LAX$K_FX_SCALE));
+
+	status = sys$qiow(0, channel, IO$_READVBLK, NULL, NULL, 0,
+			  &disks, sizeof(disks), LAX$K_REC_DISKS, 0, 0, 0);
+	if (!$VMS_STATUS_SUCCESS(status)) {
+	    fprintf(stderr, "test-lax-driver $qiow err\n");
+	    goto cleanup;
+	}
+
+	for (uint32_t i = 0; i < disks.hdr.lax$l_count; i++) {
+	    const LAX_DISK *disk = &disks.disk[i];
+	    printf("%-16.16s  %-12g  %-12g  %-12g\n", disk->lax$t_name,
+		((double)disk->lax$fx_avgs[0] * scale),
+		((double)disk->lax$fx_avgs[1] * scale),
+		((double)disk->lax$fx_avgs[2] * scale));
+	}
+	if (disks.hdr.lax$l_flags & LAX$M_DISKS_OVERFLOW) {
+	    printf("(the driver had no pool to track every disk)\n");
+	}
+	goto cleanup;
+    }
+#endif
+
+#if __IEEE_FLOAT == 1
+    /* print the run queue averages for each priority in use */
+    if (argc >= 2 && !strcasecmp("-h", argv[1])) {
+	static LAX_PRIO prio;
+	static const double scale = (1.0 / (1 << LAX$K_FX_SCALE));
+
+	status = sys$qiow(0, channel, IO$_READVBLK, NULL, NULL, 0,
+			  &prio, sizeof(prio), LAX$K_REC_PRIO, 0, 0, 0);
+	if (!$VMS_STATUS_SUCCESS(status)) {
+	    fprintf(stderr, "test-lax-driver $qiow err\n");
+	    goto cleanup;
+	}
+
+	for (int pri = 63; pri >= 0; pri--) {
+	    const uint32_t *avgs = prio.lax$fx_avgs[pri];
+	    if (avgs[0] | avgs[1] | avgs[2]) {
+		printf("priority %2d:   %-12g  %-12g  %-12g\n", pri,
+		    ((double)avgs[0] * scale), ((double)avgs[1] * scale),
+		    ((double)avgs[2] * scale));
+	    }
+	}
+	goto cleanup;
+    }
+#endif
+
+#if __IEEE_FLOAT == 1
+    /* break the load average down by thread state */
+    if (argc >= 2 && !strcasecmp("-c", argv[1])) {
+	static const char *const names[4] = {
+	    "computable:", "outswapped:", "page wait: ", "running:   "
+	};
+	static const double scale = (1.0 / (1 << LAX$K_FX_SCALE));
+	LAX_CLASSES classes;
+
+	status = sys$qiow(0, channel, IO$_READVBLK, NULL, NULL, 0,
+			  &classes, sizeof(classes), LAX$K_REC_CLASSES, 0, 0, 0);
+	if (!$VMS_STATUS_SUCCESS(status)) {
+	    fprintf(stderr, "test-lax-driver $qiow err\n");
+	    goto cleanup;
+	}
+
+	for (int i = 0; i < 4; i++) {
+	    const uint32_t *avgs = classes.lax$fx_avgs[i];
+	    printf("%s   %-12g  %-12g  %-12g\n", names[i],
+		((double)avgs[0] * scale), ((double)avgs[1] * scale),
+		((double)avgs[2] * scale));
+	}
+	goto cleanup;
+    }
+#endif
+
+#if __IEEE_FLOAT == 1
+    /* show the memory pressure averages */
+    if (argc >= 2 && !strcasecmp("-v", argv[1])) {
+	static const char *const names[LAX$K_MEM_COUNT] = {
+	    "colpg wait:", "pgflt wait:", "freepg wait:", "free pages:",
+	    "faults/s:  "
+	};
+	static const double scale = (1.0 / 4294967296.0);
+	LAX_MEMORY mem;
+
+	status = sys$qiow(0, channel, IO$_READVBLK, NULL, NULL, 0,
+			  &mem, sizeof(mem), LAX$K_REC_MEMORY, 0, 0, 0);
+	if (!$VMS_STATUS_SUCCESS(status)) {
+	    fprintf(stderr, "test-lax-driver $qiow err\n");
+	    goto cleanup;
+	}
+
+	printf("%-12s %10s   %-12s  %-12s  %-12s\n", "", "now", "1 min",
+	    "5 min", "15 min");
+	for (int i = 0; i < LAX$K_MEM_COUNT; i++) {
+	    const uint64_t *avgs = mem.lax$q_avgs[i];
+	    printf("%-12s %10u   %-12g  %-12g  %-12g\n", names[i],
+		mem.lax$l_sample[i], ((double)avgs[0] * scale),
+		((double)avgs[1] * scale), ((double)avgs[2] * scale));
+	}
+	goto cleanup;
+    }
+#endif
+
+#if __IEEE_FLOAT == 1
+    /* show the sliding window peaks, after starting to track them if
+     * asked to (requires CMKRNL priv)
+     */
+    if (argc >= 2 && !strcasecmp("-k", argv[1])) {
+	static const char *const names[2] = { "threads:   ", "dsk q len: " };
+	static const uint32_t zero = 0;
+	LAX_PEAKS peaks;
+
+	status = SS$_NORMAL;
+	if (argc >= 3 && !strcasecmp("start", argv[2])) {
+	    status = sys$qiow(0, channel, IO$_WRITEVBLK, NULL, NULL, 0,
+			      &zero, sizeof(zero), LAX$K_CMD_PEAKS, 0, 0, 0);
+	}
+	if ($VMS_STATUS_SUCCESS(status)) {
+	    status = sys$qiow(0, channel, IO$_READVBLK, NULL, NULL, 0,
+			      &peaks, sizeof(peaks), LAX$K_REC_PEAKS, 0, 0, 0);
+	}
+	if (status == SS$_DEVINACT) {
+	    fprintf(stderr, "the peaks aren't tracked; use '-k start'\n");
+	    goto cleanup;
+	}
+	if (!$VMS_STATUS_SUCCESS(status)) {
+	    fprintf(stderr, "test-lax-driver $qiow err\n");
+	    goto cleanup;
+	}
+
+	printf("%u seconds tracked\n", peaks.lax$l_tracked_ms / 1000);
+	printf("             max 1m  min 1m  max 5m  min 5m  max 15m min 15m\n");
+	for (int i = 0; i < 2; i++) {
+	    printf("%s", names[i]);
+	    for (int w = 0; w < 3; w++) {
+		printf("  %6d  %6d", (int)peaks.lax$l_max[i][w],
+		    (int)peaks.lax$l_min[i][w]);
+	    }
+	    printf("\n");
+	}
+	goto cleanup;
+    }
+#endif
+
+#if __IEEE_FLOAT == 1
+    /* show what the driver's own updates cost */
+    if (argc >= 2 && !strcasecmp("-f", argv[1])) {
+	static const char *const names[LAX$K_PROF_COUNT] = {
+	    "tick cycles", "SCHED cycles", "KTBs", "UCBs", "late us"
+	};
+	LAX_PROFILE prof;
+
+	status = sys$qiow(0, channel, IO$_READVBLK, NULL, NULL, 0,
+			  &prof, sizeof(prof), LAX$K_REC_PROFILE, 0, 0, 0);
+	if (!$VMS_STATUS_SUCCESS(status)) {
+	    fprintf(stderr, "test-lax-driver $qiow err\n");
+	    goto cleanup;
+	}
+
+	printf("%llu updates, %llu late, %llu periods missed, "
+	    "%llu without disks, %llu on another unit's scan\n\n",
+	    (unsigned long long)prof.lax$q_ticks,
+	    (unsigned long long)prof.lax$q_late_ticks,
+	    (unsigned long long)prof.lax$q_missed,
+	    (unsigned long long)prof.lax$q_iodb_busy,
+	    (unsigned long long)prof.lax$q_shared);
+	printf("%-13s %10s %12s %10s   %s\n", "", "min", "mean", "max",
+	    "histogram: bits, count");
+	for (int i = 0; i < LAX$K_PROF_COUNT; i++) {
+	    const LAX_PROF_STAT *stat = &prof.lax$r_stat[i];
+	    uint64_t count = 0;
+
+	    for (int b = 0; b < LAX$K_PROF_BUCKETS; b++) {
+		count += stat->lax$l_hist[b];
+	    }
+	    if (count == 0) {
+		printf("%-13s %10s\n", names[i], "-");
+		continue;
+	    }
+
+	    printf("%-13s %10u %12.1f %10u  ", names[i], stat->lax$l_min,
+		(double)stat->lax$q_sum / count, stat->lax$l_max);
+	    for (int b = 0; b < LAX$K_PROF_BUCKETS; b++) {
+		if (stat->lax$l_hist[b] != 0) {
+		    printf(" %d:%u", b, stat->lax$l_hist[b]);
+		}
+	    }
+	    printf("\n");
+	}
+	goto cleanup;
+    }
+#endif
+
+#if __IEEE_FLOAT == 1
+    /* read the load averages with 32 fraction bits */
+    if (argc >= 2 && !strcasecmp("-x", argv[1])) {
+	static const double scale = (1.0 / 4294967296.0);
+	LAX_AVGS64 avgs64;
+
+	status = sys$qiow(0, channel, IO$_READVBLK, NULL, NULL, 0,
+			  &avgs64, sizeof(avgs64), LAX$K_REC_AVGS64, 0, 0, 0);
+	if (!$VMS_STATUS_SUCCESS(status)) {
+	    fprintf(stderr, "test-lax-driver $qiow err\n");
+	    goto cleanup;
+	}
+
+	const uint64_t *q = avgs64.lax$q_avgs;
+	printf("load average:  %-14.10g  %-14.10g  %-14.10g\n",
+	    ((double)q[0] * scale), ((double)q[1] * scale), ((double)q[2] * scale));
+	printf("avg priority:  %-14.10g  %-14.10g  %-14.10g\n",
+	    ((double)q[3] * scale), ((double)q[4] * scale), ((double)q[5] * scale));
+	printf("av dsk q len:  %-14.10g  %-14.10g  %-14.10g\n",
+	    ((double)q[6] * scale), ((double)q[7] * scale), ((double)q[8] * scale));
+	goto cleanup;
+    }
+#endif
+
+#if __IEEE_FLOAT == 1
+    /* dump the raw samples still held by the driver, oldest first */
+    if (argc >= 2 && !strcasecmp("-s", argv[1])) {
+	static struct {
+	    LAX_SAMPLE_HDR hdr;
+	    LAX_SAMPLE sample[64];
+	} samples;
+	uint32_t next_seq = 0;
+
+	do {
+	    status = sys$qiow(0, channel, IO$_READVBLK, NULL, NULL, 0,
+			      &samples, sizeof(samples), LAX$K_REC_SAMPLES,
+			      next_seq, 0, 0);
+	    if (!$VMS_STATUS_SUCCESS(status)) {
+		fprintf(stderr, "test-lax-driver $qiow err\n");
+		goto cleanup;
+	    }
+	    if (samples.hdr.lax$l_lost) {
+		printf("(%u samples lost)\n", samples.hdr.lax$l_lost);
+	    }
+
+	    for (uint32_t i = 0; i < samples.hdr.lax$l_count; i++) {
+		const LAX_SAMPLE *s = &samples.sample[i];
+		printf("%-10u %20llu  %6u  %4d  %6d  %5u  %s%s%s\n", s->lax$l_seq,
+		    (unsigned long long)s->lax$q_time, s->lax$l_proc_count,
+		    (s->lax$l_lowest_pri == LAX$K_NO_PRI) ?
+			-1 : (int)s->lax$l_lowest_pri,
+		    (s->lax$l_disk_qlen == LAX$K_NO_QLEN) ?
+			-1 : (int)s->lax$l_disk_qlen,
+		    s->lax$l_period_ms,
+		    (s->lax$l_flags & LAX$M_APPROX) ? "approx " : "",
+		    (s->lax$l_flags & LAX$M_STALE) ? "stale " : "",
+		    (s->lax$l_flags & LAX$M_RESTARTED) ? "restarted" : "");
+	    }
+	    next_seq = samples.hdr.lax$l_next_seq;
+	} while (samples.hdr.lax$l_count == 64);
+	goto cleanup;
+    }
+#endif
+
+#if __IEEE_FLOAT == 1
+    /* publish the averages page and create the unit's global section
+     * over it (requires CMKRNL, PFNMAP, PRMGBL and SYSGBL privs)
+     */
+    if (argc >= 2 && !strcasecmp("-g", argv[1])) {
+	static const uint32_t zero = 0;
+	LAX_PAGE_INFO info;
+
+	status = sys$qiow(0, channel, IO$_WRITEVBLK, NULL, NULL, 0,
+			  &zero, sizeof(zero), LAX$K_CMD_PUBLISH, 0, 0, 0);
+	if ($VMS_STATUS_SUCCESS(status)) {
+	    status = sys$qiow(0, channel, IO$_READVBLK, NULL, NULL, 0,
+			      &info, sizeof(info), LAX$K_REC_PAGE, 0, 0, 0);
+	}
+	if (!$VMS_STATUS_SUCCESS(status)) {
+	    fprintf(stderr, "test-lax-driver $qiow err\n");
+	    goto cleanup;
+	}
+
+	/* system and owner may write, group and world may only read;
+	 * leaving out SEC$M_WRT makes the section read-only anyway.
+	 */
+	status = sys$crmpsc_gpfn_64(&secnam, NULL, 0xEE00, 1,
+				    (unsigned int)info.lax$q_pfn,
+				    SEC$M_PERM | SEC$M_SYSGBL);
+	if (!$VMS_STATUS_SUCCESS(status)) {
+	    fprintf(stderr, "test-lax-driver $crmpsc_gpfn_64 err\n");
+	}
+	goto cleanup;
+    }
+
+    /* read the load averages from the global section, without any I/O */
+    if (argc >= 2 && !strcasecmp("-m", argv[1])) {
+	GENERIC_64 region;
+	void *va;
+	unsigned __int64 length;
+	static const double scale = (1.0 / (1 << LAX$K_FX_SCALE));
+
+	region.gen64$q_quadword = VA$C_P0;
+	status = sys$mgblsc_64(&secnam, NULL, &region, 0, 0, 0,
+			       SEC$M_SYSGBL | SEC$M_EXPREG, &va, &length);
+	if (!$VMS_STATUS_SUCCESS(status)) {
+	    fprintf(stderr, "test-lax-driver $mgblsc_64 err\n");
+	    goto cleanup;
+	}
+
+	const volatile LAX_PAGE *page = (const volatile LAX_PAGE *)va;
+	uint32_t generation;
+
+	do {
+	    generation = page->lax$l_generation;
+	    __MB();
+	    for (int i = 0; i < 9; i++) {
+		avgs[i] = page->lax$fx_avgs[i];
+	    }
+	    __MB();
+	} while ((generation & 1) || generation != page->lax$l_generation);
+
+	printf("generation %u\n", generation);
+	printf("load average:  %-12g  %-12g  %-12g\n",
+	    ((double)avgs[0] * scale), ((double)avgs[1] * scale), ((double)avgs[2] * scale));
+	goto cleanup;
+    }
+#endif
+
+#if __IEEE_FLOAT == 1
+    /* wait for load average n to rise to (-w) or fall to (-b) a value */
+    if (argc >= 4 && (!strcasecmp("-w", argv[1]) || !strcasecmp("-b", argv[1]))) {
+	static const double scale = (1 << LAX$K_FX_SCALE);
+	uint32_t flags = (uint32_t)strtoul(argv[2], NULL, 10) & LAX$M_WAIT_INDEX;
+	uint32_t threshold = (uint32_t)(strtod(argv[3], NULL) * scale);
+	uint32_t hysteresis = (argc >= 5) ?
+			      (uint32_t)(strtod(argv[4], NULL) * scale) : 0;
+	struct {
+	    unsigned short status;
+	    unsigned short count;
+	    uint32_t value;
+	} iosb;
+
+	if (!strcasecmp("-b", argv[1])) {
+	    flags |= LAX$M_WAIT_BELOW;
+	}
+
+	status = sys$qiow(0, channel, IO$_READVBLK, &iosb, NULL, 0,
+			  NULL, 0, LAX$K_REC_WAIT, flags, threshold, hysteresis);
+	if ($VMS_STATUS_SUCCESS(status)) {
+	    status = iosb.status;
+	}
+	if (!$VMS_STATUS_SUCCESS(status)) {
+	    fprintf(stderr, "test-lax-driver $qiow err\n");
+	    goto cleanup;
+	}
+
+	printf("load average %s: %g\n", argv[2], (double)iosb.value / scale);
+	goto cleanup;
+    }
+#endif
+
+#if __IEEE_FLOAT == 1
+    /* set the sampling period in milliseconds (requires CMKRNL priv) */
+    if (argc >= 3 && !strcasecmp("-p", argv[1])) {
+	uint32_t period_ms = (uint32_t)strtoul(argv[2], NULL, 10);
+
+	status = sys$qiow(0, channel, IO$_WRITEVBLK, NULL, NULL, 0,
+			  &period_ms, sizeof(period_ms), LAX$K_CMD_PERIOD, 0, 0, 0);
+	if (!$VMS_STATUS_SUCCESS(status)) {
+	    fprintf(stderr, "test-lax-driver $qiow err\n");
+	}
+	goto cleanup;
+    }
+#endif
+
+#if __IEEE_FLOAT == 1
+    /* set the three averaging windows in seconds (requires CMKRNL priv) */
+    if (argc >= 5 && !strcasecmp("-t", argv[1])) {
+	uint32_t window_s[3];
+
+	for (int i = 0; i < 3; i++) {
+	    window_s[i] = (uint32_t)strtoul(argv[2 + i], NULL, 10);
+	}
+
+	status = sys$qiow(0, channel, IO$_WRITEVBLK, NULL, NULL, 0,
+			  window_s, sizeof(window_s), LAX$K_CMD_WINDOWS, 0, 0, 0);
+	if (!$VMS_STATUS_SUCCESS(status)) {
+	    fprintf(stderr, "test-lax-driver $qiow err\n");
+	}
+	goto cleanup;
+    }
+#endif
+
+#if __IEEE_FLOAT == 1
+    /* sample lazily after so many seconds without reads (requires CMKRNL priv) */
+    if (argc >= 3 && !strcasecmp("-i", argv[1])) {
+	uint32_t idle_s = (uint32_t)strtoul(argv[2], NULL, 10);
+
+	status = sys$qiow(0, channel, IO$_WRITEVBLK, NULL, NULL, 0,
+			  &idle_s, sizeof(idle_s), LAX$K_CMD_IDLE, 0, 0, 0);
+	if (!$VMS_STATUS_SUCCESS(status)) {
+	    fprintf(stderr, "test-lax-driver $qiow err\n");
+	}
+	goto cleanup;
+    }
+#endif
+
     /* handle the disable/enable update option (requires CMKRNL priv) */
     if (argc >= 2) {
 	bool write_byte;
@@ -43,7 +483,30 @@ int main(int argc, char *argv[]) {
 	    write_byte = false;
 	} else {
 	    fprintf(stderr, "error: ignoring unrecognized option '%s'\n", argv[1]);
+	    fprintf(stderr, "name a unit such as 'LAX1:' before the option to use it\n");
+	    fprintf(stderr, "instead of the first one.\n");
 	    fprintf(stderr, "use '-d' to disable updates and '-e' to enable them.\n");
+#if __IEEE_FLOAT == 1
+	    fprintf(stderr, "use '-q' to show the average queue length of each disk.\n");
+	    fprintf(stderr, "use '-c' to break the load average down by thread state.\n");
+	    fprintf(stderr, "use '-v' to show the page waits, free list and fault rate.\n");
+	    fprintf(stderr, "use '-h' to show the run queue averages by priority.\n");
+	    fprintf(stderr, "use '-s' to dump the recent raw samples.\n");
+	    fprintf(stderr, "use '-x' to show the load averages in full precision.\n");
+	    fprintf(stderr, "use '-k' to show the 1, 5 and 15 minute peaks, and\n");
+	    fprintf(stderr, "'-k start' to start tracking them first.\n");
+	    fprintf(stderr, "use '-f' to show what the driver's own updates cost.\n");
+	    fprintf(stderr, "use '-g' to create the unit's global section, LAX$STATS\n");
+	    fprintf(stderr, "for LAX0: and LAX$STATS_LAXn for the others,\n");
+	    fprintf(stderr, "and '-m' to read the load averages through it.\n");
+	    fprintf(stderr, "use '-w n value [hyst]' to wait for average n (0-8) to\n");
+	    fprintf(stderr, "rise to a value, or '-b n value [hyst]' to fall to it.\n");
+	    fprintf(stderr, "use '-p ms' to set the sampling period (100, 250, 1000 or 5000).\n");
+	    fprintf(stderr, "use '-t s1 s2 s3' to set the averaging windows in seconds,\n");
+	    fprintf(stderr, "0 for the standard 60, 300 or 900.\n");
+	    fprintf(stderr, "use '-i s' to sample lazily after s seconds without reads,\n");
+	    fprintf(stderr, "0 to always sample at the full rate.\n");
+#endif
 	    status = EXIT_FAILURE;
 	    goto cleanup;
 	}
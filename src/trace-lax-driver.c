@@ -0,0 +1,129 @@
+/* Record LAXDRIVER's raw samples into a trace file for replay-lax-trace.
+ *
+ * Drains the driver's ring of raw samples in batches every few seconds
+ * and appends them to the file, which is created with a LAX_TRACE_HDR if
+ * it doesn't exist. The ring holds a little over eight minutes of samples
+ * at the default one second period, and under a minute at 100 ms, so the
+ * interval should be well under that. Samples that were overwritten
+ * before they were read are reported, and show up in the trace as gaps.
+ *
+ *   trace-lax-driver file [seconds [device]]
+ *
+ * The device is LAX0: unless another unit is named.
+ *
+ * Runs until stopped with Ctrl/Y or Ctrl/C. Compile with /FLOAT=IEEE.
+ *
+ * Copyright 2022, Jake Hamby.
+ * MIT License.
+ */
+
+#define __NEW_STARLET 1
+#include <descrip.h>
+#include <gen64def.h>
+#include <iodef.h>
+#include <iosbdef.h>
+#include <stsdef.h>
+#include <starlet.h>
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "laxtrace.h"
+
+#define TRACE_BATCH	64		/* samples per $QIO */
+
+int main(int argc, char *argv[]) {
+    $DESCRIPTOR (devnam, "LAX0:");
+    static struct {
+	LAX_SAMPLE_HDR hdr;
+	LAX_SAMPLE sample[TRACE_BATCH];
+    } samples;
+    unsigned int interval = 10;
+    uint32_t next_seq = 0;
+    unsigned short channel;
+    IOSB iosb;
+    FILE *fp;
+    int status;
+
+    if (argc < 2) {
+	fprintf(stderr, "usage: trace-lax-driver file [seconds [device]]\n");
+	return EXIT_FAILURE;
+    }
+    if (argc >= 3) {
+	interval = (unsigned int)strtoul(argv[2], NULL, 10);
+	if (interval == 0) {
+	    interval = 1;
+	}
+    }
+    if (argc >= 4) {
+	devnam.dsc$w_length = (unsigned short)strlen(argv[3]);
+	devnam.dsc$a_pointer = argv[3];
+    }
+
+    /* assign the channel */
+    status = sys$assign(&devnam, &channel, 0, NULL);
+    if (!$VMS_STATUS_SUCCESS(status)) {
+	fprintf(stderr, "trace-lax-driver $assign err\n");
+	return status;
+    }
+
+    /* append to the file, writing the header if it's new */
+    fp = fopen(argv[1], "ab");
+    if (fp == NULL) {
+	perror(argv[1]);
+	return EXIT_FAILURE;
+    }
+    if (ftell(fp) == 0) {
+	LAX_TRACE_HDR hdr;
+	GENERIC_64 now;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.lax$t_magic, LAX$K_TRACE_MAGIC, sizeof(hdr.lax$t_magic));
+	hdr.lax$w_version = LAX$K_TRACE_VERSION;
+	hdr.lax$w_size = sizeof(hdr);
+	hdr.lax$l_sample_size = sizeof(LAX_SAMPLE);
+	sys$gettim(&now);
+	hdr.lax$q_created = now.gen64$q_quadword;
+	if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1) {
+	    perror(argv[1]);
+	    return EXIT_FAILURE;
+	}
+    }
+
+    for (;;) {
+	/* read until the ring is empty, then wait for more */
+	do {
+	    status = sys$qiow(0, channel, IO$_READVBLK, &iosb, NULL, 0,
+			      &samples, sizeof(samples), LAX$K_REC_SAMPLES,
+			      next_seq, 0, 0);
+	    if ($VMS_STATUS_SUCCESS(status)) {
+		status = iosb.iosb$w_status;
+	    }
+	    if (!$VMS_STATUS_SUCCESS(status)) {
+		fprintf(stderr, "trace-lax-driver $qiow err\n");
+		fclose(fp);
+		return status;
+	    }
+	    if (samples.hdr.lax$l_lost) {
+		fprintf(stderr, "trace-lax-driver: %u samples lost\n",
+		    samples.hdr.lax$l_lost);
+	    }
+
+	    if (samples.hdr.lax$l_count != 0 &&
+		fwrite(samples.sample, sizeof(LAX_SAMPLE),
+		       samples.hdr.lax$l_count, fp) != samples.hdr.lax$l_count) {
+		perror(argv[1]);
+		fclose(fp);
+		return EXIT_FAILURE;
+	    }
+	    next_seq = samples.hdr.lax$l_next_seq;
+	} while (samples.hdr.lax$l_count == TRACE_BATCH);
+
+	fflush(fp);
+	sleep(interval);
+    }
+}